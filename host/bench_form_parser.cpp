@@ -0,0 +1,221 @@
+/* Micro-benchmark of the form parsing of the POST handlers.
+ * legacy: parse_url() and data_decode() as they were in HTTP_server.cpp, called the way the handlers called them
+ *         (SubmitMode looked up its three keys up to six times).
+ * form_parse: the single-pass in-place parser of form_parser.cpp, followed by the same lookups with form_get().
+ * Reports the time and the heap allocations per parsed body.
+ * The JSON bodies of the same forms are checked first: form_parse_json() has to return the expected value of every key,
+ * NULL for the keys that are null. Exits with 1 if one doesn't.
+ *
+ * Usage: bench_form_parser [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include "form_parser.h"
+
+using namespace std;
+
+#define DEFAULT_ITERATIONS 200000
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations++;
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+/* ---- The legacy functions, unchanged ---- */
+
+//Because the data is URL encoded, it is necessary to decode it.
+string data_decode(string data)
+{
+    string decoded_data = "";
+    for (size_t i = 0; i < data.size(); i++) {
+        if (data[i] == '%' && i + 2 < data.size() && isxdigit(data[i + 1]) && isxdigit(data[i + 2])) {
+            //If it's a percent-encoded
+            int value;
+            sscanf(data.substr(i + 1, 2).c_str(), "%x", &value);
+            decoded_data += static_cast<char>(value);
+            i += 2; // Move ahead by 2 characters
+        } else if (data[i] == '+') {
+            //Replace '+' with space
+            decoded_data += ' ';
+        } else {
+            //Copy the character
+            decoded_data += data[i];
+        }
+    }
+    
+    return decoded_data;
+}
+
+//Parsing the data from the url
+string parse_url(string url_response, string data)
+{
+    //Find the data in the url
+    data = data + "=";
+    size_t position = url_response.find(data);
+    //Execute the code only if the data has been found
+    if (position != string::npos)
+    {
+        //Finds the position where our data starts and where it ends
+        size_t start = position + data.length();
+        size_t end = url_response.find_first_of("&", start);
+        //Copies the substring where the data is located.
+        if (end == string::npos)
+        {
+            data = url_response.substr(start);
+        }
+        else
+        {
+            data = url_response.substr(start, end-start);
+        }
+        return data;
+    }
+    else
+    {
+        return "";
+    }
+}
+
+/* ---- The forms ---- */
+
+struct Form_case
+{
+    const char* name;
+    const char* body;
+    const char* keys[3];
+    int lookups;        //How many times the legacy handler called parse_url()
+    bool decoded;       //Whether the legacy handler decoded the values
+};
+
+static const Form_case form_cases[] =
+{
+    {"SubmitMode", "choosemode=manual&window=-35&temp=22", {"choosemode", "temp", "window"}, 6, false},
+    {"SubmitWiFi", "ssid=Home+Network+%232&password=p%40ssw0rd%21%26more", {"ssid", "password", NULL}, 2, true},
+    {"SubmitAPI", "apikey=0123456789abcdef0123456789abcdef", {"apikey", NULL, NULL}, 2, true},
+    {"SubmitCoordinates", "lat=47.50&lon=19.04", {"lat", "lon", NULL}, 4, false},
+};
+
+struct Json_case
+{
+    const char* body;
+    const char* keys[2];
+    const char* values[2];      //NULL if the key must be missing
+};
+
+static const Json_case json_cases[] =
+{
+    {"{\"choosemode\":\"manual\",\"window\":-35}", {"choosemode", "window"}, {"manual", "-35"}},
+    {"{\"ssid\": \"Home \\\"2\\\"\", \"password\": \"p@ss\"}", {"ssid", "password"}, {"Home \"2\"", "p@ss"}},
+    {"{\"apikey\":null}", {"apikey", NULL}, {NULL, NULL}},
+    {"{\"apikey\": \"null\"}", {"apikey", NULL}, {"null", NULL}},
+    {"{\"lat\": 47.50, \"lon\": null }", {"lat", "lon"}, {"47.50", NULL}},
+};
+
+static bool check_json_case(const Json_case &json_case)
+{
+    char buf[256];
+    size_t length = strlen(json_case.body);
+    memcpy(buf, json_case.body, length + 1);
+    Form_fields form;
+    if (form_parse_json(buf, length, &form) < 0)
+        return false;
+    for (int i = 0; i < 2 && json_case.keys[i] != NULL; i++)
+    {
+        const char* value = form_get(&form, json_case.keys[i]);
+        const char* expected = json_case.values[i];
+        if (expected == NULL ? value != NULL : value == NULL || strcmp(value, expected) != 0)
+            return false;
+    }
+    return true;
+}
+
+static volatile size_t sink = 0;
+
+static void legacy_case(const Form_case &form_case)
+{
+    const char* buf = form_case.body;
+    int key_count = 0;
+    while (key_count < 3 && form_case.keys[key_count] != NULL)
+        key_count++;
+    for (int i = 0; i < form_case.lookups; i++)
+    {
+        string value = parse_url(buf, form_case.keys[i % key_count]);
+        if (form_case.decoded)
+            value = data_decode(value);
+        sink += value.size();
+    }
+}
+
+static void form_parse_case(const Form_case &form_case, char* buf, size_t length)
+{
+    memcpy(buf, form_case.body, length + 1);
+    Form_fields form;
+    form_parse(buf, length, &form);
+    for (int i = 0; i < 3 && form_case.keys[i] != NULL; i++)
+    {
+        const char* value = form_get(&form, form_case.keys[i]);
+        sink += value != NULL ? strlen(value) : 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations <= 0)
+    {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    bool passed = true;
+    for (const Json_case &json_case : json_cases)
+    {
+        bool as_expected = check_json_case(json_case);
+        passed = passed && as_expected;
+        printf("JSON %-40s %s\n", json_case.body, as_expected ? "ok" : "UNEXPECTED");
+    }
+
+    printf("%-18s %14s %14s %14s %14s\n", "form", "legacy ns", "legacy allocs", "form_parse ns", "form_parse allocs");
+    for (size_t c = 0; c < sizeof(form_cases) / sizeof(form_cases[0]); c++)
+    {
+        const Form_case &form_case = form_cases[c];
+        char buf[256];
+        size_t length = strlen(form_case.body);
+
+        allocations = 0;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            legacy_case(form_case);
+        double legacy_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+        double legacy_allocations = (double)allocations / iterations;
+
+        allocations = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+            form_parse_case(form_case, buf, length);
+        double parser_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+        double parser_allocations = (double)allocations / iterations;
+
+        printf("%-18s %14.1f %14.1f %14.1f %14.1f\n", form_case.name, legacy_ns, legacy_allocations, parser_ns, parser_allocations);
+    }
+    return passed ? 0 : 1;
+}
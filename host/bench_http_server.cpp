@@ -0,0 +1,438 @@
+/* Load test of the webserver. src/HTTP_server.cpp, with the worker pool, the form parser, the JSON writer,
+ * the write-behind configuration storage and the job queue, is built for the host on the POSIX httpd shim
+ * (httpd_shim.cpp) and serves the files of the data directory.
+ * The server runs in a child process, so its heap allocations are counted apart from the load generator's.
+ * Keep-alive clients in a closed loop drive one endpoint at a time: GET / and the four form POSTs.
+ * Reports the throughput, the p50/p99 latency and the allocations of the server per request.
+ * The Wi-Fi, weather and WebSocket parts are stubs, a Wi-Fi or weather job finishes at once.
+ *
+ * Usage: bench_http_server [concurrency] [seconds per endpoint] [port]
+ */
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs_emulator.h"
+#include "store_data.h"
+#include "room_data.h"
+#include "weather_data.h"
+#include "job_queue.h"
+#include "WS_telemetry.h"
+#include "HTTP_server.h"
+#include "HTTP_workers.h"
+#include "HTTP_request_handler.h"
+
+#define DEFAULT_CONCURRENCY     4
+#define DEFAULT_SECONDS         3
+#define DEFAULT_PORT            8080
+#define NVS_PATH                "bench_http_server_nvs.bin"
+#define NVS_PARTITION_SIZE      0x6000
+#define CLIENT_BUFFER_SIZE      4096
+#define STARTUP_TIMEOUT_MS      5000
+
+/* ---- Counting the heap allocations of the server process ---- */
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+//Set in the server process only. The counter is shared memory, the load generator reads it between the phases.
+static std::atomic<uint64_t> *server_allocations = NULL;
+
+extern "C" void *malloc(size_t size)
+{
+    if (server_allocations != NULL)
+        server_allocations->fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (server_allocations != NULL)
+        server_allocations->fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (server_allocations != NULL)
+        server_allocations->fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/* ---- The firmware modules that aren't part of the host build ---- */
+
+Room_data Internal_room_data;
+Weather_data Weather;
+
+void telemetry_notify(uint32_t changes)
+{
+}
+
+esp_err_t ws_telemetry_register(httpd_handle_t server)
+{
+    return ESP_OK;
+}
+
+void ws_telemetry_close_fn(httpd_handle_t server, int sockfd)
+{
+    close(sockfd);
+}
+
+void ws_telemetry_stop()
+{
+}
+
+void wifi_restart(const char *ssid, const char *pass)
+{
+}
+
+bool weather_service_send(Weather_command command)
+{
+    return true;
+}
+
+static void run_server(uint16_t port)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    unlink(NVS_PATH);
+    nvs_emu_configure(NVS_PATH, NVS_PARTITION_SIZE);
+    nvs_config_init();
+    init_web_assets();
+    if (job_queue_init() != ESP_OK)
+        exit(1);
+    host_httpd_set_port(port);
+    if (start_webserver() == NULL)
+        exit(1);
+    while (true)
+        pause();
+}
+
+/* ---- The load generator ---- */
+
+struct Endpoint
+{
+    const char *name;
+    const char *request;        //The full request, head and body
+};
+
+static char submit_mode_request[256];
+static char submit_wifi_request[256];
+static char submit_api_request[256];
+static char submit_coordinates_request[256];
+
+static void format_post(char *request, size_t size, const char *uri, const char *body)
+{
+    snprintf(request, size, "POST %s HTTP/1.1\r\nHost: bench\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+             "Content-Length: %zu\r\n\r\n%s", uri, strlen(body), body);
+}
+
+static const Endpoint endpoints[] =
+{
+    {"GET /", "GET / HTTP/1.1\r\nHost: bench\r\nAccept: text/html\r\nAccept-Encoding: gzip, deflate\r\n\r\n"},
+    {"POST /SubmitMode", submit_mode_request},
+    {"POST /SubmitWiFi", submit_wifi_request},
+    {"POST /SubmitAPI", submit_api_request},
+    {"POST /SubmitCoordinates", submit_coordinates_request},
+};
+
+struct Client_result
+{
+    std::vector<uint32_t> latencies_us;
+    uint64_t errors = 0;
+    uint64_t rejected = 0;      //503 from a full job queue
+    uint64_t reconnects = 0;
+};
+
+//A keep-alive connection that reads the responses of the server
+struct Client_connection
+{
+    int fd = -1;
+    char buffer[CLIENT_BUFFER_SIZE];
+    size_t start = 0;
+    size_t length = 0;
+
+    bool open(uint16_t port)
+    {
+        close_connection();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+        {
+            close_connection();
+            return false;
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        return true;
+    }
+
+    void close_connection()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        start = 0;
+        length = 0;
+    }
+
+    bool fill()
+    {
+        if (start > 0)
+        {
+            memmove(buffer, buffer + start, length);
+            start = 0;
+        }
+        if (length >= sizeof(buffer) - 1)
+            return false;
+        ssize_t received = recv(fd, buffer + length, sizeof(buffer) - 1 - length, 0);
+        if (received <= 0)
+            return false;
+        length += received;
+        buffer[length] = '\0';
+        return true;
+    }
+
+    //The position of the next "\r\n" in the buffered bytes, NULL if it hasn't arrived yet
+    const char *find_line_end()
+    {
+        buffer[start + length] = '\0';
+        return strstr(buffer + start, "\r\n");
+    }
+
+    void consume(size_t count)
+    {
+        start += count;
+        length -= count;
+    }
+
+    bool skip(size_t count)
+    {
+        while (count > 0)
+        {
+            if (length == 0 && !fill())
+                return false;
+            size_t skipped = std::min(count, length);
+            consume(skipped);
+            count -= skipped;
+        }
+        return true;
+    }
+
+    //Reading a whole response. Returns the status code, 0 if the connection failed.
+    int read_response(bool *keep_alive)
+    {
+        const char *head_end;
+        while (true)
+        {
+            buffer[start + length] = '\0';
+            head_end = strstr(buffer + start, "\r\n\r\n");
+            if (head_end != NULL)
+                break;
+            if (!fill())
+                return 0;
+        }
+        const char *head = buffer + start;
+        int status = atoi(head + 9);
+        size_t head_length = head_end + 4 - head;
+        bool chunked = strcasestr(head, "Transfer-Encoding: chunked") != NULL && strcasestr(head, "Transfer-Encoding: chunked") < head_end;
+        const char *content_length = strcasestr(head, "Content-Length:");
+        size_t body_length = content_length != NULL && content_length < head_end ? strtoul(content_length + 15, NULL, 10) : 0;
+        const char *connection = strcasestr(head, "Connection: close");
+        *keep_alive = connection == NULL || connection > head_end;
+        consume(head_length);
+
+        if (!chunked)
+            return skip(body_length) ? status : 0;
+        while (true)
+        {
+            const char *line_end;
+            while ((line_end = find_line_end()) == NULL)
+            {
+                if (!fill())
+                    return 0;
+            }
+            size_t chunk_length = strtoul(buffer + start, NULL, 16);
+            consume(line_end + 2 - (buffer + start));
+            if (!skip(chunk_length + 2))
+                return 0;
+            if (chunk_length == 0)
+                return status;
+        }
+    }
+};
+
+static bool send_request(int fd, const char *request, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, request, length, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        request += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+static void run_client(const Endpoint *endpoint, uint16_t port, std::chrono::steady_clock::time_point deadline, Client_result *result)
+{
+    Client_connection *connection = new Client_connection();
+    size_t request_length = strlen(endpoint->request);
+    if (!connection->open(port))
+    {
+        result->errors++;
+        delete connection;
+        return;
+    }
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool keep_alive = false;
+        int status = send_request(connection->fd, endpoint->request, request_length) ? connection->read_response(&keep_alive) : 0;
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+        if (status == 200 || status == 202)
+            result->latencies_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        else if (status == 503)
+            result->rejected++;
+        else
+            result->errors++;
+        if (status == 0 || !keep_alive)
+        {
+            result->reconnects++;
+            if (!connection->open(port))
+                break;
+        }
+    }
+    delete connection;
+}
+
+static void run_phase(const Endpoint *endpoint, int concurrency, int seconds, uint16_t port, std::atomic<uint64_t> *server_counter)
+{
+    std::vector<Client_result> results(concurrency);
+    for (int i = 0; i < concurrency; i++)
+        results[i].latencies_us.reserve(1 << 20);
+
+    uint64_t allocations_before = server_counter->load();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point deadline = start + std::chrono::seconds(seconds);
+    std::vector<std::thread> clients;
+    for (int i = 0; i < concurrency; i++)
+        clients.emplace_back(run_client, endpoint, port, deadline, &results[i]);
+    for (size_t i = 0; i < clients.size(); i++)
+        clients[i].join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t allocations = server_counter->load() - allocations_before;
+
+    std::vector<uint32_t> latencies;
+    uint64_t errors = 0;
+    uint64_t rejected = 0;
+    uint64_t reconnects = 0;
+    for (int i = 0; i < concurrency; i++)
+    {
+        latencies.insert(latencies.end(), results[i].latencies_us.begin(), results[i].latencies_us.end());
+        errors += results[i].errors;
+        rejected += results[i].rejected;
+        reconnects += results[i].reconnects;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t requests = latencies.size() + rejected;
+    if (latencies.empty())
+    {
+        printf("%-26s no successful request, %llu error(s)\n", endpoint->name, (unsigned long long)errors);
+        return;
+    }
+    printf("%-26s %10.0f %9u %9u %12.2f %8llu %8llu %8llu\n", endpoint->name, latencies.size() / elapsed,
+           latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], (double)allocations / requests,
+           (unsigned long long)rejected, (unsigned long long)errors, (unsigned long long)reconnects);
+}
+
+static bool wait_for_server(uint16_t port)
+{
+    for (int waited = 0; waited < STARTUP_TIMEOUT_MS; waited += 10)
+    {
+        Client_connection connection;
+        if (connection.open(port))
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    int concurrency = argc > 1 ? atoi(argv[1]) : DEFAULT_CONCURRENCY;
+    int seconds = argc > 2 ? atoi(argv[2]) : DEFAULT_SECONDS;
+    int port = argc > 3 ? atoi(argv[3]) : DEFAULT_PORT;
+    if (concurrency <= 0 || seconds <= 0 || port <= 0 || port > 65535)
+    {
+        fprintf(stderr, "Usage: %s [concurrency] [seconds per endpoint] [port]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    format_post(submit_mode_request, sizeof(submit_mode_request), "/SubmitMode", "choosemode=manual&temp=22&window=45");
+    format_post(submit_wifi_request, sizeof(submit_wifi_request), "/SubmitWiFi", "ssid=HomeNetwork&password=correct+horse+battery+staple");
+    format_post(submit_api_request, sizeof(submit_api_request), "/SubmitAPI", "apikey=0123456789abcdef0123456789abcdef");
+    format_post(submit_coordinates_request, sizeof(submit_coordinates_request), "/SubmitCoordinates", "lat=47.50&lon=19.04");
+
+    void *shared = mmap(NULL, sizeof(std::atomic<uint64_t>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        return 1;
+    std::atomic<uint64_t> *counter = new (shared) std::atomic<uint64_t>(0);
+
+    //Forked before any thread is started
+    pid_t server_pid = fork();
+    if (server_pid == 0)
+    {
+        server_allocations = counter;
+        run_server(port);
+    }
+    if (server_pid < 0 || !wait_for_server(port))
+    {
+        fprintf(stderr, "The server didn't start on port %d\n", port);
+        if (server_pid > 0)
+            kill(server_pid, SIGKILL);
+        return 1;
+    }
+    printf("%d keep-alive client(s), %d s per endpoint, HTTP_WORKER_COUNT %d, HTTP_MAX_OPEN_SOCKETS %d\n",
+           concurrency, seconds, HTTP_WORKER_COUNT, HTTP_MAX_OPEN_SOCKETS);
+    printf("%-26s %10s %9s %9s %12s %8s %8s %8s\n", "endpoint", "req/s", "p50 us", "p99 us", "allocs/req", "503", "errors", "reconn");
+    for (size_t i = 0; i < sizeof(endpoints) / sizeof(endpoints[0]); i++)
+        run_phase(&endpoints[i], concurrency, seconds, port, counter);
+
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+    unlink(NVS_PATH);
+    return 0;
+}
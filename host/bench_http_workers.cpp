@@ -0,0 +1,223 @@
+/* Load test of the worker pool of the webserver (src/HTTP_workers.cpp), running on the host FreeRTOS shim.
+ * A simulated httpd task serves several concurrent keep-alive clients: browsers loading the config page
+ * and API clients polling /api/v1/status. Every request is parsed on the httpd task and its handler is then
+ * deferred to an idle worker exactly like HTTP_server.cpp does it, or served on the httpd task if every worker is busy.
+ * The handlers wait for the modeled time of the flash reads and of the TCP sends, which dominate on the ESP32.
+ *
+ * Usage: bench_http_workers [seconds per run] [max open sockets]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "esp_log.h"
+#include "HTTP_workers.h"
+
+#define DEFAULT_SECONDS         2
+
+//The modeled costs, in microseconds
+#define PARSE_US                300     //Receiving and parsing the request line and the headers on the httpd task
+#define PAGE_CHUNKS             6       //The gzip-compressed config page, in 1 KB chunks
+#define PAGE_CHUNK_READ_US      800     //Reading one chunk from SPIFFS
+#define PAGE_CHUNK_SEND_US      2500    //Sending one chunk, the TCP window of a Wi-Fi client
+#define STATUS_BUILD_US         400     //The snapshots and the JSON of /api/v1/status
+#define STATUS_SEND_US          2000
+
+struct Client
+{
+    int id;
+    bool browser;
+    std::mutex lock;
+    std::condition_variable done;
+    bool completed = false;
+    std::vector<uint32_t> latencies_us;
+};
+
+//The connections with a pending request, the select() of the httpd task
+static std::mutex pending_lock;
+static std::condition_variable pending_changed;
+static std::deque<Client*> pending;
+static std::atomic<bool> running;
+static std::atomic<uint64_t> deferred_count;
+static std::atomic<uint64_t> inline_count;
+
+static void wait_us(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+static void page_handler()
+{
+    for (int i = 0; i < PAGE_CHUNKS; i++)
+    {
+        wait_us(PAGE_CHUNK_READ_US);
+        wait_us(PAGE_CHUNK_SEND_US);
+    }
+}
+
+static void status_handler()
+{
+    wait_us(STATUS_BUILD_US);
+    wait_us(STATUS_SEND_US);
+}
+
+static void complete(Client* client)
+{
+    {
+        std::lock_guard<std::mutex> guard(client->lock);
+        client->completed = true;
+    }
+    client->done.notify_one();
+}
+
+static void serve(Client* client)
+{
+    if (client->browser)
+        page_handler();
+    else
+        status_handler();
+    complete(client);
+}
+
+//The deferred request on a worker, run_deferred_request() of HTTP_server.cpp
+static void run_deferred(void* arg, void* context)
+{
+    serve((Client*)arg);
+}
+
+static void httpd_task()
+{
+    while (true)
+    {
+        Client* client;
+        {
+            std::unique_lock<std::mutex> guard(pending_lock);
+            pending_changed.wait(guard, []() { return !pending.empty() || !running; });
+            if (pending.empty())
+                return;
+            client = pending.front();
+            pending.pop_front();
+        }
+        wait_us(PARSE_US);
+        if (http_workers_submit(run_deferred, client, NULL))
+        {
+            deferred_count++;
+        }
+        else
+        {
+            inline_count++;
+            serve(client);
+        }
+    }
+}
+
+//A keep-alive client sends its next request as soon as the previous response has arrived
+static void client_thread(Client* client)
+{
+    while (running)
+    {
+        auto start = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> guard(pending_lock);
+            pending.push_back(client);
+        }
+        pending_changed.notify_one();
+        {
+            std::unique_lock<std::mutex> guard(client->lock);
+            client->done.wait(guard, [client]() { return client->completed; });
+            client->completed = false;
+        }
+        client->latencies_us.push_back((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+static uint32_t percentile(std::vector<uint32_t> &values, int percent)
+{
+    if (values.empty())
+        return 0;
+    return values[std::min(values.size() - 1, values.size() * percent / 100)];
+}
+
+static void run(int workers, int browsers, int api_clients, int seconds)
+{
+    std::vector<Client*> clients;
+    for (int i = 0; i < browsers + api_clients; i++)
+    {
+        Client* client = new Client();
+        client->id = i;
+        client->browser = i < browsers;
+        clients.push_back(client);
+    }
+    deferred_count = 0;
+    inline_count = 0;
+    running = true;
+    http_workers_start(workers);
+
+    std::thread httpd(httpd_task);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clients.size(); i++)
+        threads.push_back(std::thread(client_thread, clients[i]));
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running = false;
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    pending_changed.notify_all();
+    httpd.join();
+    http_workers_stop();
+
+    std::vector<uint32_t> page_latencies;
+    std::vector<uint32_t> status_latencies;
+    for (size_t i = 0; i < clients.size(); i++)
+    {
+        std::vector<uint32_t> &target = clients[i]->browser ? page_latencies : status_latencies;
+        target.insert(target.end(), clients[i]->latencies_us.begin(), clients[i]->latencies_us.end());
+        delete clients[i];
+    }
+    std::sort(page_latencies.begin(), page_latencies.end());
+    std::sort(status_latencies.begin(), status_latencies.end());
+    double requests = (double)(page_latencies.size() + status_latencies.size());
+    printf("%7d  %8d  %11d  %8.0f  %9.1f %9.1f  %9.1f %9.1f  %5.0f%%\n",
+           workers, browsers, api_clients, requests / seconds,
+           percentile(page_latencies, 50) / 1000.0, percentile(page_latencies, 99) / 1000.0,
+           percentile(status_latencies, 50) / 1000.0, percentile(status_latencies, 99) / 1000.0,
+           requests > 0 ? 100.0 * deferred_count / requests : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+    int max_open_sockets = argc > 2 ? atoi(argv[2]) : HTTP_MAX_OPEN_SOCKETS;
+    if (seconds <= 0 || max_open_sockets <= 1)
+    {
+        fprintf(stderr, "Usage: %s [seconds per run] [max open sockets]\n", argv[0]);
+        return 1;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    //Every client keeps one connection open, a worker needs a socket left for the new requests
+    static const int worker_counts[] = {0, 1, 2, 4};
+    static const int client_mixes[][2] = {{1, 1}, {1, 3}, {2, 4}, {3, 4}};
+    printf("max_open_sockets %d, %d s per run, page and status latencies in ms\n\n", max_open_sockets, seconds);
+    printf("workers  browsers  api clients     req/s   page p50  page p99  stat. p50 stat. p99  deferred\n");
+    for (size_t mix = 0; mix < sizeof(client_mixes) / sizeof(client_mixes[0]); mix++)
+    {
+        int browsers = client_mixes[mix][0];
+        int api_clients = client_mixes[mix][1];
+        if (browsers + api_clients > max_open_sockets)
+            continue;
+        for (size_t i = 0; i < sizeof(worker_counts) / sizeof(worker_counts[0]); i++)
+        {
+            if (worker_counts[i] < max_open_sockets)
+                run(worker_counts[i], browsers, api_clients, seconds);
+        }
+        printf("\n");
+    }
+    return 0;
+}
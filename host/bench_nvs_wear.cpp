@@ -0,0 +1,327 @@
+/* Flash-wear benchmark of the configuration storage, running on the host NVS emulator.
+ * The same day of user traffic (slider drags, temperature adjustments, mode changes, occasional coordinate and Wi-Fi updates)
+ * is replayed against two implementations:
+ *  - legacy: the original store_data.cpp pattern, every update opens the namespace, sets one key and commits it,
+ *  - write-behind: the current store_data.cpp, built for the host, with its persistence task and single record.
+ * The write-behind run is real time, scaled down by the time factor (the quiet period and the message intervals alike).
+ *
+ * Usage: bench_nvs_wear [days] [time factor] [partition table CSV]
+ * The default partition table is the one of the firmware, its path is given by the build (PARTITIONS_CSV).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include "esp_log.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "nvs_emulator.h"
+#include "store_data.h"
+
+#define DEFAULT_DAYS            30
+#define DEFAULT_TIME_FACTOR     200
+#ifndef PARTITIONS_CSV
+#define PARTITIONS_CSV          "partitions_custom.csv"
+#endif
+
+//The daily traffic
+#define SLIDER_DRAGS_PER_DAY    8
+#define SLIDER_MESSAGES         40      //Messages of one drag
+#define SLIDER_INTERVAL_MS      50      //The slider sends at 20 Hz while dragged
+#define TEMP_ADJUSTS_PER_DAY    4
+#define TEMP_MESSAGES           10
+#define TEMP_INTERVAL_MS        200
+#define MODE_SUBMITS_PER_DAY    3       //SubmitMode form: operation mode, desired temperature and window degree
+#define MQTT_TOGGLES_PER_DAY    2
+#define COORDINATES_EVERY_DAYS  7
+#define WIFI_EVERY_DAYS         30
+
+//What a run does with one user action
+struct Storage_ops
+{
+    const char* name;
+    void (*set_window_deg)(float window_deg);
+    void (*set_desired_temp)(int desired_temp);
+    void (*set_operation_mode)(bool op_mode);
+    void (*set_coordinates)(float lat, float lon);
+    void (*set_wifi)(const char* ssid, const char* pass);
+    void (*idle)();     //The time between two user actions
+};
+
+static uint32_t time_factor = DEFAULT_TIME_FACTOR;
+static uint64_t updates = 0;
+
+static void scaled_sleep(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds((uint64_t)ms * 1000 / time_factor));
+}
+
+/* ---- The legacy pattern: open, set, commit and close for every single update ---- */
+
+static void legacy_write_i8(const char* key, int8_t value)
+{
+    nvs_handle_t handle;
+    nvs_flash_init();
+    if (nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    nvs_set_i8(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void legacy_write_i64(const char* key, int64_t value)
+{
+    nvs_handle_t handle;
+    nvs_flash_init();
+    if (nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    nvs_set_i64(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void legacy_write_str(const char* key, const char* value)
+{
+    nvs_handle_t handle;
+    nvs_flash_init();
+    if (nvs_open("storage", NVS_READWRITE, &handle) != ESP_OK)
+        return;
+    nvs_set_str(handle, key, value);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+static void legacy_window_deg(float window_deg)
+{
+    legacy_write_i64("window_deg", (int64_t)(window_deg * 100));
+}
+
+static void legacy_desired_temp(int desired_temp)
+{
+    legacy_write_i64("desired_temp", desired_temp);
+}
+
+static void legacy_operation_mode(bool op_mode)
+{
+    legacy_write_i8("op_mode", op_mode ? 1 : 0);
+}
+
+static void legacy_coordinates(float lat, float lon)
+{
+    legacy_write_i64("lat", (int64_t)(lat * 100));
+    legacy_write_i64("lon", (int64_t)(lon * 100));
+}
+
+static void legacy_wifi(const char* ssid, const char* pass)
+{
+    legacy_write_str("ssid", ssid);
+    legacy_write_str("pass", pass);
+}
+
+static void legacy_idle()
+{
+}
+
+/* ---- The current store_data.cpp ---- */
+
+static void coordinates_transaction(float lat, float lon)
+{
+    Config_transaction transaction;
+    transaction.set_latitude(lat);
+    transaction.set_longitude(lon);
+    transaction.commit();
+}
+
+static void wifi_transaction(const char* ssid, const char* pass)
+{
+    Config_transaction transaction;
+    transaction.set_wifi_ssid(ssid);
+    transaction.set_wifi_pass(pass);
+    transaction.commit();
+}
+
+//User actions are hours apart, the persistence task has plenty of time to flush in between
+static void write_behind_idle()
+{
+    scaled_sleep(NVS_PERSIST_QUIET_MS * 3);
+}
+
+static const Storage_ops legacy_ops =
+{
+    "legacy", legacy_window_deg, legacy_desired_temp, legacy_operation_mode, legacy_coordinates, legacy_wifi, legacy_idle
+};
+
+static const Storage_ops write_behind_ops =
+{
+    "write-behind", nvs_write_window_deg, nvs_write_desired_temp, nvs_write_operation_mode,
+    coordinates_transaction, wifi_transaction, write_behind_idle
+};
+
+/* ---- The traffic ---- */
+
+static void simulate_day(const Storage_ops &ops, int day, std::mt19937 &rng, float* window_deg, int* desired_temp, bool* op_mode)
+{
+    std::uniform_real_distribution<float> step(-3.0f, 3.0f);
+    for (int drag = 0; drag < SLIDER_DRAGS_PER_DAY; drag++)
+    {
+        for (int i = 0; i < SLIDER_MESSAGES; i++)
+        {
+            *window_deg = std::min(90.0f, std::max(0.0f, *window_deg + step(rng)));
+            ops.set_window_deg(*window_deg);
+            updates++;
+            scaled_sleep(SLIDER_INTERVAL_MS);
+        }
+        ops.idle();
+    }
+    for (int adjust = 0; adjust < TEMP_ADJUSTS_PER_DAY; adjust++)
+    {
+        int direction = (rng() & 1) ? 1 : -1;
+        for (int i = 0; i < TEMP_MESSAGES; i++)
+        {
+            *desired_temp = std::min(30, std::max(15, *desired_temp + direction));
+            ops.set_desired_temp(*desired_temp);
+            updates++;
+            scaled_sleep(TEMP_INTERVAL_MS);
+        }
+        ops.idle();
+    }
+    for (int submit = 0; submit < MODE_SUBMITS_PER_DAY; submit++)
+    {
+        *op_mode = !*op_mode;
+        ops.set_operation_mode(*op_mode);
+        ops.set_desired_temp(*desired_temp);
+        ops.set_window_deg(*window_deg);
+        updates += 3;
+        ops.idle();
+    }
+    for (int toggle = 0; toggle < MQTT_TOGGLES_PER_DAY; toggle++)
+    {
+        *op_mode = !*op_mode;
+        ops.set_operation_mode(*op_mode);
+        updates++;
+        ops.idle();
+    }
+    if (day % COORDINATES_EVERY_DAYS == COORDINATES_EVERY_DAYS - 1)
+    {
+        std::uniform_real_distribution<float> coordinate(-80.0f, 80.0f);
+        ops.set_coordinates(coordinate(rng), coordinate(rng));
+        updates += 2;
+        ops.idle();
+    }
+    if (day % WIFI_EVERY_DAYS == WIFI_EVERY_DAYS - 1)
+    {
+        char ssid[NVS_SSID_SIZE];
+        snprintf(ssid, sizeof(ssid), "HomeNetwork-%d", day);
+        ops.set_wifi(ssid, "correct horse battery staple");
+        updates += 2;
+        ops.idle();
+    }
+}
+
+static void print_report(const Storage_ops &ops, int days, const Nvs_emu_stats &stats)
+{
+    std::vector<uint32_t> latencies = stats.commit_latency_us;
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t latency_sum = 0;
+    for (size_t i = 0; i < latencies.size(); i++)
+        latency_sum += latencies[i];
+    uint32_t max_page_erases = 0;
+    for (size_t i = 0; i < stats.erases_per_page.size(); i++)
+        max_page_erases = std::max(max_page_erases, stats.erases_per_page[i]);
+
+    printf("\n%s, %d day(s)\n", ops.name, days);
+    printf("  updates:              %llu\n", (unsigned long long)updates);
+    printf("  commits:              %zu\n", latencies.size());
+    printf("  entries written:      %llu (%llu identical writes skipped)\n",
+           (unsigned long long)stats.entries_written, (unsigned long long)stats.skipped_writes);
+    printf("  bytes programmed:     %llu in %llu operations\n",
+           (unsigned long long)stats.bytes_programmed, (unsigned long long)stats.program_ops);
+    printf("  page erases:          %llu (%llu GC runs), most erased page: %u\n",
+           (unsigned long long)stats.page_erases, (unsigned long long)stats.gc_runs, max_page_erases);
+    if (!latencies.empty())
+    {
+        printf("  commit latency (us):  avg %llu, p50 %u, p99 %u, max %u (modeled)\n",
+               (unsigned long long)(latency_sum / latencies.size()), latencies[latencies.size() / 2],
+               latencies[latencies.size() * 99 / 100], latencies.back());
+    }
+    if (max_page_erases > 0)
+    {
+        double erases_per_day = (double)max_page_erases / days;
+        printf("  projected lifetime:   %.0f years (%d erase cycles per sector)\n",
+               NVS_EMU_ERASE_ENDURANCE / erases_per_day / 365.0, NVS_EMU_ERASE_ENDURANCE);
+    }
+    else
+    {
+        printf("  projected lifetime:   more than %.0f years, no page was erased\n",
+               (double)NVS_EMU_ERASE_ENDURANCE * days / 365.0);
+    }
+}
+
+static void run(const Storage_ops &ops, int days, size_t partition_size, bool write_behind)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "nvs_wear_%s.bin", ops.name);
+    unlink(path);
+    nvs_flash_deinit();
+    nvs_emu_configure(path, partition_size);
+    nvs_emu_reset_stats();
+    updates = 0;
+
+    if (write_behind)
+    {
+        nvs_config_set_quiet_period(NVS_PERSIST_QUIET_MS / time_factor > 0 ? NVS_PERSIST_QUIET_MS / time_factor : 1);
+        nvs_config_init();
+    }
+    else
+    {
+        nvs_flash_init();
+    }
+    //Only the traffic is measured, not the creation of the namespace and the first record
+    nvs_emu_reset_stats();
+
+    std::mt19937 rng(1234);
+    float window_deg = 45;
+    int desired_temp = 21;
+    bool op_mode = false;
+    for (int day = 0; day < days; day++)
+        simulate_day(ops, day, rng, &window_deg, &desired_temp, &op_mode);
+    if (write_behind)
+        nvs_config_flush();
+    print_report(ops, days, nvs_emu_get_stats());
+}
+
+int main(int argc, char** argv)
+{
+    int days = argc > 1 ? atoi(argv[1]) : DEFAULT_DAYS;
+    time_factor = argc > 2 ? atoi(argv[2]) : DEFAULT_TIME_FACTOR;
+    const char* csv_path = argc > 3 ? argv[3] : PARTITIONS_CSV;
+    if (days <= 0 || time_factor == 0)
+    {
+        fprintf(stderr, "Usage: %s [days] [time factor] [partition table CSV]\n", argv[0]);
+        return 1;
+    }
+
+    //The wear depends on the size of the partition, a guessed size would make the results meaningless
+    if (access(csv_path, R_OK) != 0)
+    {
+        fprintf(stderr, "Can't read the partition table %s: %s\n", csv_path, strerror(errno));
+        return 1;
+    }
+    size_t partition_size = nvs_emu_partition_size(csv_path, "nvs");
+    if (partition_size == 0)
+    {
+        fprintf(stderr, "No nvs partition in %s.\n", csv_path);
+        return 1;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    printf("NVS partition: 0x%zx bytes (%zu pages), time factor: %u\n", partition_size, partition_size / 4096, time_factor);
+
+    run(legacy_ops, days, partition_size, false);
+    run(write_behind_ops, days, partition_size, true);
+    return 0;
+}
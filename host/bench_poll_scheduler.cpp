@@ -0,0 +1,149 @@
+/* Simulation of a fleet of devices polling the weather API with the scheduler of src/poll_scheduler.cpp,
+ * against the former fixed 10 minute poll. Every device boots at the same time, like after a power outage.
+ * The simulated 3 days have a calm day, an outage of the API, a rate limited hour, an alert and a fast front.
+ * Reports the most calls of a device in a day, the peak calls of the fleet in a minute after the first hour, how fast
+ * the fleet recovers after the outage and how often it polls during the alert.
+ *   bench_poll_scheduler [devices]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <queue>
+#include <vector>
+#include <map>
+#include "esp_random.h"
+#include "poll_scheduler.h"
+
+#define HOUR_US         (3600LL * 1000000)
+#define SIMULATED_US    (72 * HOUR_US)
+#define OUTAGE_START_US (30 * HOUR_US)
+#define OUTAGE_END_US   (32 * HOUR_US)
+#define LIMITED_END_US  (33 * HOUR_US)      //Half of the requests get a 429 for an hour after the outage
+#define RETRY_AFTER_MS  300000
+#define ALERT_START_US  (40 * HOUR_US)
+#define ALERT_END_US    (46 * HOUR_US)
+#define FRONT_START_US  (50 * HOUR_US)
+#define FRONT_END_US    (52 * HOUR_US)
+
+//What the API answers at a given time
+static Poll_outcome get_outcome(int64_t now_us)
+{
+    Poll_outcome outcome = {};
+    if (now_us >= OUTAGE_START_US && now_us < OUTAGE_END_US)
+    {
+        outcome.result = POLL_FAILED;
+        return outcome;
+    }
+    if (now_us >= OUTAGE_END_US && now_us < LIMITED_END_US && esp_random() % 2 == 0)
+    {
+        outcome.result = POLL_RATE_LIMITED;
+        outcome.retry_after_ms = RETRY_AFTER_MS;
+        return outcome;
+    }
+    outcome.result = POLL_SUCCESS;
+    outcome.alert_active = now_us >= ALERT_START_US && now_us < ALERT_END_US;
+    outcome.temp = 15.0f;
+    outcome.pressure = 1015;
+    //The front cools the air by 18 °C in 2 hours
+    if (now_us >= FRONT_END_US)
+        outcome.temp -= 18.0f;
+    else if (now_us >= FRONT_START_US)
+        outcome.temp -= 18.0f * (now_us - FRONT_START_US) / (FRONT_END_US - FRONT_START_US);
+    return outcome;
+}
+
+struct Fleet_result
+{
+    uint32_t total_calls;
+    uint32_t max_calls_per_day;
+    uint32_t peak_calls_per_minute;
+    uint32_t outage_calls;
+    double mean_recovery_s;     //From the end of the outage to the first success of a device
+    double alert_polls_per_hour;
+};
+
+//Polling with the scheduler, or every 10 minutes whatever the outcome like the former task
+static Fleet_result simulate(int devices, bool adaptive)
+{
+    typedef std::pair<int64_t, int> Event;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    std::vector<Poll_scheduler> schedulers(devices);
+    std::vector<std::vector<uint32_t>> calls_per_day(devices, std::vector<uint32_t>(SIMULATED_US / (24 * HOUR_US) + 1));
+    std::vector<int64_t> recovered_us(devices, -1);
+    std::map<int64_t, uint32_t> calls_per_minute;
+    Fleet_result result = {};
+    uint32_t alert_calls = 0;
+
+    for (int i = 0; i < devices; i++)
+    {
+        poll_scheduler_init(&schedulers[i], 0);
+        events.push(Event(0, i));
+    }
+    while (!events.empty() && events.top().first < SIMULATED_US)
+    {
+        int64_t now_us = events.top().first;
+        int device = events.top().second;
+        events.pop();
+
+        Poll_outcome outcome = get_outcome(now_us);
+        uint32_t delay_ms = poll_scheduler_next_delay(&schedulers[device], &outcome, now_us);
+        if (!adaptive)
+            delay_ms = POLL_INTERVAL_MS;
+
+        result.total_calls++;
+        calls_per_day[device][now_us / (24 * HOUR_US)]++;
+        if (now_us >= HOUR_US)
+            calls_per_minute[now_us / 60000000]++;
+        if (now_us >= OUTAGE_START_US && now_us < OUTAGE_END_US)
+            result.outage_calls++;
+        if (now_us >= ALERT_START_US && now_us < ALERT_END_US)
+            alert_calls++;
+        if (now_us >= OUTAGE_END_US && recovered_us[device] < 0 && outcome.result == POLL_SUCCESS)
+            recovered_us[device] = now_us - OUTAGE_END_US;
+        events.push(Event(now_us + (int64_t)delay_ms * 1000, device));
+    }
+
+    double recovery_sum_s = 0;
+    for (int i = 0; i < devices; i++)
+    {
+        for (uint32_t calls : calls_per_day[i])
+        {
+            if (calls > result.max_calls_per_day)
+                result.max_calls_per_day = calls;
+        }
+        recovery_sum_s += recovered_us[i] / 1e6;
+    }
+    for (auto &minute : calls_per_minute)
+    {
+        if (minute.second > result.peak_calls_per_minute)
+            result.peak_calls_per_minute = minute.second;
+    }
+    result.mean_recovery_s = recovery_sum_s / devices;
+    result.alert_polls_per_hour = (double)alert_calls / devices / ((ALERT_END_US - ALERT_START_US) / HOUR_US);
+    return result;
+}
+
+static void print_result(const char* name, const Fleet_result &result, int devices)
+{
+    printf("%-10s %12u %14u %16u %14.1f %16.0f %12.1f\n", name, result.total_calls, result.max_calls_per_day,
+           result.peak_calls_per_minute, (double)result.outage_calls / devices, result.mean_recovery_s,
+           result.alert_polls_per_hour);
+}
+
+int main(int argc, char** argv)
+{
+    int devices = argc > 1 ? atoi(argv[1]) : 100;
+    if (devices <= 0)
+    {
+        fprintf(stderr, "usage: %s [devices]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%d devices, 72 simulated hours, budget %d calls/day/device\n", devices, WEATHER_DAILY_CALL_BUDGET);
+    printf("%-10s %12s %14s %16s %14s %16s %12s\n", "schedule", "total calls", "max calls/day",
+           "peak calls/min", "outage calls", "recovery (s)", "alert polls/h");
+    print_result("fixed", simulate(devices, false), devices);
+    print_result("adaptive", simulate(devices, true), devices);
+    return 0;
+}
@@ -0,0 +1,202 @@
+/* Benchmark of the whole weather fetch of the firmware on Linux: the replay provider asks the replay server
+ * for the recorded responses of host/data/weather over the plain TCP transport, weather_client_fetch() reads them,
+ * the streaming parser of JSON_parser.cpp parses them and apply_weather_report() writes them into Weather.
+ * The responses are served in turn: a small one, a chunked one with an alert, a full one with the hourly and daily
+ * forecasts and a 429. The fetches run on a kept-alive connection, then on a new connection each.
+ * Reports fetches/second, the p50/p99 latency, the parsed and failed responses, and the heap allocations of the
+ * fetching thread per fetch (the server threads are not counted). The time of building the request is reported too,
+ * against the former snprintf of the whole request.
+ *   bench_weather_fetch [fetches] [directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "esp_log.h"
+#include "weather_data.h"
+#include "WS_telemetry.h"
+#include "openweathermap_provider.h"
+#include "tcp_transport.h"
+#include "weather_client.h"
+#include "replay_server.h"
+
+#define DEFAULT_FETCHES     4000
+#define READ_TIMEOUT_MS     5000
+#define REQUEST_BUILDS      200000
+
+/* ---- Counting the heap allocations of the fetching thread ---- */
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void __libc_free(void *ptr);
+}
+
+static thread_local bool counting = false;
+static std::atomic<uint64_t> allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+    if (counting)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (counting)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+/* ---- The firmware modules that aren't part of the host build ---- */
+
+Weather_data Weather;
+
+void telemetry_notify(uint32_t changes)
+{
+}
+
+static uint64_t get_time_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static Weather_query get_query()
+{
+    Weather_query query = {};
+    query.latitude = 47.4979f;
+    query.longitude = 19.0402f;
+    query.app_id = "0123456789abcdef0123456789abcdef";
+    query.units = OPENWEATHERMAP_UNITS;
+    query.exclude = OPENWEATHERMAP_EXCLUDE;
+    query.lang = OPENWEATHERMAP_LANG;
+    return query;
+}
+
+//The request as the weather task built it before the request writer
+static size_t build_request_snprintf(char* buf, size_t size, const Weather_query* query, const char* host)
+{
+    int length = snprintf(buf, size,
+                          "GET /data/2.5/onecall?lat=%f&lon=%f&units=%s&exclude=%s&lang=%s&appid=%s HTTP/1.1\r\n"
+                          "Host: %s\r\n"
+                          "User-Agent: esp-idf/1.0 esp32\r\n"
+                          "Accept: application/json\r\n"
+                          "Connection: keep-alive\r\n"
+                          "\r\n",
+                          query->latitude, query->longitude, query->units, query->exclude, query->lang, query->app_id, host);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+static void run_build(Weather_provider* provider)
+{
+    char request[WEATHER_REQUEST_SIZE];
+    Weather_query query = get_query();
+    size_t length = 0, snprintf_length = 0;
+
+    uint64_t start = get_time_us();
+    for (int i = 0; i < REQUEST_BUILDS; i++)
+    {
+        query.latitude += (i & 1) ? 0.0001f : -0.0001f;
+        length += provider->build_request(request, sizeof(request), &query);
+    }
+    double writer_ns = (get_time_us() - start) * 1000.0 / REQUEST_BUILDS;
+    start = get_time_us();
+    for (int i = 0; i < REQUEST_BUILDS; i++)
+    {
+        query.latitude += (i & 1) ? 0.0001f : -0.0001f;
+        snprintf_length += build_request_snprintf(request, sizeof(request), &query, provider->get_host());
+    }
+    double snprintf_ns = (get_time_us() - start) * 1000.0 / REQUEST_BUILDS;
+    printf("request: %zu bytes, %.0f ns to build (snprintf with %%f: %zu bytes, %.0f ns)\n", length / REQUEST_BUILDS,
+           writer_ns, snprintf_length / REQUEST_BUILDS, snprintf_ns);
+}
+
+static void run_phase(const char* name, Weather_provider* provider, Weather_transport* transport, int fetches, bool keep_alive)
+{
+    char request[WEATHER_REQUEST_SIZE];
+    Weather_query query = get_query();
+    size_t request_length = provider->build_request(request, sizeof(request), &query);
+    std::vector<uint32_t> latencies;
+    latencies.reserve(fetches);
+    int parsed_count = 0, rate_limited = 0, errors = 0;
+
+    transport->disconnect();
+    allocations = 0;
+    uint64_t start = get_time_us();
+    for (int i = 0; i < fetches; i++)
+    {
+        bool parsed;
+        uint64_t fetch_start = get_time_us();
+        counting = true;
+        int ret = weather_client_fetch(transport, provider, request, request_length, &parsed);
+        if (!keep_alive)
+            transport->disconnect();
+        counting = false;
+        latencies.push_back((uint32_t)(get_time_us() - fetch_start));
+        if (ret != 0)
+            errors++;
+        else if (parsed)
+            parsed_count++;
+        else if (provider->get_response().status == 429)
+            rate_limited++;
+        else
+            errors++;
+    }
+    double elapsed = (get_time_us() - start) / 1e6;
+    transport->disconnect();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("%-16s %10.0f %9u %9u %8d %8d %8d %12.2f\n", name, fetches / elapsed, latencies[latencies.size() / 2],
+           latencies[latencies.size() * 99 / 100], parsed_count, rate_limited, errors, (double)allocations / fetches);
+}
+
+int main(int argc, char** argv)
+{
+    int fetches = argc > 1 ? atoi(argv[1]) : DEFAULT_FETCHES;
+    const char* directory = argc > 2 ? argv[2] : REPLAY_DATA_DIR;
+    if (fetches <= 0)
+    {
+        fprintf(stderr, "usage: %s [fetches] [directory]\n", argv[0]);
+        return 1;
+    }
+
+    uint16_t port = replay_server_start(directory, "127.0.0.1", 0);
+    if (port == 0)
+        return 1;
+    //The parser logs the 429 responses and the transport every connection, only the summary is printed
+    esp_log_level_set("*", ESP_LOG_NONE);
+    char port_text[8];
+    snprintf(port_text, sizeof(port_text), "%u", port);
+    Replay_provider provider("127.0.0.1", port_text);
+    Tcp_transport transport(READ_TIMEOUT_MS);
+
+    printf("%d fetches per phase, largest response %zu bytes\n", fetches, replay_server_get_max_response_size());
+    run_build(&provider);
+    printf("%-16s %10s %9s %9s %8s %8s %8s %12s\n", "connection", "fetch/s", "p50 us", "p99 us", "parsed", "429", "errors",
+           "allocs/fetch");
+    run_phase("keep-alive", &provider, &transport, fetches, true);
+    run_phase("new connection", &provider, &transport, fetches, false);
+    replay_server_stop();
+    return 0;
+}
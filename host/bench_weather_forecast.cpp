@@ -0,0 +1,128 @@
+/* Benchmark of the forecast ingestion of JSON_parser.cpp and weather_forecast.cpp: One Call responses with 48 hourly and
+ * 8 daily entries are generated and parsed in small pieces, like they arrive over TLS.
+ * The daily entries are at local noon of Europe/Budapest, so the cases with a change of DST have a 23 or 25 hour day.
+ * Reports the kept entries against the expected ones, the parse time and the size of the store.
+ * Exits with 1 if a case keeps other entries than expected.
+ *   bench_weather_forecast [parses]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include "esp_log.h"
+#include "weather_data.h"
+#include "WS_telemetry.h"
+#include "JSON_parser.h"
+
+#define DEFAULT_PARSES  2000
+#define PIECE_SIZE      512     //The read buffer of weather_client.cpp
+
+/* ---- The firmware modules that aren't part of the host build ---- */
+
+Weather_data Weather;
+
+void telemetry_notify(uint32_t changes)
+{
+}
+
+struct Forecast_case
+{
+    const char* name;
+    int64_t first_day;          //Unix time of the noon of the first day
+    int shifted_day;            //The daily entries from this one are shifted, -1 for none
+    int shift_s;
+    int expected_days;
+};
+
+static const Forecast_case cases[] =
+{
+    {"no DST change", 1760695200, -1, 0, FORECAST_DAYS},
+    {"DST end", 1761386400, 1, 3600, FORECAST_DAYS},            //2025-10-25 12:00 CEST, the next noon is 25 hours later
+    {"DST start", 1743246000, 1, -3600, FORECAST_DAYS},         //2025-03-29 12:00 CET, the next noon is 23 hours later
+    {"missing day", 1760695200, 3, 86400, 3},                   //The entries after a gap aren't kept
+};
+
+static uint64_t get_time_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static std::string build_response(const Forecast_case* forecast_case)
+{
+    char entry[512];
+    std::string body = "{\"lat\":47.4979,\"lon\":19.0402,\"timezone\":\"Europe/Budapest\",\"timezone_offset\":7200,"
+                       "\"current\":{\"dt\":1760700000,\"temp\":10.4,\"pressure\":1013,\"humidity\":71,\"wind_speed\":4.63,"
+                       "\"wind_deg\":230,\"weather\":[{\"id\":804,\"main\":\"Clouds\"}]},\"hourly\":[";
+    int64_t first_hour = forecast_case->first_day - 2 * FORECAST_HOUR_S;
+    for (int i = 0; i < FORECAST_HOURS; i++)
+    {
+        snprintf(entry, sizeof(entry), "%s{\"dt\":%lld,\"temp\":%.2f,\"feels_like\":9.1,\"pressure\":1013,\"humidity\":%d,"
+                 "\"wind_speed\":%.2f,\"wind_deg\":230,\"weather\":[{\"id\":%d,\"main\":\"Rain\",\"icon\":\"10d\"}],\"pop\":%.2f}",
+                 i > 0 ? "," : "", (long long)(first_hour + i * FORECAST_HOUR_S), 8.0 + i % 7, 60 + i % 30,
+                 2.0 + i % 5 * 0.5, i % 2 ? 500 : 804, i % 10 / 10.0);
+        body += entry;
+    }
+    body += "],\"daily\":[";
+    for (int i = 0; i < FORECAST_DAYS; i++)
+    {
+        int64_t dt = forecast_case->first_day + (int64_t)i * FORECAST_DAY_S;
+        if (forecast_case->shifted_day >= 0 && i >= forecast_case->shifted_day)
+            dt += forecast_case->shift_s;
+        snprintf(entry, sizeof(entry), "%s{\"dt\":%lld,\"temp\":{\"day\":14.2,\"min\":%.1f,\"max\":%.1f,\"night\":9.4},"
+                 "\"feels_like\":{\"day\":13.1},\"humidity\":%d,\"wind_speed\":%.2f,\"weather\":[{\"id\":500}],\"pop\":0.6}",
+                 i > 0 ? "," : "", (long long)dt, 5.0 + i, 15.0 + i, 70 + i, 3.0 + i * 0.25);
+        body += entry;
+    }
+    body += "]}";
+    return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+static bool parse(Weather_parser* parser, const std::string &response)
+{
+    weather_parser_init(parser);
+    for (size_t i = 0; i < response.size(); i += PIECE_SIZE)
+    {
+        size_t length = response.size() - i < PIECE_SIZE ? response.size() - i : PIECE_SIZE;
+        if (!weather_parser_feed(parser, response.data() + i, length))
+            return false;
+    }
+    return weather_parser_finish(parser);
+}
+
+int main(int argc, char** argv)
+{
+    int parses = argc > 1 ? atoi(argv[1]) : DEFAULT_PARSES;
+    if (parses <= 0)
+    {
+        fprintf(stderr, "usage: %s [parses]\n", argv[0]);
+        return 1;
+    }
+    esp_log_level_set("*", ESP_LOG_NONE);
+    static Weather_parser parser;
+    bool passed = true;
+
+    printf("%d parses per case, store %zu bytes (hourly %zu, daily %zu)\n", parses, sizeof(Weather_forecast),
+           sizeof(Hourly_forecast), sizeof(Daily_forecast));
+    printf("%-14s %10s %8s %10s %12s %10s\n", "case", "response", "hours", "days", "expected", "us/parse");
+    for (const Forecast_case &forecast_case : cases)
+    {
+        std::string response = build_response(&forecast_case);
+        bool parsed = true;
+        uint64_t start = get_time_us();
+        for (int i = 0; i < parses; i++)
+            parsed = parse(&parser, response) && parsed;
+        double parse_us = (double)(get_time_us() - start) / parses;
+
+        const Weather_forecast* forecast = &parser.report.forecast;
+        bool as_expected = parsed && forecast->hourly.ring.count == FORECAST_HOURS
+                           && forecast->daily.ring.count == forecast_case.expected_days;
+        passed = passed && as_expected;
+        printf("%-14s %10zu %8d %10d %12d %10.1f%s\n", forecast_case.name, response.size(), forecast->hourly.ring.count,
+               forecast->daily.ring.count, forecast_case.expected_days, parse_us, as_expected ? "" : "  UNEXPECTED");
+    }
+    return passed ? 0 : 1;
+}
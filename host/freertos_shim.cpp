@@ -0,0 +1,222 @@
+/* This module implements the parts of the FreeRTOS API that the firmware uses on top of POSIX threads,
+ * so the modules can be built and benchmarked on a Linux host. One tick is one millisecond.
+ */
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+struct host_task
+{
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notify_value = 0;
+};
+
+//Thrown by vTaskDelete(NULL) to unwind the thread of the calling task
+struct host_task_exit
+{
+};
+
+struct host_semaphore
+{
+    std::timed_mutex lock;
+};
+
+struct host_queue
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<uint8_t> storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+};
+
+static thread_local host_task* current_task = NULL;
+static const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+static host_task* get_current_task()
+{
+    //Threads that weren't created through xTaskCreate (e.g. main) get a task control block on first use
+    if (current_task == NULL)
+        current_task = new host_task();
+    return current_task;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                       UBaseType_t priority, TaskHandle_t *created_task)
+{
+    host_task* task = new host_task();
+    if (created_task != NULL)
+        *created_task = task;
+    std::thread([task, function, params]()
+    {
+        current_task = task;
+        try
+        {
+            function(params);
+        }
+        catch (const host_task_exit &)
+        {
+        }
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *params,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id)
+{
+    return xTaskCreate(function, name, stack_depth, params, priority, created_task);
+}
+
+//A host thread can't be killed from the outside, deleting the calling task ends its thread.
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current_task)
+    {
+        throw host_task_exit();
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return get_current_task();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        task->notify_value++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    host_task* task = get_current_task();
+    std::unique_lock<std::mutex> guard(task->lock);
+    if (ticks_to_wait == portMAX_DELAY)
+        task->notified.wait(guard, [task]() { return task->notify_value != 0; });
+    else
+        task->notified.wait_for(guard, std::chrono::milliseconds(ticks_to_wait), [task]() { return task->notify_value != 0; });
+
+    uint32_t value = task->notify_value;
+    if (value != 0)
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    return value;
+}
+
+void host_enter_critical(portMUX_TYPE *mux)
+{
+    while (__atomic_exchange_n(&mux->owner, 1, __ATOMIC_ACQUIRE) != 0)
+        std::this_thread::yield();
+}
+
+void host_exit_critical(portMUX_TYPE *mux)
+{
+    __atomic_store_n(&mux->owner, 0, __ATOMIC_RELEASE);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return new host_semaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    if (ticks_to_wait == portMAX_DELAY)
+    {
+        semaphore->lock.lock();
+        return pdTRUE;
+    }
+    return semaphore->lock.try_lock_for(std::chrono::milliseconds(ticks_to_wait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->lock.unlock();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    delete semaphore;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue* queue = new host_queue();
+    queue->storage.resize((size_t)length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+//Waiting until the predicate holds or the ticks have passed, with the lock of the queue held
+template <typename Predicate>
+static bool queue_wait(host_queue* queue, std::unique_lock<std::mutex> &guard, TickType_t ticks_to_wait, Predicate predicate)
+{
+    if (ticks_to_wait == portMAX_DELAY)
+    {
+        queue->changed.wait(guard, predicate);
+        return true;
+    }
+    return queue->changed.wait_for(guard, std::chrono::milliseconds(ticks_to_wait), predicate);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!queue_wait(queue, guard, ticks_to_wait, [queue]() { return queue->count < queue->length; }))
+        return pdFALSE;
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[(size_t)tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    guard.unlock();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> guard(queue->lock);
+    if (!queue_wait(queue, guard, ticks_to_wait, [queue]() { return queue->count > 0; }))
+        return pdFALSE;
+    memcpy(buffer, &queue->storage[(size_t)queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    guard.unlock();
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return queue->count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
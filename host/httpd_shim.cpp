@@ -0,0 +1,852 @@
+/* This module implements the part of the esp_http_server API that the firmware uses on top of POSIX sockets,
+ * so HTTP_server.cpp can be built and load tested on a Linux host. It is modeled on the ESP-IDF 5.2 server:
+ *  - one server thread selects over the listening socket, a control pipe and the open sessions,
+ *    and runs the URI handlers itself; sessions with an asynchronous request are left out of the select,
+ *  - the request head is read into a scratch buffer of HTTPD_MAX_REQ_HDR_LEN bytes, the body is read by the handler,
+ *  - keep-alive, per-session contexts, LRU purge, close_fn, and a closed session after a failed handler.
+ * Per request it allocates only what the real server does: the copies of httpd_req_async_handler_begin().
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+static const char *TAG = "HOST_HTTPD";
+
+#define HOST_HTTPD_RX_SIZE          (HTTPD_MAX_REQ_HDR_LEN + 512)   //The head and the start of the body
+#define HOST_HTTPD_MAX_RESP_HDRS    16
+#define HOST_HTTPD_HEAD_SIZE        1024                            //The status line and the headers of a response
+
+struct host_httpd_session
+{
+    int fd;                                 //-1 if the slot is free
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    std::atomic<bool> for_async_req;
+    std::atomic<bool> close_pending;
+    uint64_t lru_counter;
+    char rx[HOST_HTTPD_RX_SIZE];            //Received bytes that haven't been consumed yet
+    size_t rx_start;
+    size_t rx_length;
+};
+
+struct host_httpd_resp_hdr
+{
+    const char *field;
+    const char *value;
+};
+
+//The private part of a request. httpd_req_async_handler_begin() copies it, so it holds offsets, not pointers to itself.
+struct host_httpd_aux
+{
+    host_httpd_session *session;
+    size_t remaining_len;                   //The body bytes that haven't been read
+    bool keep_alive;
+    bool chunked_started;
+    const char *status;
+    const char *content_type;
+    host_httpd_resp_hdr resp_hdrs[HOST_HTTPD_MAX_RESP_HDRS];
+    unsigned resp_hdr_count;
+    unsigned max_resp_headers;
+    unsigned header_count;
+    size_t headers_offset;                  //The header lines in scratch, each terminated by '\0'
+    char scratch[HTTPD_MAX_REQ_HDR_LEN + 1];
+};
+
+struct host_httpd
+{
+    httpd_config_t config;
+    int listen_fd;
+    int ctrl_pipe[2];
+    httpd_uri_t *handlers;
+    unsigned handler_count;
+    host_httpd_session *sessions;
+    std::mutex sessions_lock;               //Taken to assign a slot and to look up a session from other threads
+    uint64_t lru_counter;
+    std::atomic<bool> running;
+    std::thread thread;
+    //The request being processed by the server thread. httpd_req_t has a const URI array, so it is raw storage.
+    alignas(httpd_req_t) unsigned char req_storage[sizeof(httpd_req_t)];
+    host_httpd_aux aux;
+};
+
+static uint16_t port_override = 0;
+
+void host_httpd_set_port(uint16_t port)
+{
+    port_override = port;
+}
+
+static void wake_server(host_httpd *hd)
+{
+    char wake = 0;
+    if (write(hd->ctrl_pipe[1], &wake, 1) < 0)
+        ESP_LOGW(TAG, "Waking the server failed");
+}
+
+/* ---- Sessions ---- */
+
+static void close_session(host_httpd *hd, host_httpd_session *session)
+{
+    std::lock_guard<std::mutex> guard(hd->sessions_lock);
+    if (session->fd < 0)
+        return;
+    if (hd->config.close_fn != NULL)
+        hd->config.close_fn(hd, session->fd);
+    else
+        close(session->fd);
+    if (session->ctx != NULL)
+    {
+        if (session->free_ctx != NULL)
+            session->free_ctx(session->ctx);
+        else
+            free(session->ctx);
+    }
+    session->fd = -1;
+    session->ctx = NULL;
+    session->free_ctx = NULL;
+    session->close_pending = false;
+}
+
+static host_httpd_session *find_free_session(host_httpd *hd)
+{
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i].fd < 0)
+            return &hd->sessions[i];
+    }
+    return NULL;
+}
+
+//The least recently used session that can be closed, NULL if every session is busy with an asynchronous request
+static host_httpd_session *find_lru_session(host_httpd *hd)
+{
+    host_httpd_session *lru = NULL;
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        host_httpd_session *session = &hd->sessions[i];
+        if (session->fd >= 0 && !session->for_async_req && (lru == NULL || session->lru_counter < lru->lru_counter))
+            lru = session;
+    }
+    return lru;
+}
+
+static void accept_session(host_httpd *hd)
+{
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0)
+        return;
+
+    host_httpd_session *session = find_free_session(hd);
+    if (session == NULL && hd->config.lru_purge_enable)
+    {
+        session = find_lru_session(hd);
+        if (session != NULL)
+        {
+            ESP_LOGD(TAG, "Closing the least recently used session %d", session->fd);
+            close_session(hd, session);
+        }
+    }
+    if (session == NULL)
+    {
+        ESP_LOGW(TAG, "No free session, closing the new connection");
+        close(fd);
+        return;
+    }
+
+    struct timeval recv_timeout = {hd->config.recv_wait_timeout, 0};
+    struct timeval send_timeout = {hd->config.send_wait_timeout, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    //Linux would hold back the small writes for the delayed ACKs of the client, lwIP answers them at once
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    std::lock_guard<std::mutex> guard(hd->sessions_lock);
+    session->ctx = NULL;
+    session->free_ctx = NULL;
+    session->for_async_req = false;
+    session->close_pending = false;
+    session->lru_counter = ++hd->lru_counter;
+    session->rx_start = 0;
+    session->rx_length = 0;
+    session->fd = fd;
+    if (hd->config.open_fn != NULL && hd->config.open_fn(hd, fd) != ESP_OK)
+    {
+        close(fd);
+        session->fd = -1;
+    }
+}
+
+/* ---- Sending ---- */
+
+static esp_err_t send_all(int fd, struct iovec *iov, int count)
+{
+    while (count > 0)
+    {
+        struct msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        while (count > 0 && (size_t)sent >= iov->iov_len)
+        {
+            sent -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    return ESP_OK;
+}
+
+//The status line and the headers. Returns the length, 0 if they don't fit.
+static size_t format_head(host_httpd_aux *aux, char *head, size_t size, ssize_t content_length)
+{
+    int length = snprintf(head, size, "HTTP/1.1 %s\r\nContent-Type: %s\r\n", aux->status, aux->content_type);
+    if (content_length < 0)
+        length += snprintf(head + length, size - length, "Transfer-Encoding: chunked\r\n");
+    else
+        length += snprintf(head + length, size - length, "Content-Length: %zd\r\n", content_length);
+    for (unsigned i = 0; i < aux->resp_hdr_count && (size_t)length < size; i++)
+        length += snprintf(head + length, size - length, "%s: %s\r\n", aux->resp_hdrs[i].field, aux->resp_hdrs[i].value);
+    if ((size_t)length < size)
+        length += snprintf(head + length, size - length, "\r\n");
+    return (size_t)length < size ? length : 0;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if (r == NULL || status == NULL)
+        return ESP_ERR_INVALID_ARG;
+    ((host_httpd_aux *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if (r == NULL || type == NULL)
+        return ESP_ERR_INVALID_ARG;
+    ((host_httpd_aux *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (r == NULL || field == NULL || value == NULL)
+        return ESP_ERR_INVALID_ARG;
+    host_httpd_aux *aux = (host_httpd_aux *)r->aux;
+    if (aux->resp_hdr_count >= aux->max_resp_headers)
+        return ESP_ERR_HTTPD_RESP_HDR;
+    aux->resp_hdrs[aux->resp_hdr_count].field = field;
+    aux->resp_hdrs[aux->resp_hdr_count].value = value;
+    aux->resp_hdr_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (r == NULL)
+        return ESP_ERR_INVALID_ARG;
+    host_httpd_aux *aux = (host_httpd_aux *)r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = buf != NULL ? strlen(buf) : 0;
+
+    char head[HOST_HTTPD_HEAD_SIZE];
+    size_t head_length = format_head(aux, head, sizeof(head), buf_len);
+    if (head_length == 0)
+        return ESP_ERR_HTTPD_RESP_HDR;
+    struct iovec iov[2] = {{head, head_length}, {(void *)buf, (size_t)buf_len}};
+    return send_all(aux->session->fd, iov, buf_len > 0 ? 2 : 1);
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (r == NULL)
+        return ESP_ERR_INVALID_ARG;
+    host_httpd_aux *aux = (host_httpd_aux *)r->aux;
+    if (buf_len == HTTPD_RESP_USE_STRLEN)
+        buf_len = buf != NULL ? strlen(buf) : 0;
+
+    char head[HOST_HTTPD_HEAD_SIZE];
+    size_t head_length = 0;
+    if (!aux->chunked_started)
+    {
+        head_length = format_head(aux, head, sizeof(head), -1);
+        if (head_length == 0)
+            return ESP_ERR_HTTPD_RESP_HDR;
+        aux->chunked_started = true;
+    }
+    //A NULL buffer ends the response
+    char chunk_size[16];
+    int chunk_size_length = snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", buf != NULL ? (size_t)buf_len : 0);
+    struct iovec iov[4] =
+    {
+        {head, head_length},
+        {chunk_size, (size_t)chunk_size_length},
+        {(void *)buf, buf != NULL ? (size_t)buf_len : 0},
+        {(void *)"\r\n", 2}
+    };
+    return send_all(aux->session->fd, iov, 4);
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    static const char *const statuses[HTTPD_ERR_CODE_MAX] =
+    {
+        "500 Internal Server Error", "501 Method Not Implemented", "505 Version Not Supported",
+        "400 Bad Request", "401 Unauthorized", "403 Forbidden", "404 Not Found", "405 Method Not Allowed",
+        "408 Request Timeout", "411 Length Required", "414 URI Too Long", "431 Request Header Fields Too Large"
+    };
+    if (req == NULL || error >= HTTPD_ERR_CODE_MAX)
+        return ESP_ERR_INVALID_ARG;
+    httpd_resp_set_status(req, statuses[error]);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg != NULL ? msg : statuses[error], HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_resp_send_404(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_404_NOT_FOUND, NULL);
+}
+
+esp_err_t httpd_resp_send_408(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_408_REQ_TIMEOUT, NULL);
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r)
+{
+    return httpd_resp_send_err(r, HTTPD_500_INTERNAL_SERVER_ERROR, NULL);
+}
+
+/* ---- The request ---- */
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (r == NULL || buf == NULL)
+        return HTTPD_SOCK_ERR_INVALID;
+    host_httpd_aux *aux = (host_httpd_aux *)r->aux;
+    host_httpd_session *session = aux->session;
+    if (buf_len > aux->remaining_len)
+        buf_len = aux->remaining_len;
+    if (buf_len == 0)
+        return 0;
+
+    //The bytes that arrived with the head come first
+    if (session->rx_length > 0)
+    {
+        size_t length = buf_len < session->rx_length ? buf_len : session->rx_length;
+        memcpy(buf, session->rx + session->rx_start, length);
+        session->rx_start += length;
+        session->rx_length -= length;
+        aux->remaining_len -= length;
+        return length;
+    }
+    ssize_t received = recv(session->fd, buf, buf_len, 0);
+    if (received < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    aux->remaining_len -= received;
+    return received;
+}
+
+//Finding a header line of the request. Returns the start of its value, NULL if it isn't there.
+static const char *find_header(host_httpd_aux *aux, const char *field)
+{
+    size_t field_length = strlen(field);
+    const char *line = aux->scratch + aux->headers_offset;
+    for (unsigned i = 0; i < aux->header_count; i++)
+    {
+        if (strncasecmp(line, field, field_length) == 0 && line[field_length] == ':')
+        {
+            const char *value = line + field_length + 1;
+            while (*value == ' ' || *value == '\t')
+                value++;
+            return value;
+        }
+        line += strlen(line) + 1;
+    }
+    return NULL;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    if (r == NULL || field == NULL)
+        return 0;
+    const char *value = find_header((host_httpd_aux *)r->aux, field);
+    return value != NULL ? strlen(value) : 0;
+}
+
+//Copying a value the way the real server does: truncated to the buffer, with ESP_ERR_HTTPD_RESULT_TRUNC
+static esp_err_t copy_value(const char *value, size_t length, char *buf, size_t buf_size)
+{
+    if (buf_size == 0)
+        return ESP_ERR_INVALID_ARG;
+    size_t copied = length < buf_size - 1 ? length : buf_size - 1;
+    memcpy(buf, value, copied);
+    buf[copied] = '\0';
+    return copied < length ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (r == NULL || field == NULL || val == NULL)
+        return ESP_ERR_INVALID_ARG;
+    const char *value = find_header((host_httpd_aux *)r->aux, field);
+    if (value == NULL)
+        return ESP_ERR_NOT_FOUND;
+    return copy_value(value, strlen(value), val, val_size);
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    if (r == NULL)
+        return 0;
+    const char *query = strchr(r->uri, '?');
+    return query != NULL ? strlen(query + 1) : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (r == NULL || buf == NULL)
+        return ESP_ERR_INVALID_ARG;
+    const char *query = strchr(r->uri, '?');
+    if (query == NULL)
+        return ESP_ERR_NOT_FOUND;
+    return copy_value(query + 1, strlen(query + 1), buf, buf_len);
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    if (qry == NULL || key == NULL || val == NULL)
+        return ESP_ERR_INVALID_ARG;
+    size_t key_length = strlen(key);
+    const char *pair = qry;
+    while (pair != NULL && *pair != '\0')
+    {
+        const char *end = strchr(pair, '&');
+        if (strncmp(pair, key, key_length) == 0 && pair[key_length] == '=')
+        {
+            const char *value = pair + key_length + 1;
+            return copy_value(value, end != NULL ? (size_t)(end - value) : strlen(value), val, val_size);
+        }
+        pair = end != NULL ? end + 1 : NULL;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    if (r == NULL)
+        return -1;
+    return ((host_httpd_aux *)r->aux)->session->fd;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    if (r == NULL || out == NULL)
+        return ESP_ERR_INVALID_ARG;
+    httpd_req_t *async = (httpd_req_t *)malloc(sizeof(httpd_req_t));
+    host_httpd_aux *async_aux = (host_httpd_aux *)malloc(sizeof(host_httpd_aux));
+    if (async == NULL || async_aux == NULL)
+    {
+        free(async);
+        free(async_aux);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy((void *)async, r, sizeof(httpd_req_t));
+    memcpy(async_aux, r->aux, sizeof(host_httpd_aux));
+    async->aux = async_aux;
+    //The server thread doesn't select on the socket until the request is completed
+    async_aux->session->for_async_req = true;
+    *out = async;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    if (r == NULL)
+        return ESP_ERR_INVALID_ARG;
+    host_httpd_aux *aux = (host_httpd_aux *)r->aux;
+    host_httpd *hd = (host_httpd *)r->handle;
+    aux->session->for_async_req = false;
+    free(r->aux);
+    free(r);
+    wake_server(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    host_httpd *hd = (host_httpd *)handle;
+    std::lock_guard<std::mutex> guard(hd->sessions_lock);
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+    {
+        if (hd->sessions[i].fd == sockfd)
+        {
+            hd->sessions[i].close_pending = true;
+            wake_server(hd);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/* ---- Processing a request on the server thread ---- */
+
+//Reading until the end of the head. Returns its length including the empty line, 0 if the session has to be closed.
+static size_t read_head(host_httpd *hd, host_httpd_session *session)
+{
+    if (session->rx_start > 0)
+    {
+        memmove(session->rx, session->rx + session->rx_start, session->rx_length);
+        session->rx_start = 0;
+    }
+    while (true)
+    {
+        session->rx[session->rx_length] = '\0';
+        const char *end = strstr(session->rx, "\r\n\r\n");
+        if (end != NULL && (size_t)(end - session->rx) + 4 <= HTTPD_MAX_REQ_HDR_LEN)
+            return end - session->rx + 4;
+        if (end != NULL || session->rx_length >= HTTPD_MAX_REQ_HDR_LEN)
+        {
+            ESP_LOGW(TAG, "Request head too long");
+            static const char response[] = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\n\r\n";
+            send(session->fd, response, sizeof(response) - 1, MSG_NOSIGNAL);
+            return 0;
+        }
+        ssize_t received = recv(session->fd, session->rx + session->rx_length, HOST_HTTPD_RX_SIZE - 1 - session->rx_length, 0);
+        if (received <= 0)
+            return 0;
+        session->rx_length += received;
+    }
+}
+
+//Splitting the head into the request line and the header lines of the scratch buffer. Returns false if it is malformed.
+static bool parse_head(host_httpd *hd, host_httpd_session *session, size_t head_length)
+{
+    httpd_req_t *req = (httpd_req_t *)hd->req_storage;
+    host_httpd_aux *aux = &hd->aux;
+    memcpy(aux->scratch, session->rx, head_length - 2);
+    aux->scratch[head_length - 2] = '\0';
+    session->rx_start = head_length;
+    session->rx_length -= head_length;
+
+    //Every line ends with "\r\n", they become '\0'-terminated strings
+    char *line = aux->scratch;
+    char *request_line = NULL;
+    char *compact = aux->scratch;
+    aux->header_count = 0;
+    while (*line != '\0')
+    {
+        char *end = strstr(line, "\r\n");
+        if (end == NULL)
+            return false;
+        *end = '\0';
+        size_t length = end - line;
+        memmove(compact, line, length + 1);
+        if (request_line == NULL)
+        {
+            request_line = compact;
+            aux->headers_offset = compact + length + 1 - aux->scratch;
+        }
+        else
+        {
+            aux->header_count++;
+        }
+        compact += length + 1;
+        line = end + 2;
+    }
+    if (request_line == NULL)
+        return false;
+
+    char *method = request_line;
+    char *uri = strchr(method, ' ');
+    if (uri == NULL)
+        return false;
+    *uri++ = '\0';
+    char *version = strchr(uri, ' ');
+    if (version == NULL)
+        return false;
+    *version++ = '\0';
+    if (strlen(uri) > HTTPD_MAX_URI_LEN)
+        return false;
+
+    static const char *const methods[] = {"DELETE", "GET", "HEAD", "POST", "PUT"};
+    req->method = -1;
+    for (int i = 0; i < (int)(sizeof(methods) / sizeof(methods[0])); i++)
+    {
+        if (strcmp(method, methods[i]) == 0)
+            req->method = i;
+    }
+    strcpy((char *)req->uri, uri);
+
+    const char *content_length = find_header(aux, "Content-Length");
+    req->content_len = content_length != NULL ? strtoul(content_length, NULL, 10) : 0;
+    aux->remaining_len = req->content_len;
+    const char *connection = find_header(aux, "Connection");
+    if (strcmp(version, "HTTP/1.0") == 0)
+        aux->keep_alive = connection != NULL && strcasecmp(connection, "keep-alive") == 0;
+    else
+        aux->keep_alive = connection == NULL || strcasecmp(connection, "close") != 0;
+    return true;
+}
+
+static const httpd_uri_t *find_handler(host_httpd *hd, const char *uri, int method, bool *uri_exists)
+{
+    const char *query = strchr(uri, '?');
+    size_t length = query != NULL ? (size_t)(query - uri) : strlen(uri);
+    *uri_exists = false;
+    for (unsigned i = 0; i < hd->handler_count; i++)
+    {
+        const httpd_uri_t *handler = &hd->handlers[i];
+        if (strlen(handler->uri) == length && strncmp(handler->uri, uri, length) == 0)
+        {
+            *uri_exists = true;
+            if ((int)handler->method == method)
+                return handler;
+        }
+    }
+    return NULL;
+}
+
+//Processing one request of the session. Returns false if the session has been closed.
+static bool process_request(host_httpd *hd, host_httpd_session *session)
+{
+    size_t head_length = read_head(hd, session);
+    if (head_length == 0)
+    {
+        close_session(hd, session);
+        return false;
+    }
+    session->lru_counter = ++hd->lru_counter;
+
+    httpd_req_t *req = (httpd_req_t *)hd->req_storage;
+    host_httpd_aux *aux = &hd->aux;
+    memset(hd->req_storage, 0, sizeof(hd->req_storage));
+    aux->session = session;
+    aux->chunked_started = false;
+    aux->status = HTTPD_200;
+    aux->content_type = HTTPD_TYPE_TEXT;
+    aux->resp_hdr_count = 0;
+    aux->max_resp_headers = hd->config.max_resp_headers < HOST_HTTPD_MAX_RESP_HDRS ? hd->config.max_resp_headers : HOST_HTTPD_MAX_RESP_HDRS;
+    req->handle = hd;
+    req->aux = aux;
+    req->sess_ctx = session->ctx;
+    req->free_ctx = session->free_ctx;
+
+    if (!parse_head(hd, session, head_length))
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, NULL);
+        close_session(hd, session);
+        return false;
+    }
+
+    bool uri_exists;
+    const httpd_uri_t *handler = find_handler(hd, req->uri, req->method, &uri_exists);
+    esp_err_t ret;
+    if (handler == NULL)
+    {
+        if (uri_exists)
+            httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, "Request method for this URI is not handled by server");
+        else
+            httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Nothing matches the given URI");
+        ret = ESP_OK;
+    }
+    else
+    {
+        req->user_ctx = handler->user_ctx;
+        ret = handler->handler(req);
+    }
+
+    //The session keeps the context the handler left in the request
+    if (!req->ignore_sess_ctx_changes && req->sess_ctx != session->ctx && session->ctx != NULL)
+    {
+        if (session->free_ctx != NULL)
+            session->free_ctx(session->ctx);
+        else
+            free(session->ctx);
+    }
+    session->ctx = req->sess_ctx;
+    session->free_ctx = req->free_ctx;
+
+    if (session->for_async_req)
+        return true;
+    if (ret != ESP_OK || !aux->keep_alive)
+    {
+        close_session(hd, session);
+        return false;
+    }
+    //Discarding the body the handler didn't read
+    char purge[32];
+    while (aux->remaining_len > 0)
+    {
+        if (httpd_req_recv(req, purge, sizeof(purge)) <= 0)
+        {
+            close_session(hd, session);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void server_thread(host_httpd *hd)
+{
+    while (hd->running)
+    {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(hd->listen_fd, &read_fds);
+        FD_SET(hd->ctrl_pipe[0], &read_fds);
+        int max_fd = hd->listen_fd > hd->ctrl_pipe[0] ? hd->listen_fd : hd->ctrl_pipe[0];
+        for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            host_httpd_session *session = &hd->sessions[i];
+            if (session->fd >= 0 && !session->for_async_req)
+            {
+                FD_SET(session->fd, &read_fds);
+                if (session->fd > max_fd)
+                    max_fd = session->fd;
+            }
+        }
+        if (select(max_fd + 1, &read_fds, NULL, NULL, NULL) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ESP_LOGE(TAG, "select failed: %s", strerror(errno));
+            break;
+        }
+
+        if (FD_ISSET(hd->ctrl_pipe[0], &read_fds))
+        {
+            char drain[64];
+            if (read(hd->ctrl_pipe[0], drain, sizeof(drain)) < 0)
+                ESP_LOGW(TAG, "Reading the control pipe failed");
+        }
+        for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            host_httpd_session *session = &hd->sessions[i];
+            if (session->fd >= 0 && session->close_pending && !session->for_async_req)
+                close_session(hd, session);
+        }
+        for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        {
+            host_httpd_session *session = &hd->sessions[i];
+            if (session->fd >= 0 && !session->for_async_req && FD_ISSET(session->fd, &read_fds))
+            {
+                //A pipelined request may already be in the buffer
+                while (process_request(hd, session) && !session->for_async_req && session->rx_length > 0)
+                {
+                }
+            }
+        }
+        if (FD_ISSET(hd->listen_fd, &read_fds))
+            accept_session(hd);
+    }
+}
+
+/* ---- Starting and stopping ---- */
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (handle == NULL || config == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    host_httpd *hd = new host_httpd();
+    hd->config = *config;
+    hd->handlers = new httpd_uri_t[config->max_uri_handlers];
+    hd->handler_count = 0;
+    hd->sessions = new host_httpd_session[config->max_open_sockets];
+    for (unsigned i = 0; i < config->max_open_sockets; i++)
+        hd->sessions[i].fd = -1;
+    hd->lru_counter = 0;
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port_override != 0 ? port_override : config->server_port);
+    int reuse = 1;
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (hd->listen_fd < 0
+        || setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0
+        || bind(hd->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0
+        || listen(hd->listen_fd, config->backlog_conn) < 0
+        || pipe(hd->ctrl_pipe) < 0)
+    {
+        ESP_LOGE(TAG, "Failed to listen on port %d: %s", ntohs(address.sin_port), strerror(errno));
+        if (hd->listen_fd >= 0)
+            close(hd->listen_fd);
+        delete[] hd->handlers;
+        delete[] hd->sessions;
+        delete hd;
+        return ESP_ERR_HTTPD_TASK;
+    }
+
+    hd->running = true;
+    hd->thread = std::thread(server_thread, hd);
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    host_httpd *hd = (host_httpd *)handle;
+    if (hd == NULL)
+        return ESP_ERR_INVALID_ARG;
+    hd->running = false;
+    wake_server(hd);
+    hd->thread.join();
+    for (unsigned i = 0; i < hd->config.max_open_sockets; i++)
+        close_session(hd, &hd->sessions[i]);
+    close(hd->listen_fd);
+    close(hd->ctrl_pipe[0]);
+    close(hd->ctrl_pipe[1]);
+    for (unsigned i = 0; i < hd->handler_count; i++)
+        free((void *)hd->handlers[i].uri);
+    delete[] hd->handlers;
+    delete[] hd->sessions;
+    delete hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    host_httpd *hd = (host_httpd *)handle;
+    if (hd == NULL || uri_handler == NULL)
+        return ESP_ERR_INVALID_ARG;
+    bool uri_exists;
+    if (find_handler(hd, uri_handler->uri, uri_handler->method, &uri_exists) != NULL)
+        return ESP_ERR_HTTPD_HANDLER_EXISTS;
+    if (hd->handler_count >= hd->config.max_uri_handlers)
+    {
+        ESP_LOGW(TAG, "No slot left for %s", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    //The server keeps its own copy of the URI, like the real one
+    hd->handlers[hd->handler_count] = *uri_handler;
+    hd->handlers[hd->handler_count].uri = strdup(uri_handler->uri);
+    hd->handler_count++;
+    return ESP_OK;
+}
@@ -0,0 +1,16 @@
+/* Placeholder credentials for the host build. The firmware's own credentials.h is not part of the repository. */
+#ifndef CREDENTIALS_H_
+#define CREDENTIALS_H_
+
+#define WIFI_SSID_DEFAULT "HomeAutomaton"
+#define WIFI_PWD_DEFAULT "password"
+#define HOME_AUTOMATON_SSID "HomeAutomaton_AP"
+#define HOME_AUTOMATON_PASS "password"
+#define TIMEZONE_DEFAULT "CET-1CEST,M3.5.0,M10.5.0/3"
+#define LAT 47.50
+#define LON 19.04
+#define MQTT_TOPIC_ADDRESS "/topic/phone_data"
+#define MQTT_TOPIC "phone_data"
+#define MQTT_ADDRESS_URI "mqtt://127.0.0.1"
+
+#endif
@@ -0,0 +1,10 @@
+/* Host build shim of esp_event.h, only the types of the event handlers */
+#ifndef HOST_ESP_EVENT_H_
+#define HOST_ESP_EVENT_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef const char* esp_event_base_t;
+
+#endif
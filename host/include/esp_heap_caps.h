@@ -0,0 +1,15 @@
+/* Host build shim of esp_heap_caps.h */
+#ifndef HOST_ESP_HEAP_CAPS_H_
+#define HOST_ESP_HEAP_CAPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+/* Host build shim of esp_https_server.h, the server runs without TLS */
+#ifndef HOST_ESP_HTTPS_SERVER_H_
+#define HOST_ESP_HTTPS_SERVER_H_
+
+#include "esp_http_server.h"
+
+static inline esp_err_t httpd_ssl_stop(httpd_handle_t handle)
+{
+    return httpd_stop(handle);
+}
+
+#endif
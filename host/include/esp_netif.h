@@ -0,0 +1,7 @@
+/* Host build shim of esp_netif.h, the host network stack is used directly */
+#ifndef HOST_ESP_NETIF_H_
+#define HOST_ESP_NETIF_H_
+
+#include "esp_err.h"
+
+#endif
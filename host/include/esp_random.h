@@ -0,0 +1,15 @@
+/* Host build shim of esp_random.h */
+#ifndef HOST_ESP_RANDOM_H_
+#define HOST_ESP_RANDOM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t esp_random(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,15 @@
+/* Host build shim of the ROM CRC functions */
+#ifndef HOST_ESP_ROM_CRC_H_
+#define HOST_ESP_ROM_CRC_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
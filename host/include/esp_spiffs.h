@@ -0,0 +1,22 @@
+/* Host build shim of esp_spiffs.h. Nothing is mounted, the files are read from the base path of the host file system. */
+#ifndef HOST_ESP_SPIFFS_H_
+#define HOST_ESP_SPIFFS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct
+{
+    const char* base_path;
+    const char* partition_label;
+    size_t max_files;
+    bool format_if_mount_failed;
+} esp_vfs_spiffs_conf_t;
+
+static inline esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t* conf)
+{
+    return ESP_OK;
+}
+
+#endif
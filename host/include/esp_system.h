@@ -0,0 +1,24 @@
+/* Host build shim of esp_system.h */
+#ifndef HOST_ESP_SYSTEM_H_
+#define HOST_ESP_SYSTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_random.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle);
+//Runs the shutdown handlers like esp_restart() does, but returns to the caller
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,15 @@
+/* Host build shim of esp_timer.h, microseconds since the start of the process */
+#ifndef HOST_ESP_TIMER_H_
+#define HOST_ESP_TIMER_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+int64_t esp_timer_get_time(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
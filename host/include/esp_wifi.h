@@ -0,0 +1,7 @@
+/* Host build shim of esp_wifi.h, the host is always connected */
+#ifndef HOST_ESP_WIFI_H_
+#define HOST_ESP_WIFI_H_
+
+#include "esp_err.h"
+
+#endif
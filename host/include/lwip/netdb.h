@@ -0,0 +1,7 @@
+/* Host build shim of lwip/netdb.h */
+#ifndef HOST_LWIP_NETDB_H_
+#define HOST_LWIP_NETDB_H_
+
+#include <netdb.h>
+
+#endif
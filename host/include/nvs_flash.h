@@ -0,0 +1,17 @@
+/* Host build shim of nvs_flash.h. The partition is a file, see nvs_emulator.h. */
+#ifndef HOST_NVS_FLASH_H_
+#define HOST_NVS_FLASH_H_
+
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_deinit(void);
+esp_err_t nvs_flash_erase(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif
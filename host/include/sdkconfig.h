@@ -0,0 +1,7 @@
+/* Host build shim of the generated sdkconfig.h, the options the firmware checks at compile time */
+#ifndef HOST_SDKCONFIG_H_
+#define HOST_SDKCONFIG_H_
+
+#define CONFIG_LWIP_MAX_SOCKETS 10
+
+#endif
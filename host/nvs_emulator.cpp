@@ -0,0 +1,822 @@
+/* This module emulates the NVS library on the host with a file-backed partition.
+ * Layout of a page: 32-byte header, 32-byte entry state bitmap (2 bits per entry: 11 empty, 10 written, 00 erased),
+ * then 126 entries of 32 bytes. An item is one entry (namespace, type, span, chunk index, CRC, 16-byte key, 8 bytes of data),
+ * strings and blob chunks are followed by span-1 entries of payload. Blobs are written like NVS does it: a data chunk
+ * with an alternating chunk index, then an index entry, then the previous version is erased.
+ * Updates are appended to the active page and the old entries are marked erased. When only the spare page is
+ * left, the full page with the most erased entries is garbage collected into it and erased.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "nvs_emulator.h"
+
+static const char *TAG = "NVS_EMU";
+
+#define PAGE_SIZE       4096
+#define ENTRY_SIZE      32
+#define ENTRY_COUNT     126
+#define HEADER_SIZE     32
+#define BITMAP_OFFSET   32
+#define ENTRIES_OFFSET  64
+#define KEY_SIZE        16
+
+#define PAGE_EMPTY      0xFFFFFFFFu
+#define PAGE_ACTIVE     0xFFFFFFFEu
+#define PAGE_FULL       0xFFFFFFFCu
+#define PAGE_FREEING    0xFFFFFFF8u
+
+#define ENTRY_EMPTY     3
+#define ENTRY_WRITTEN   2
+#define ENTRY_ERASED    0
+
+#define TYPE_U8         0x01
+#define TYPE_I8         0x11
+#define TYPE_I64        0x18
+#define TYPE_STR        0x21
+#define TYPE_BLOB_DATA  0x42
+#define TYPE_BLOB_IDX   0x48
+
+#define CHUNK_ANY       0xFF
+#define VER_OFFSET      0x80
+
+struct __attribute__((packed)) Entry
+{
+    uint8_t ns;
+    uint8_t type;
+    uint8_t span;
+    uint8_t chunk_index;
+    uint32_t crc;
+    char key[KEY_SIZE];
+    uint8_t data[8];
+};
+
+struct Location
+{
+    int page;
+    int index;
+    uint8_t type;
+    uint8_t span;
+};
+
+struct Page
+{
+    uint32_t state;
+    uint32_t seq;
+    int next_free;
+    int erased;
+};
+
+typedef std::pair<uint16_t, std::string> Item_key; //(namespace << 8 | chunk index, key)
+
+static std::recursive_mutex emu_mutex;
+static std::string file_path = "nvs_partition.bin";
+static size_t partition_size = 0x6000;
+static int fd = -1;
+static std::vector<uint8_t> flash;
+static std::vector<Page> pages;
+static std::map<Item_key, Location> items;
+static std::map<std::string, uint8_t> namespaces;
+static std::map<nvs_handle_t, std::pair<uint8_t, bool>> handles; //handle -> (namespace, read-only)
+static nvs_handle_t next_handle = 1;
+static int active_page = -1;
+static uint32_t next_seq = 0;
+static bool initialized = false;
+static Nvs_emu_stats stats;
+static uint64_t flash_time_at_commit = 0;
+
+/* ---- Flash primitives, every modification is written through to the file ---- */
+
+static void program(size_t offset, const void* data, size_t length)
+{
+    memcpy(&flash[offset], data, length);
+    if (pwrite(fd, &flash[offset], length, offset) != (ssize_t)length)
+        ESP_LOGE(TAG, "Writing the partition file failed");
+    stats.program_ops++;
+    stats.bytes_programmed += length;
+    stats.flash_time_us += NVS_EMU_PROGRAM_OVERHEAD_US + (length * NVS_EMU_PROGRAM_NS_PER_BYTE) / 1000;
+}
+
+static void erase_page(int page)
+{
+    memset(&flash[page * PAGE_SIZE], 0xFF, PAGE_SIZE);
+    if (pwrite(fd, &flash[page * PAGE_SIZE], PAGE_SIZE, page * PAGE_SIZE) != PAGE_SIZE)
+        ESP_LOGE(TAG, "Erasing the partition file failed");
+    stats.page_erases++;
+    stats.erases_per_page[page]++;
+    stats.flash_time_us += NVS_EMU_ERASE_US;
+    pages[page].state = PAGE_EMPTY;
+    pages[page].seq = 0;
+    pages[page].next_free = 0;
+    pages[page].erased = 0;
+}
+
+static size_t entry_offset(int page, int index)
+{
+    return page * PAGE_SIZE + ENTRIES_OFFSET + index * ENTRY_SIZE;
+}
+
+static int entry_state(int page, int index)
+{
+    uint8_t byte = flash[page * PAGE_SIZE + BITMAP_OFFSET + index / 4];
+    return (byte >> ((index % 4) * 2)) & 3;
+}
+
+//Flash bits can only be cleared, so a state change is a program of a single bitmap byte
+static void set_entry_state(int page, int index, int state)
+{
+    size_t offset = page * PAGE_SIZE + BITMAP_OFFSET + index / 4;
+    int shift = (index % 4) * 2;
+    uint8_t byte = flash[offset];
+    byte = (byte & ~(3 << shift)) | (state << shift);
+    program(offset, &byte, 1);
+}
+
+static void set_page_state(int page, uint32_t state)
+{
+    uint32_t header[2] = {state, pages[page].seq};
+    program(page * PAGE_SIZE, header, sizeof(header));
+    pages[page].state = state;
+}
+
+static uint32_t entry_crc(const Entry &entry)
+{
+    Entry copy = entry;
+    copy.crc = 0;
+    return esp_rom_crc32_le(0, (const uint8_t*)&copy, sizeof(copy));
+}
+
+/* ---- Page management ---- */
+
+static void activate_page(int page)
+{
+    pages[page].seq = next_seq++;
+    set_page_state(page, PAGE_ACTIVE);
+    active_page = page;
+}
+
+static int count_pages(uint32_t state)
+{
+    int count = 0;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].state == state)
+            count++;
+    }
+    return count;
+}
+
+//Copying the written entries of a page to the active page, keeping the index up to date
+static void copy_live_entries(int from)
+{
+    for (int index = 0; index < ENTRY_COUNT; index++)
+    {
+        if (entry_state(from, index) != ENTRY_WRITTEN)
+            continue;
+        Entry entry;
+        memcpy(&entry, &flash[entry_offset(from, index)], sizeof(entry));
+        int span = entry.span ? entry.span : 1;
+        int to = pages[active_page].next_free;
+        for (int i = 0; i < span; i++)
+        {
+            program(entry_offset(active_page, to + i), &flash[entry_offset(from, index + i)], ENTRY_SIZE);
+            set_entry_state(active_page, to + i, ENTRY_WRITTEN);
+        }
+        stats.entries_written += span;
+        pages[active_page].next_free += span;
+
+        char key[KEY_SIZE + 1] = {0};
+        memcpy(key, entry.key, KEY_SIZE);
+        Item_key item_key((entry.ns << 8) | entry.chunk_index, key);
+        std::map<Item_key, Location>::iterator it = items.find(item_key);
+        if (it != items.end() && it->second.page == from && it->second.index == index)
+        {
+            it->second.page = active_page;
+            it->second.index = to;
+        }
+        index += span - 1;
+    }
+}
+
+/* Marking the active page full and taking a new one. One empty page is always kept as a spare:
+ * when it is the last one, the full page with the most erased entries is collected into it.
+ */
+static esp_err_t request_new_page()
+{
+    if (active_page >= 0)
+        set_page_state(active_page, PAGE_FULL);
+    active_page = -1;
+
+    if (count_pages(PAGE_EMPTY) > 1)
+    {
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            if (pages[i].state == PAGE_EMPTY)
+            {
+                activate_page(i);
+                return ESP_OK;
+            }
+        }
+    }
+
+    int victim = -1;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].state == PAGE_FULL && pages[i].erased > 0 && (victim < 0 || pages[i].erased > pages[victim].erased))
+            victim = i;
+    }
+    int spare = -1;
+    for (size_t i = 0; i < pages.size(); i++)
+    {
+        if (pages[i].state == PAGE_EMPTY)
+            spare = i;
+    }
+    if (victim < 0 || spare < 0)
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+    stats.gc_runs++;
+    activate_page(spare);
+    set_page_state(victim, PAGE_FREEING);
+    copy_live_entries(victim);
+    erase_page(victim);
+    return ESP_OK;
+}
+
+static esp_err_t allocate(int span, int* page, int* index)
+{
+    if (span > ENTRY_COUNT)
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    for (size_t attempt = 0; attempt <= pages.size(); attempt++)
+    {
+        if (active_page >= 0 && ENTRY_COUNT - pages[active_page].next_free >= span)
+        {
+            *page = active_page;
+            *index = pages[active_page].next_free;
+            pages[active_page].next_free += span;
+            return ESP_OK;
+        }
+        esp_err_t ret = request_new_page();
+        if (ret != ESP_OK)
+            return ret;
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+/* ---- Items ---- */
+
+static void erase_item(const Location &location)
+{
+    for (int i = 0; i < location.span; i++)
+        set_entry_state(location.page, location.index + i, ENTRY_ERASED);
+    pages[location.page].erased += location.span;
+}
+
+//Writing an item with its payload. The previous version of the item is erased afterwards.
+static esp_err_t write_item(uint8_t ns, uint8_t type, const char* key, uint8_t chunk_index,
+                            const uint8_t* data8, const void* payload, size_t payload_length)
+{
+    if (strlen(key) >= KEY_SIZE)
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    Entry entry;
+    memset(&entry, 0xFF, sizeof(entry));
+    entry.ns = ns;
+    entry.type = type;
+    entry.span = 1 + (payload_length + ENTRY_SIZE - 1) / ENTRY_SIZE;
+    entry.chunk_index = chunk_index;
+    memset(entry.key, 0, KEY_SIZE);
+    memcpy(entry.key, key, strlen(key));
+    memcpy(entry.data, data8, sizeof(entry.data));
+    entry.crc = entry_crc(entry);
+
+    int page, index;
+    esp_err_t ret = allocate(entry.span, &page, &index);
+    if (ret != ESP_OK)
+        return ret;
+
+    program(entry_offset(page, index), &entry, sizeof(entry));
+    if (payload_length > 0)
+        program(entry_offset(page, index + 1), payload, payload_length);
+    for (int i = 0; i < entry.span; i++)
+        set_entry_state(page, index + i, ENTRY_WRITTEN);
+    stats.entries_written += entry.span;
+
+    Item_key item_key((ns << 8) | chunk_index, key);
+    std::map<Item_key, Location>::iterator old = items.find(item_key);
+    if (old != items.end())
+        erase_item(old->second);
+    Location location = {page, index, type, entry.span};
+    items[item_key] = location;
+    return ESP_OK;
+}
+
+static const Location* find_item(uint8_t ns, const char* key, uint8_t chunk_index)
+{
+    std::map<Item_key, Location>::iterator it = items.find(Item_key((ns << 8) | chunk_index, key));
+    return it == items.end() ? NULL : &it->second;
+}
+
+static Entry read_entry(const Location &location)
+{
+    Entry entry;
+    memcpy(&entry, &flash[entry_offset(location.page, location.index)], sizeof(entry));
+    return entry;
+}
+
+static const uint8_t* payload_of(const Location &location)
+{
+    return &flash[entry_offset(location.page, location.index + 1)];
+}
+
+//Rebuilding the index by scanning the pages in the order they were written
+static void load_partition()
+{
+    items.clear();
+    namespaces.clear();
+    active_page = -1;
+    next_seq = 0;
+
+    std::vector<int> order;
+    for (size_t page = 0; page < pages.size(); page++)
+    {
+        uint32_t header[2];
+        memcpy(header, &flash[page * PAGE_SIZE], sizeof(header));
+        pages[page].state = header[0];
+        pages[page].seq = header[1];
+        pages[page].next_free = 0;
+        pages[page].erased = 0;
+        if (header[0] != PAGE_EMPTY)
+            order.push_back(page);
+        if (header[0] != PAGE_EMPTY && header[1] >= next_seq)
+            next_seq = header[1] + 1;
+    }
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        for (size_t j = i + 1; j < order.size(); j++)
+        {
+            if (pages[order[j]].seq < pages[order[i]].seq)
+                std::swap(order[i], order[j]);
+        }
+    }
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        int page = order[i];
+        for (int index = 0; index < ENTRY_COUNT; index++)
+        {
+            int state = entry_state(page, index);
+            if (state == ENTRY_EMPTY)
+                continue;
+            pages[page].next_free = index + 1;
+            if (state == ENTRY_ERASED)
+            {
+                pages[page].erased++;
+                continue;
+            }
+            Entry entry;
+            memcpy(&entry, &flash[entry_offset(page, index)], sizeof(entry));
+            if (entry.crc != entry_crc(entry) || entry.span == 0 || index + entry.span > ENTRY_COUNT)
+            {
+                ESP_LOGW(TAG, "Skipping a corrupted entry at page %d, entry %d", page, index);
+                continue;
+            }
+            char key[KEY_SIZE + 1] = {0};
+            memcpy(key, entry.key, KEY_SIZE);
+            Location location = {page, index, entry.type, entry.span};
+            items[Item_key((entry.ns << 8) | entry.chunk_index, key)] = location;
+            if (entry.ns == 0)
+                namespaces[key] = entry.data[0];
+            pages[page].next_free = index + entry.span;
+            index += entry.span - 1;
+        }
+        if (pages[page].state == PAGE_ACTIVE)
+            active_page = page;
+    }
+}
+
+/* ---- Emulator control ---- */
+
+void nvs_emu_configure(const char* path, size_t size)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    file_path = path;
+    partition_size = size - size % PAGE_SIZE;
+}
+
+void nvs_emu_reset_stats()
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    size_t page_count = pages.size() ? pages.size() : partition_size / PAGE_SIZE;
+    stats = Nvs_emu_stats();
+    stats.erases_per_page.assign(page_count, 0);
+    flash_time_at_commit = 0;
+}
+
+Nvs_emu_stats nvs_emu_get_stats()
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    return stats;
+}
+
+size_t nvs_emu_partition_size(const char* csv_path, const char* partition_name)
+{
+    FILE* fp = fopen(csv_path, "r");
+    if (fp == NULL)
+        return 0;
+    char line[256];
+    size_t size = 0;
+    while (size == 0 && fgets(line, sizeof(line), fp) != NULL)
+    {
+        if (line[0] == '#')
+            continue;
+        //Name, Type, SubType, Offset, Size, Flags
+        char* fields[6] = {0};
+        int count = 0;
+        for (char* token = strtok(line, ","); token != NULL && count < 6; token = strtok(NULL, ","))
+        {
+            while (*token == ' ' || *token == '\t')
+                token++;
+            fields[count++] = token;
+        }
+        if (count >= 5 && strncmp(fields[0], partition_name, strlen(partition_name)) == 0
+            && (fields[0][strlen(partition_name)] == ' ' || fields[0][strlen(partition_name)] == '\0'))
+        {
+            char* end;
+            size = strtoul(fields[4], &end, 0);
+            if (*end == 'K' || *end == 'k')
+                size *= 1024;
+            else if (*end == 'M' || *end == 'm')
+                size *= 1024 * 1024;
+        }
+    }
+    fclose(fp);
+    return size;
+}
+
+/* ---- nvs_flash.h ---- */
+
+esp_err_t nvs_flash_init(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    if (initialized)
+        return ESP_OK;
+
+    fd = open(file_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "Can't open the partition file %s", file_path.c_str());
+        return ESP_FAIL;
+    }
+    flash.assign(partition_size, 0xFF);
+    pages.assign(partition_size / PAGE_SIZE, Page());
+    if (stats.erases_per_page.size() != pages.size())
+        nvs_emu_reset_stats();
+
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    if (file_size != (off_t)partition_size || pread(fd, &flash[0], partition_size, 0) != (ssize_t)partition_size)
+    {
+        //A new partition reads as erased flash
+        flash.assign(partition_size, 0xFF);
+        if (ftruncate(fd, 0) != 0 || pwrite(fd, &flash[0], partition_size, 0) != (ssize_t)partition_size)
+            ESP_LOGE(TAG, "Initializing the partition file failed");
+    }
+    load_partition();
+    if (count_pages(PAGE_EMPTY) == 0 && active_page < 0)
+        return ESP_ERR_NVS_NO_FREE_PAGES;
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+    handles.clear();
+    initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    bool was_initialized = initialized;
+    if (!was_initialized && nvs_flash_init() != ESP_OK && fd < 0)
+        return ESP_FAIL;
+    for (size_t page = 0; page < pages.size(); page++)
+        erase_page(page);
+    load_partition();
+    return ESP_OK;
+}
+
+/* ---- nvs.h ---- */
+
+static esp_err_t get_handle(nvs_handle_t handle, bool write, uint8_t* ns)
+{
+    if (!initialized)
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    std::map<nvs_handle_t, std::pair<uint8_t, bool> >::iterator it = handles.find(handle);
+    if (it == handles.end())
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    if (write && it->second.second)
+        return ESP_ERR_NVS_READ_ONLY;
+    *ns = it->second.first;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    if (!initialized)
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    if (strlen(name) >= KEY_SIZE)
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+
+    std::map<std::string, uint8_t>::iterator it = namespaces.find(name);
+    uint8_t ns;
+    if (it != namespaces.end())
+    {
+        ns = it->second;
+    }
+    else
+    {
+        if (open_mode == NVS_READONLY)
+            return ESP_ERR_NVS_NOT_FOUND;
+        ns = namespaces.size() + 1;
+        uint8_t data[8];
+        memset(data, 0xFF, sizeof(data));
+        data[0] = ns;
+        esp_err_t ret = write_item(0, TYPE_U8, name, CHUNK_ANY, data, NULL, 0);
+        if (ret != ESP_OK)
+            return ret;
+        namespaces[name] = ns;
+    }
+    *out_handle = next_handle++;
+    handles[*out_handle] = std::make_pair(ns, open_mode == NVS_READONLY);
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    handles.erase(handle);
+}
+
+//NVS writes every item immediately, the commit only closes the latency sample of the writes before it
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, false, &ns);
+    if (ret != ESP_OK)
+        return ret;
+    stats.commit_latency_us.push_back(stats.flash_time_us - flash_time_at_commit);
+    flash_time_at_commit = stats.flash_time_us;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, true, &ns);
+    if (ret != ESP_OK)
+        return ret;
+
+    const Location* location = find_item(ns, key, CHUNK_ANY);
+    if (location == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (location->type == TYPE_BLOB_IDX)
+    {
+        Entry index = read_entry(*location);
+        const Location* chunk = find_item(ns, key, index.data[5]);
+        if (chunk != NULL)
+        {
+            erase_item(*chunk);
+            items.erase(Item_key((ns << 8) | index.data[5], key));
+        }
+    }
+    erase_item(*location);
+    items.erase(Item_key((ns << 8) | CHUNK_ANY, key));
+    return ESP_OK;
+}
+
+static esp_err_t set_primitive(nvs_handle_t handle, const char *key, uint8_t type, const void* value, size_t size)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, true, &ns);
+    if (ret != ESP_OK)
+        return ret;
+
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    memcpy(data, value, size);
+    const Location* old = find_item(ns, key, CHUNK_ANY);
+    if (old != NULL && old->type == type && memcmp(read_entry(*old).data, data, size) == 0)
+    {
+        stats.skipped_writes++;
+        return ESP_OK;
+    }
+    return write_item(ns, type, key, CHUNK_ANY, data, NULL, 0);
+}
+
+static esp_err_t get_primitive(nvs_handle_t handle, const char *key, uint8_t type, void* out, size_t size)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, false, &ns);
+    if (ret != ESP_OK)
+        return ret;
+    const Location* location = find_item(ns, key, CHUNK_ANY);
+    if (location == NULL || location->type != type)
+        return ESP_ERR_NVS_NOT_FOUND;
+    memcpy(out, read_entry(*location).data, size);
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_i8(nvs_handle_t handle, const char *key, int8_t value)
+{
+    return set_primitive(handle, key, TYPE_I8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_i64(nvs_handle_t handle, const char *key, int64_t value)
+{
+    return set_primitive(handle, key, TYPE_I64, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_i8(nvs_handle_t handle, const char *key, int8_t *out_value)
+{
+    return get_primitive(handle, key, TYPE_I8, out_value, sizeof(*out_value));
+}
+
+esp_err_t nvs_get_i64(nvs_handle_t handle, const char *key, int64_t *out_value)
+{
+    return get_primitive(handle, key, TYPE_I64, out_value, sizeof(*out_value));
+}
+
+//The header data of variable length items: size, reserved, CRC of the payload
+static void variable_header(uint8_t* data, const void* payload, size_t length)
+{
+    uint16_t size = length;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)payload, length);
+    memset(data, 0xFF, 8);
+    memcpy(data, &size, sizeof(size));
+    memcpy(data + 4, &crc, sizeof(crc));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, true, &ns);
+    if (ret != ESP_OK)
+        return ret;
+
+    size_t length = strlen(value) + 1;
+    const Location* old = find_item(ns, key, CHUNK_ANY);
+    if (old != NULL && old->type == TYPE_STR)
+    {
+        uint16_t old_length;
+        memcpy(&old_length, read_entry(*old).data, sizeof(old_length));
+        if (old_length == length && memcmp(payload_of(*old), value, length) == 0)
+        {
+            stats.skipped_writes++;
+            return ESP_OK;
+        }
+    }
+    uint8_t data[8];
+    variable_header(data, value, length);
+    return write_item(ns, TYPE_STR, key, CHUNK_ANY, data, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, false, &ns);
+    if (ret != ESP_OK)
+        return ret;
+    const Location* location = find_item(ns, key, CHUNK_ANY);
+    if (location == NULL || location->type != TYPE_STR)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    uint16_t size;
+    memcpy(&size, read_entry(*location).data, sizeof(size));
+    if (out_value == NULL)
+    {
+        *length = size;
+        return ESP_OK;
+    }
+    if (*length < size)
+    {
+        *length = size;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, payload_of(*location), size);
+    *length = size;
+    return ESP_OK;
+}
+
+/* A blob is a data chunk and an index entry. The new chunk uses the other half of the chunk index range,
+ * so the old version stays valid until the new index entry has been written.
+ */
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, true, &ns);
+    if (ret != ESP_OK)
+        return ret;
+
+    uint8_t chunk_start = 0;
+    const Location* old_index = find_item(ns, key, CHUNK_ANY);
+    Entry old_entry;
+    if (old_index != NULL && old_index->type == TYPE_BLOB_IDX)
+    {
+        old_entry = read_entry(*old_index);
+        uint32_t old_size;
+        memcpy(&old_size, old_entry.data, sizeof(old_size));
+        const Location* old_chunk = find_item(ns, key, old_entry.data[5]);
+        if (old_chunk != NULL && old_size == length && memcmp(payload_of(*old_chunk), value, length) == 0)
+        {
+            stats.skipped_writes++;
+            return ESP_OK;
+        }
+        chunk_start = old_entry.data[5] ^ VER_OFFSET;
+    }
+    else
+    {
+        old_index = NULL;
+    }
+
+    uint8_t data[8];
+    variable_header(data, value, length);
+    ret = write_item(ns, TYPE_BLOB_DATA, key, chunk_start, data, value, length);
+    if (ret != ESP_OK)
+        return ret;
+
+    uint32_t size = length;
+    memset(data, 0xFF, sizeof(data));
+    memcpy(data, &size, sizeof(size));
+    data[4] = 1;            //Chunk count
+    data[5] = chunk_start;
+    ret = write_item(ns, TYPE_BLOB_IDX, key, CHUNK_ANY, data, NULL, 0);
+    if (ret != ESP_OK)
+        return ret;
+
+    if (old_index != NULL)
+    {
+        uint8_t old_chunk_index = old_entry.data[5];
+        const Location* old_chunk = find_item(ns, key, old_chunk_index);
+        if (old_chunk != NULL)
+        {
+            erase_item(*old_chunk);
+            items.erase(Item_key((ns << 8) | old_chunk_index, key));
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    std::lock_guard<std::recursive_mutex> guard(emu_mutex);
+    uint8_t ns;
+    esp_err_t ret = get_handle(handle, false, &ns);
+    if (ret != ESP_OK)
+        return ret;
+    const Location* index = find_item(ns, key, CHUNK_ANY);
+    if (index == NULL || index->type != TYPE_BLOB_IDX)
+        return ESP_ERR_NVS_NOT_FOUND;
+    Entry index_entry = read_entry(*index);
+    const Location* chunk = find_item(ns, key, index_entry.data[5]);
+    if (chunk == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    uint32_t size;
+    memcpy(&size, index_entry.data, sizeof(size));
+    if (out_value == NULL)
+    {
+        *length = size;
+        return ESP_OK;
+    }
+    if (*length < size)
+    {
+        *length = size;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, payload_of(*chunk), size);
+    *length = size;
+    return ESP_OK;
+}
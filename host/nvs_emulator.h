@@ -0,0 +1,40 @@
+/* The host emulator of the NVS library. The partition is a file that has the same page/entry layout as
+ * the real NVS (4 KB pages of 126 32-byte entries, log-structured, with garbage collection into a spare page),
+ * so the number of flash writes and page erases of an access pattern can be counted without hardware.
+ * The flash timings are a model of a typical SPI NOR flash, they are not measured.
+ */
+#ifndef NVS_EMULATOR_H_
+#define NVS_EMULATOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//Typical values of the SPI NOR flash on ESP32 modules
+#define NVS_EMU_PROGRAM_OVERHEAD_US 30      //Fixed cost of a program operation
+#define NVS_EMU_PROGRAM_NS_PER_BYTE 1600    //~0.4 ms for a 256-byte flash page
+#define NVS_EMU_ERASE_US            45000   //4 KB sector erase
+#define NVS_EMU_ERASE_ENDURANCE     100000  //Erase cycles per sector
+
+struct Nvs_emu_stats
+{
+    uint64_t program_ops;
+    uint64_t bytes_programmed;
+    uint64_t entries_written;
+    uint64_t skipped_writes;        //Writes of a value identical to the stored one, NVS doesn't touch the flash
+    uint64_t page_erases;
+    uint64_t gc_runs;
+    uint64_t flash_time_us;         //Modeled time spent programming and erasing
+    std::vector<uint32_t> erases_per_page;
+    std::vector<uint32_t> commit_latency_us; //Modeled flash time of every nvs_commit, including the writes before it
+};
+
+//Must be called before nvs_flash_init(). The file is created (erased) if it doesn't exist or has a different size.
+void nvs_emu_configure(const char* path, size_t partition_size);
+void nvs_emu_reset_stats();
+Nvs_emu_stats nvs_emu_get_stats();
+
+//Reading the size of a partition from a partition table CSV (e.g. partitions_custom.csv), 0 if not found
+size_t nvs_emu_partition_size(const char* csv_path, const char* partition_name);
+
+#endif
@@ -0,0 +1,274 @@
+/* This module implements the replay server of replay_server.h with POSIX sockets, a thread per connection.
+ * The responses are read into memory at the start, a request costs a read of its head and a send.
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "esp_log.h"
+#include "replay_server.h"
+
+static const char *TAG = "REPLAY_SERVER";
+
+#define REPLAY_REQUEST_SIZE 4096
+
+struct Replay_response
+{
+    std::string name;
+    std::string data;
+    bool close;         //The connection is closed after the response
+};
+
+struct Replay_connection
+{
+    int fd;
+    std::thread thread;
+};
+
+static std::vector<Replay_response> responses;
+static std::atomic<uint64_t> request_count(0);
+static int listen_fd = -1;
+static std::thread accept_thread;
+static std::mutex connections_mutex;
+static std::vector<Replay_connection*> connections;
+
+static bool ends_with(const std::string &name, const char* suffix)
+{
+    size_t length = strlen(suffix);
+    return name.size() >= length && name.compare(name.size() - length, length, suffix) == 0;
+}
+
+static bool read_file(const std::string &path, std::string* data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == NULL)
+        return false;
+    char buf[4096];
+    size_t length;
+    while ((length = fread(buf, 1, sizeof(buf), file)) > 0)
+        data->append(buf, length);
+    fclose(file);
+    return true;
+}
+
+static bool load_responses(const char* directory)
+{
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+    {
+        ESP_LOGE(TAG, "Can't open %s", directory);
+        return false;
+    }
+    std::vector<std::string> names;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        std::string name = entry->d_name;
+        if (ends_with(name, ".http") || ends_with(name, ".json"))
+            names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    responses.clear();
+    for (const std::string &name : names)
+    {
+        Replay_response response;
+        std::string body;
+        response.name = name;
+        if (!read_file(std::string(directory) + "/" + name, &body))
+        {
+            ESP_LOGE(TAG, "Can't read %s", name.c_str());
+            continue;
+        }
+        if (ends_with(name, ".json"))
+        {
+            response.data = "HTTP/1.1 200 OK\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: "
+                            + std::to_string(body.size()) + "\r\n\r\n" + body;
+        }
+        else
+        {
+            response.data = body;
+        }
+        size_t head_end = response.data.find("\r\n\r\n");
+        std::string head = response.data.substr(0, head_end);
+        std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+        response.close = head_end == std::string::npos || head.find("\r\nconnection: close") != std::string::npos;
+        ESP_LOGI(TAG, "%s: %zu bytes", name.c_str(), response.data.size());
+        responses.push_back(response);
+    }
+    return !responses.empty();
+}
+
+static bool send_all(int fd, const char* data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t ret = send(fd, data, length, MSG_NOSIGNAL);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        data += ret;
+        length -= ret;
+    }
+    return true;
+}
+
+//Answering the requests of a connection until the client closes it, or a response closes it
+static void serve_connection(int fd)
+{
+    char buf[REPLAY_REQUEST_SIZE];
+    size_t length = 0;
+    while (true)
+    {
+        ssize_t ret = recv(fd, buf + length, sizeof(buf) - length, 0);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            break;
+        length += ret;
+
+        //Every complete request head gets the next response, the body of a request is not expected
+        char* head_end;
+        bool closed = false;
+        while (!closed && (head_end = (char*)memmem(buf, length, "\r\n\r\n", 4)) != NULL)
+        {
+            size_t head_length = head_end + 4 - buf;
+            const Replay_response &response = responses[request_count.fetch_add(1) % responses.size()];
+            closed = !send_all(fd, response.data.data(), response.data.size()) || response.close;
+            memmove(buf, buf + head_length, length - head_length);
+            length -= head_length;
+        }
+        if (closed || length == sizeof(buf))
+            break;
+    }
+    shutdown(fd, SHUT_RDWR);
+}
+
+static void accept_connections()
+{
+    while (true)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        //The connections that have ended are joined here, so a long run doesn't pile them up
+        for (size_t i = 0; i < connections.size();)
+        {
+            if (connections[i]->fd < 0)
+            {
+                connections[i]->thread.join();
+                delete connections[i];
+                connections[i] = connections.back();
+                connections.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+        Replay_connection* connection = new Replay_connection;
+        connection->fd = fd;
+        connection->thread = std::thread([connection]()
+        {
+            serve_connection(connection->fd);
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            close(connection->fd);
+            connection->fd = -1;
+        });
+        connections.push_back(connection);
+    }
+}
+
+uint16_t replay_server_start(const char* directory, const char* address, uint16_t port)
+{
+    if (!load_responses(directory))
+    {
+        ESP_LOGE(TAG, "No .http or .json responses in %s", directory);
+        return 0;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        ESP_LOGE(TAG, "Invalid address %s", address);
+        return 0;
+    }
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    socklen_t addr_length = sizeof(addr);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0
+        || getsockname(listen_fd, (struct sockaddr*)&addr, &addr_length) != 0)
+    {
+        ESP_LOGE(TAG, "Can't listen on %s:%u, errno %d", address, port, errno);
+        close(listen_fd);
+        listen_fd = -1;
+        return 0;
+    }
+    request_count = 0;
+    accept_thread = std::thread(accept_connections);
+    ESP_LOGI(TAG, "Serving %zu responses on %s:%u", responses.size(), address, ntohs(addr.sin_port));
+    return ntohs(addr.sin_port);
+}
+
+void replay_server_stop()
+{
+    if (listen_fd < 0)
+        return;
+    shutdown(listen_fd, SHUT_RDWR);
+    accept_thread.join();
+    close(listen_fd);
+    listen_fd = -1;
+
+    std::vector<Replay_connection*> ending;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        for (Replay_connection* connection : connections)
+        {
+            if (connection->fd >= 0)
+                shutdown(connection->fd, SHUT_RDWR);
+        }
+        ending.swap(connections);
+    }
+    for (Replay_connection* connection : ending)
+    {
+        connection->thread.join();
+        delete connection;
+    }
+}
+
+uint64_t replay_server_get_requests()
+{
+    return request_count.load();
+}
+
+size_t replay_server_get_max_response_size()
+{
+    size_t max_size = 0;
+    for (const Replay_response &response : responses)
+        max_size = std::max(max_size, response.data.size());
+    return max_size;
+}
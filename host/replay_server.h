@@ -0,0 +1,21 @@
+/* A local HTTP/1.1 server that answers every request with the next recorded response of a directory, in the order
+ * of the file names, starting over after the last one:
+ *  - a .http file is a whole recorded response, status line and headers included, sent as it is,
+ *  - a .json file is a body, sent with 200 OK and its Content-Length.
+ * The connections are kept alive unless the recorded response has "Connection: close".
+ */
+#ifndef REPLAY_SERVER_H_
+#define REPLAY_SERVER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Listening on the address ("127.0.0.1", or "0.0.0.0" for the devices of the network), port 0 picks a free one.
+//Returns the port, 0 if the directory has no responses or the socket can't be opened.
+uint16_t replay_server_start(const char* directory, const char* address, uint16_t port);
+void replay_server_stop();
+uint64_t replay_server_get_requests();
+//The size of the largest recorded response
+size_t replay_server_get_max_response_size();
+
+#endif
@@ -0,0 +1,22 @@
+/* The replay server as a program, for the firmware built with -DWEATHER_REPLAY_HOST=\"<address of this machine>\".
+ *   weather_replay_server [directory] [port]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "replay_server.h"
+
+int main(int argc, char** argv)
+{
+    const char* directory = argc > 1 ? argv[1] : REPLAY_DATA_DIR;
+    int port = argc > 2 ? atoi(argv[2]) : 8080;
+    if (port <= 0 || port > 65535)
+    {
+        fprintf(stderr, "usage: %s [directory] [port]\n", argv[0]);
+        return 1;
+    }
+    if (replay_server_start(directory, "0.0.0.0", (uint16_t)port) == 0)
+        return 1;
+    while (true)
+        pause();
+}
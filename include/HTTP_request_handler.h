@@ -1,7 +1,26 @@
 #ifndef HTTP_REQUEST_HANDLER_H_
 #define HTTP_REQUEST_HANDLER_H_
 
-//void openweathermap_api_call(void *pvParameters);
-void https_request_task(void *pvparameters);
+#include <stdbool.h>
+#include "esp_err.h"
 
-#endif
\ No newline at end of file
+#define WEATHER_COMMAND_QUEUE_DEPTH 4
+#define WEATHER_SERVICE_STACK_SIZE 8192
+#define WEATHER_SERVICE_PRIORITY 5
+#define WEATHER_SERVICE_MAX_WAIT_MS 3600000     //The longest single wait on the command queue, the next fetch may be a day later
+
+//The commands of the weather service, handled between two requests
+enum Weather_command
+{
+    WEATHER_RECONFIGURE,    //Reading the stored API-key and coordinates before the next request, and fetching at once
+    WEATHER_FETCH_NOW,      //Unless the call budget of the day is used up
+    WEATHER_PAUSE,          //No requests until WEATHER_RESUME, the connection is closed
+    WEATHER_RESUME
+};
+
+//Starting the weather service, which fetches the weather at once and then as the poll scheduler says
+esp_err_t weather_service_start();
+//Queueing a command without blocking. Returns false if the queue is full or the service isn't running.
+bool weather_service_send(Weather_command command);
+
+#endif
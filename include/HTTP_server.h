@@ -1,14 +1,17 @@
 #include <esp_event.h>
 #include <esp_https_server.h>
+#include "form_parser.h"
 
 #ifndef HTTP_SERVER_H_
 #define HTTP_SERVER_H_
 
-static httpd_handle_t server = NULL;
+//The running webserver, NULL while it is stopped. The Wi-Fi event handlers start and stop it.
+extern httpd_handle_t server;
 
-void config_web_page_buffer();
+void init_web_assets();
 void disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 void connect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
 httpd_handle_t start_webserver(void);
+void apply_mode_settings(const Form_fields* form);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef HTTP_WORKERS_H_
+#define HTTP_WORKERS_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+//The worker tasks and the connections of the webserver, both can be overridden with build flags (-DHTTP_WORKER_COUNT=3)
+#ifndef HTTP_WORKER_COUNT
+#define HTTP_WORKER_COUNT 2
+#endif
+#ifndef HTTP_MAX_OPEN_SOCKETS
+#define HTTP_MAX_OPEN_SOCKETS 7
+#endif
+#define HTTP_WORKER_MAX_COUNT 8
+#define HTTP_WORKER_STACK_SIZE 4096
+#define HTTP_WORKER_PRIORITY 5
+
+typedef void (*http_work_fn_t)(void* arg, void* context);
+
+//Starting the given number of worker tasks, 0 leaves every request on the httpd task. Does nothing if they are running.
+esp_err_t http_workers_start(int count);
+//Waiting for the running work to finish and deleting the workers
+void http_workers_stop();
+//Handing the work to an idle worker without blocking. Returns false if every worker is busy.
+bool http_workers_submit(http_work_fn_t work, void* arg, void* context);
+bool http_worker_is_current();
+
+#endif
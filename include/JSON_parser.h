@@ -1,9 +1,80 @@
-#include <string>
-using namespace std;
-
 #ifndef JSON_PARSER_H_
 #define JSON_PARSER_H_
 
-void parse_weather_json(string request_string);
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "weather_data.h"
+#include "http_response.h"
+#include "weather_forecast.h"
+
+#define WEATHER_PARSER_MAX_DEPTH        8       //Deeper documents are rejected, the One Call response has 4 levels
+#define WEATHER_PARSER_KEY_SIZE         16      //Longer keys are skipped, none of the extracted ones is
+#define WEATHER_PARSER_NUMBER_SIZE      32
+#define WEATHER_PARSER_MAX_ALERTS       4
+#define WEATHER_PARSER_DESCRIPTION_SIZE 384     //Longer alert descriptions are cut
+
+//The fields of the Openweathermap response that were found
+#define WEATHER_FIELD_TEMP              (1u << 0)
+#define WEATHER_FIELD_PRESSURE          (1u << 1)
+#define WEATHER_FIELD_HUMIDITY          (1u << 2)
+#define WEATHER_FIELD_WIND_SPEED        (1u << 3)
+#define WEATHER_FIELD_WIND_DEG          (1u << 4)
+#define WEATHER_FIELD_TIMEZONE_OFFSET   (1u << 5)
+#define WEATHER_FIELD_WEATHER           (1u << 6)   //The "weather" array of "current"
+#define WEATHER_FIELD_ALERTS            (1u << 7)
+#define WEATHER_FIELD_HOURLY            (1u << 8)
+#define WEATHER_FIELD_DAILY             (1u << 9)
+
+//The values Weather_data needs from one response
+struct Weather_report
+{
+    uint32_t fields;
+    float temp, wind_speed;
+    int pressure, humidity, wind_deg, timezone_offset;
+    int weather_ids[WEATHER_SNAPSHOT_MAX_IDS];
+    int weather_id_count;
+    int alert_count;        //Only the first WEATHER_PARSER_MAX_ALERTS alerts are kept
+    char alert_events[WEATHER_PARSER_MAX_ALERTS][WEATHER_SNAPSHOT_EVENT_SIZE];
+    char alert_descriptions[WEATHER_PARSER_MAX_ALERTS][WEATHER_PARSER_DESCRIPTION_SIZE];
+    Weather_forecast forecast;
+};
+
+/* Parsing the HTTP response of the One Call API while it is received, chunk by chunk.
+ * The head and the framing are read by http_response.cpp, then the JSON body of a 2xx response is tokenized
+ * without building a tree. Only the values of the report are kept, so the memory used doesn't depend on the size
+ * of the response. The body of an error is never parsed.
+ */
+struct Weather_parser
+{
+    Http_response http;
+    uint8_t state;
+    uint8_t string_state;
+    bool failed;                                    //The response or its JSON body is invalid
+    bool is_key;
+    int depth;
+    uint8_t contexts[WEATHER_PARSER_MAX_DEPTH];     //What the containers on the path are
+    char key[WEATHER_PARSER_KEY_SIZE];
+    size_t key_length;
+    char number[WEATHER_PARSER_NUMBER_SIZE];
+    size_t number_length;
+    char* string;                                   //Where the current string value is copied, NULL if it is skipped
+    size_t string_size;
+    size_t string_length;
+    uint32_t unicode;
+    int unicode_digits;
+    int forecast_slot;                              //The slot of the current hourly or daily entry, -1 before its "dt"
+    Weather_report report;
+};
+
+void weather_parser_init(Weather_parser* parser);
+//Returns false once the response turned out to be invalid, the rest of it can be dropped
+bool weather_parser_feed(Weather_parser* parser, const char* data, size_t length);
+//True once the whole body has been received, as given by Content-Length or the chunked encoding
+bool weather_parser_is_complete(const Weather_parser* parser);
+//True if the status was 2xx and the whole JSON document has been parsed
+bool weather_parser_finish(Weather_parser* parser);
+//Copying the report into Weather at once. The Date of the response, if any, dates the data while the clock isn't set.
+void apply_weather_report(const Weather_report* report, int64_t server_date);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,22 @@
+#ifndef WS_TELEMETRY_H_
+#define WS_TELEMETRY_H_
+
+#include <stdint.h>
+#include <esp_http_server.h>
+
+//The sections of a telemetry message, a change marks the section that has to be pushed again
+#define TELEMETRY_ROOM      (1u << 0)   //Measurements and settings of Room_data
+#define TELEMETRY_WEATHER   (1u << 1)   //The latest Openweathermap data
+#define TELEMETRY_ACTUATOR  (1u << 2)   //The angle commanded to the window opener
+#define TELEMETRY_ALL       (TELEMETRY_ROOM | TELEMETRY_WEATHER | TELEMETRY_ACTUATOR)
+
+//Can be called from any task, it only sets bits and wakes up the push task
+void telemetry_notify(uint32_t changes);
+
+esp_err_t ws_telemetry_register(httpd_handle_t server);
+//The close_fn of the httpd configuration, it forgets the client and closes the socket
+void ws_telemetry_close_fn(httpd_handle_t server, int sockfd);
+//Forgetting every client when the server is stopped
+void ws_telemetry_stop();
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef FORM_PARSER_H_
+#define FORM_PARSER_H_
+
+#include <stddef.h>
+
+#define FORM_MAX_FIELDS 8
+
+//A key-value pair of an application/x-www-form-urlencoded body. Both point into the parsed buffer and are zero terminated.
+struct Form_field
+{
+    const char* key;
+    size_t key_length;
+    const char* value;
+    size_t value_length;
+};
+
+struct Form_fields
+{
+    Form_field fields[FORM_MAX_FIELDS];
+    int count;
+};
+
+/* Tokenizing a form body in a single pass. The separators are replaced by zeros and the percent-escapes
+ * and '+' characters are decoded in place, so no memory is allocated and the views stay valid as long as the buffer does.
+ * The buffer must have room for a terminating zero after length bytes.
+ * Returns the number of fields, or -1 if the body has more than FORM_MAX_FIELDS fields.
+ */
+int form_parse(char* body, size_t length, Form_fields* form);
+
+/* Parsing a flat JSON object ({"key": value, ...}) into the same table, so the handlers accept JSON bodies as well.
+ * Strings are unescaped in place, numbers, true and false are returned as their text. A key with a null value is left out.
+ * Returns the number of fields, or -1 if the body is not a flat object or has more than FORM_MAX_FIELDS fields.
+ */
+int form_parse_json(char* body, size_t length, Form_fields* form);
+
+//The value of a key, NULL if the form doesn't have it
+const char* form_get(const Form_fields* form, const char* key);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef HTTP_RESPONSE_H_
+#define HTTP_RESPONSE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HTTP_RESPONSE_LINE_SIZE         64      //The kept start of a header line
+#define HTTP_RESPONSE_MAX_ERROR_BODY    2048    //A longer body of an error isn't read, the connection is closed instead
+
+/* Reading the head and the framing of an HTTP/1.x response while it is received, chunk by chunk.
+ * The status is known before any of the body is read: the body of a 2xx response is handed to the caller,
+ * the body of an error is only read to its end, so the connection can be kept open, and never handed over.
+ * The end of the body is given by Content-Length or the chunked encoding, or by the server closing the connection.
+ */
+struct Http_response
+{
+    uint8_t state;
+    uint8_t body_state;
+    bool failed;                            //The response is invalid, the connection can't be used any more
+    bool keep_alive;                        //The server keeps the connection open after the response
+    int status;                             //0 until the status line has been received
+    int64_t date;                           //The Date header as Unix time, 0 if there was none
+    uint32_t retry_after_s;                 //The Retry-After header of a 429 or 503, 0 if there was none
+    int64_t retry_after_date;               //Retry-After as a date, converted to seconds at the end of the head
+    size_t body_remaining;                  //The rest of the Content-Length or of the current chunk
+    size_t error_body_length;
+    char line[HTTP_RESPONSE_LINE_SIZE];     //The current line of the head, or the size line of a chunk
+    size_t line_length;
+};
+
+void http_response_init(Http_response* response);
+/* Reading the response up to the next piece of the body. Returns the bytes used from data, *body and *body_length
+ * point to the piece of the body among them (*body_length is 0 if there was none). The caller calls it again
+ * with the rest of the data, until it is used up, response->failed is set or the response is complete.
+ */
+size_t http_response_feed(Http_response* response, const char* data, size_t length, const char** body, size_t* body_length);
+//True once the status is 2xx, the body is the expected document
+bool http_response_is_success(const Http_response* response);
+//True once the whole body has been received, as given by Content-Length or the chunked encoding
+bool http_response_is_complete(const Http_response* response);
+//Whether the connection can be used for the next request after the response
+bool http_response_can_reuse(const Http_response* response);
+//Parsing an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") into Unix time. Returns 0 if it isn't one.
+int64_t http_parse_date(const char* text);
+
+#endif
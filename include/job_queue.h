@@ -0,0 +1,50 @@
+#ifndef JOB_QUEUE_H_
+#define JOB_QUEUE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define JOB_QUEUE_DEPTH 4
+#define JOB_HISTORY_SIZE 8      //The statuses of the latest jobs, more than the queue can hold
+#define JOB_TASK_STACK_SIZE 4096
+#define JOB_TASK_PRIORITY 4
+
+//The slow side effects of a configuration change. They read the new settings from the stored configuration.
+enum Job_type
+{
+    JOB_WIFI_RESTART,           //Reconnecting with the stored Wi-Fi credentials
+    JOB_WEATHER_RECONFIGURE     //Making the weather service use the stored API-key and coordinates
+};
+
+enum Job_state
+{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED
+};
+
+struct Job_status
+{
+    uint32_t id;                //0 if the slot is unused
+    Job_type type;
+    Job_state state;
+    esp_err_t result;
+    int64_t queued_us;
+    int64_t started_us;
+    int64_t finished_us;
+};
+
+esp_err_t job_queue_init();
+/* Queueing a job without blocking. A job of the same type that hasn't started yet is not queued again,
+ * its id is returned instead: it will see the newest settings anyway. Returns 0 if the queue is full.
+ */
+uint32_t job_submit(Job_type type);
+//Returns false if the job is unknown or too old to be remembered
+bool job_get_status(uint32_t id, Job_status* status);
+//Copying the remembered jobs, the newest first. Returns their number.
+int job_get_recent(Job_status* statuses, int max_count);
+const char* job_type_name(Job_type type);
+const char* job_state_name(Job_state state);
+
+#endif
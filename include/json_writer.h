@@ -0,0 +1,39 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define JSON_WRITER_MAX_DEPTH 8
+
+/* Writing a JSON document into a fixed buffer, without any allocation.
+ * The key parameter is ignored inside arrays and must be NULL for the root.
+ * If the buffer is too small the writer stops writing and json_finish() returns -1.
+ */
+struct Json_writer
+{
+    char* buffer;
+    size_t size;
+    size_t length;
+    int depth;
+    uint32_t has_items;     //One bit per nesting level, set after the first item of the level
+    bool overflow;
+};
+
+void json_init(Json_writer* writer, char* buffer, size_t size);
+void json_object_begin(Json_writer* writer, const char* key);
+void json_object_end(Json_writer* writer);
+void json_array_begin(Json_writer* writer, const char* key);
+void json_array_end(Json_writer* writer);
+void json_int(Json_writer* writer, const char* key, int32_t value);
+void json_uint(Json_writer* writer, const char* key, uint32_t value);
+void json_float(Json_writer* writer, const char* key, float value, int decimals);
+void json_bool(Json_writer* writer, const char* key, bool value);
+void json_string(Json_writer* writer, const char* key, const char* value);
+void json_null(Json_writer* writer, const char* key);
+
+//The length of the document, -1 if it didn't fit. The document is zero terminated either way.
+int json_finish(Json_writer* writer);
+
+#endif
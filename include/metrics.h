@@ -0,0 +1,136 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define METRICS_MAX_BUCKETS 12
+#define METRICS_RENDER_CHUNK 512
+
+//The histogram buckets in microseconds: the HTTP handlers and the NVS commits, and the requests to remote servers
+extern const uint32_t METRICS_BUCKETS_FAST_US[];
+extern const size_t METRICS_BUCKETS_FAST_COUNT;
+extern const uint32_t METRICS_BUCKETS_SLOW_US[];
+extern const size_t METRICS_BUCKETS_SLOW_COUNT;
+
+enum Metric_type
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+};
+
+/* A metric registers itself when it is constructed, so the metrics are defined at namespace scope
+ * and the registry is complete before app_main. Metrics of the same name differ in their labels,
+ * which are written as they are, e.g. uri="/api/v1/status". Updating a metric takes no lock but a spinlock
+ * for the histograms, so it can be done on any hot path.
+ */
+class Metric
+{
+    public:
+
+    const Metric_type type;
+    const char* const name;
+    const char* const help;
+    const char* const labels;   //NULL without labels
+    Metric* next;
+
+    Metric(Metric_type type, const char* name, const char* help, const char* labels);
+};
+
+class Metric_counter : public Metric
+{
+    private:
+
+    uint32_t value;
+
+    public:
+
+    Metric_counter(const char* name, const char* help, const char* labels = NULL);
+    void add(uint32_t amount = 1)
+    {
+        __atomic_fetch_add(&value, amount, __ATOMIC_RELAXED);
+    }
+    uint32_t get() const
+    {
+        return __atomic_load_n(&value, __ATOMIC_RELAXED);
+    }
+};
+
+class Metric_gauge : public Metric
+{
+    private:
+
+    volatile float value;
+
+    public:
+
+    Metric_gauge(const char* name, const char* help, const char* labels = NULL);
+    void set(float value)
+    {
+        this -> value = value;
+    }
+    float get() const
+    {
+        return value;
+    }
+};
+
+//The counts of the buckets are not cumulative here, the rendering adds them up
+struct Histogram_snapshot
+{
+    uint32_t counts[METRICS_MAX_BUCKETS + 1];
+    uint64_t sum_us;
+    uint32_t count;
+};
+
+class Metric_histogram : public Metric
+{
+    private:
+
+    const uint32_t* bounds_us;
+    size_t bound_count;
+    uint32_t counts[METRICS_MAX_BUCKETS + 1];   //The last one is +Inf
+    uint64_t sum_us;
+    uint32_t count;
+    portMUX_TYPE lock;
+
+    public:
+
+    Metric_histogram(const char* name, const char* help, const char* labels, const uint32_t* bounds_us, size_t bound_count);
+    void observe_us(uint32_t duration_us);
+    Histogram_snapshot get_snapshot();
+    const uint32_t* get_bounds_us() const
+    {
+        return bounds_us;
+    }
+    size_t get_bound_count() const
+    {
+        return bound_count;
+    }
+};
+
+//Observing the time until the end of the scope
+class Metric_timer
+{
+    private:
+
+    Metric_histogram* histogram;
+    int64_t start_us;
+
+    public:
+
+    explicit Metric_timer(Metric_histogram* histogram);
+    ~Metric_timer();
+};
+
+//Returns false to stop the rendering
+typedef bool (*metrics_write_fn_t)(void* ctx, const char* data, size_t length);
+
+//Writing every metric in the Prometheus text format, in pieces of at most METRICS_RENDER_CHUNK bytes
+bool metrics_render(metrics_write_fn_t write, void* ctx);
+
+#endif
@@ -2,5 +2,6 @@
 #define MOTOR_CONTROL_H_
 
 void motor_control_task(void *params);
+int motor_get_commanded_angle();
 
 #endif
\ No newline at end of file
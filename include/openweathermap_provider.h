@@ -0,0 +1,64 @@
+#ifndef OPENWEATHERMAP_PROVIDER_H_
+#define OPENWEATHERMAP_PROVIDER_H_
+
+#include "JSON_parser.h"
+#include "weather_provider.h"
+
+#define OPENWEATHERMAP_HOST "api.openweathermap.org"
+#define OPENWEATHERMAP_PORT "443"
+//The default query, e.g. -DOPENWEATHERMAP_LANG=\"hu\" for the alert descriptions in Hungarian
+#ifndef OPENWEATHERMAP_UNITS
+#define OPENWEATHERMAP_UNITS "metric"
+#endif
+#ifndef OPENWEATHERMAP_EXCLUDE
+#define OPENWEATHERMAP_EXCLUDE "minutely"      //The hourly and the daily forecast are stored by weather_forecast
+#endif
+#ifndef OPENWEATHERMAP_LANG
+#define OPENWEATHERMAP_LANG "en"
+#endif
+//The port of the replay server, -DWEATHER_REPLAY_HOST=\"192.168.1.10\" selects the replay provider
+#ifndef WEATHER_REPLAY_PORT
+#define WEATHER_REPLAY_PORT "8080"
+#endif
+
+//The One Call API 2.5 of Openweathermap, over TLS
+class Openweathermap_provider : public Weather_provider
+{
+    private:
+
+    Weather_parser parser;
+
+    public:
+
+    const char* get_name() const override;
+    const char* get_host() const override;
+    const char* get_port() const override;
+    bool uses_tls() const override;
+    size_t build_request(char* buf, size_t size, const Weather_query* query) const override;
+    void begin_response() override;
+    bool feed_response(const char* data, size_t length) override;
+    bool is_response_complete() const override;
+    bool finish_response() override;
+    Weather_response get_response() const override;
+};
+
+/* Recorded One Call responses, served over plain HTTP by the replay server of the host build (host/replay_server.cpp).
+ * For testing without the internet and without spending the calls of the API-key.
+ */
+class Replay_provider : public Openweathermap_provider
+{
+    private:
+
+    const char* host;
+    const char* port;
+
+    public:
+
+    Replay_provider(const char* host, const char* port);
+    const char* get_name() const override;
+    const char* get_host() const override;
+    const char* get_port() const override;
+    bool uses_tls() const override;
+};
+
+#endif
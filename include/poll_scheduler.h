@@ -0,0 +1,59 @@
+#ifndef POLL_SCHEDULER_H_
+#define POLL_SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//The API calls a device may make per day, the quota of the account divided among the devices (-DWEATHER_DAILY_CALL_BUDGET=100)
+#ifndef WEATHER_DAILY_CALL_BUDGET
+#define WEATHER_DAILY_CALL_BUDGET 200
+#endif
+#define POLL_INTERVAL_MS            600000      //The weather is calm
+#define POLL_FAST_INTERVAL_MS       180000      //An alert is active or the weather changes quickly
+#define POLL_JITTER_PERCENT         10          //Keeps a fleet that started together from polling together
+#define POLL_BACKOFF_BASE_MS        30000       //The first retry after a failure
+#define POLL_BACKOFF_MAX_MS         POLL_INTERVAL_MS    //A retry never waits longer than a normal poll
+#define POLL_RETRY_AFTER_MAX_MS     86400000    //A longer Retry-After is cut, a day later the budget is renewed anyway
+#define POLL_FAST_TEMP_DELTA        2.0f        //Between two polls, in °C
+#define POLL_FAST_PRESSURE_DELTA    3           //Between two polls, in hPa
+#define POLL_DAY_US                 (24LL * 3600 * 1000000)
+
+enum Poll_result
+{
+    POLL_SUCCESS,
+    POLL_FAILED,            //Connection, TLS, or an HTTP error other than 429
+    POLL_RATE_LIMITED       //429 Too Many Requests, or a 503 with Retry-After
+};
+
+struct Poll_outcome
+{
+    Poll_result result;
+    uint32_t retry_after_ms;    //The Retry-After of the response, 0 if the server didn't send one
+    bool alert_active;
+    float temp;
+    int pressure;
+};
+
+/* Deciding when the weather is requested next.
+ *  - after a success: the normal or the fast interval, with jitter,
+ *  - after a failure: exponential backoff with jitter, at least the Retry-After of a 429,
+ *  - the calls of the day are counted, and once the spare calls are used up the rest of the budget is spread evenly
+ *    over the rest of the day. The budget is never exceeded, not even by the fast polls or the retries.
+ */
+struct Poll_scheduler
+{
+    uint32_t consecutive_failures;
+    uint32_t calls_today;
+    int64_t day_start_us;
+    bool has_previous;
+    float previous_temp;
+    int previous_pressure;
+};
+
+void poll_scheduler_init(Poll_scheduler* scheduler, int64_t now_us);
+//Counting the call that ended with the outcome, and returning the delay until the next one
+uint32_t poll_scheduler_next_delay(Poll_scheduler* scheduler, const Poll_outcome* outcome, int64_t now_us);
+//Whether an extra call now, e.g. one asked for by the user, still fits into the budget of the day
+bool poll_scheduler_can_call(const Poll_scheduler* scheduler, int64_t now_us);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef REQUEST_WRITER_H_
+#define REQUEST_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define REQUEST_WRITER_MAX_DECIMALS 6
+
+/* Writing an HTTP request into a fixed buffer, without any allocation or formatting of floats.
+ * The query parameters are appended to the path with '?' or '&', their values are percent-encoded.
+ * If the buffer is too small the writer stops writing and request_finish() returns -1.
+ */
+struct Request_writer
+{
+    char* buffer;
+    size_t size;
+    size_t length;
+    bool has_query;
+    bool overflow;
+};
+
+void request_init(Request_writer* writer, char* buffer, size_t size);
+//The request line up to the end of the path, e.g. request_begin(&writer, "GET", "/data/2.5/onecall")
+void request_begin(Request_writer* writer, const char* method, const char* path);
+void request_query(Request_writer* writer, const char* key, const char* value);
+//A fixed point number with the given decimals, rounded to the nearest, e.g. 47.4979 for 47.49794f and 4 decimals
+void request_query_fixed(Request_writer* writer, const char* key, float value, int decimals);
+//Ending the request line, with the version
+void request_end_line(Request_writer* writer);
+void request_header(Request_writer* writer, const char* name, const char* value);
+
+//Ending the headers. Returns the length of the request, -1 if it didn't fit. The request is zero terminated either way.
+int request_finish(Request_writer* writer);
+
+#endif
@@ -1,10 +1,26 @@
 #ifndef ROOM_DATA_H_
 #define ROOM_DATA_H_
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+//A copy of every field of Room_data, taken at the same moment
+struct Room_snapshot
+{
+    float internal_temperature;
+    float internal_humidity;
+    float gas_resistance;
+    float window_deg;
+    int desired_temperature;
+    bool is_auto;
+};
+
 class Room_data
 {
     private:
 
+    SemaphoreHandle_t mutex;
+
     float internal_temperature;
     float internal_humidity;
     float gas_resistance;
@@ -16,8 +32,10 @@ class Room_data
 
     Room_data()
     {
+        mutex = xSemaphoreCreateMutex();
         internal_temperature = 0;
         internal_humidity = 0;
+        gas_resistance = 0;
         window_deg = 0;
         desired_temperature = 20;
         is_auto = true;
@@ -29,6 +47,8 @@ class Room_data
     void set_window_deg(float window_deg);
     void set_desired_temperature(int desired_temperature);
     void set_is_auto(bool is_auto);
+    //The results of a sensor measurement are updated together
+    void set_measurement(float internal_temperature, float internal_humidity, float gas_resistance);
 
     float get_internal_temperature();
     float get_internal_humidity();
@@ -36,6 +56,7 @@ class Room_data
     float get_window_deg();
     int get_desired_temperature();
     bool get_is_auto();
+    Room_snapshot get_snapshot();
 };
 
 
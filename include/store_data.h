@@ -1,6 +1,79 @@
 #ifndef STORE_DATA_H_
 #define STORE_DATA_H_
 
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+//How long the setters have to be quiet before the dirty keys are committed to the flash
+#ifndef NVS_PERSIST_QUIET_MS
+#define NVS_PERSIST_QUIET_MS 2000
+#endif
+//A continuous stream of updates is committed after at most this many quiet periods
+#ifndef NVS_PERSIST_MAX_DEFER
+#define NVS_PERSIST_MAX_DEFER 10
+#endif
+//After a failed commit the dirty keys are retried after this delay, doubled on every further failure up to the maximum
+#ifndef NVS_PERSIST_RETRY_MS
+#define NVS_PERSIST_RETRY_MS 1000
+#endif
+#ifndef NVS_PERSIST_RETRY_MAX_MS
+#define NVS_PERSIST_RETRY_MAX_MS 60000
+#endif
+
+//Buffer sizes of the string keys, including the terminating zero
+#define NVS_SSID_SIZE 33
+#define NVS_PASS_SIZE 65
+#define NVS_APIKEY_SIZE 65
+#define NVS_TZ_SIZE 64
+
+//The typed in-RAM copy of the "storage" namespace. Every read is served from here.
+struct Stored_config
+{
+    char ssid[NVS_SSID_SIZE];
+    char pass[NVS_PASS_SIZE];
+    char apikey[NVS_APIKEY_SIZE];
+    char tz[NVS_TZ_SIZE];
+    bool op_mode;
+    float window_deg;
+    int desired_temp;
+    float lat;
+    float lon;
+};
+
+/* Staging several keys that belong together (e.g. ssid and password, latitude and longitude).
+ * commit() applies them to the RAM copy at once and rewrites the configuration record with a single nvs_set_blob
+ * (the control entry of the mode, window and temperature with a single nvs_set_i64), so a power cut leaves either
+ * the old or the new values. The optional parameter returns the commit latency.
+ */
+class Config_transaction
+{
+    private:
+
+    Stored_config staged;
+    uint32_t keys;
+
+    public:
+
+    Config_transaction();
+
+    void set_wifi_ssid(const char* ssid);
+    void set_wifi_pass(const char* pass);
+    void set_apikey(const char* apikey);
+    void set_timezone(const char* tz);
+    void set_operation_mode(bool op_mode);
+    void set_window_deg(float window_deg);
+    void set_desired_temp(int desired_temp);
+    void set_latitude(float lat);
+    void set_longitude(float lon);
+
+    esp_err_t commit(int64_t* latency_us = NULL);
+};
+
+esp_err_t nvs_config_init();
+esp_err_t nvs_config_flush();
+void nvs_config_set_quiet_period(uint32_t quiet_ms);
+
 void nvs_write_wifi_ssid(const char* ssid);
 void nvs_write_wifi_pass(const char* pass);
 void nvs_write_apikey(const char* apikey);
@@ -11,14 +84,21 @@ void nvs_write_latitude(float lat);
 void nvs_write_longitude(float lon);
 void nvs_write_timezone(const char* tz);
 
-const char* nvs_read_wifi_ssid();
-const char* nvs_read_wifi_pass();
-const char* nvs_read_apikey();
+//The string readers copy into a buffer owned by the caller, they never allocate.
+esp_err_t nvs_read_wifi_ssid(char* ssid, size_t size);
+esp_err_t nvs_read_wifi_pass(char* pass, size_t size);
+esp_err_t nvs_read_apikey(char* apikey, size_t size);
+esp_err_t nvs_read_timezone(char* tz, size_t size);
+void nvs_read_config(Stored_config* out);
 bool nvs_read_operation_mode();
 float nvs_read_window_deg();
 int nvs_read_desired_temp();
 float nvs_read_latitude();
 float nvs_read_longitude();
-const char* nvs_read_timezone();
 
-#endif
\ No newline at end of file
+//A blob of another module in the same namespace, e.g. the weather cache. The key must not be one of the configuration.
+esp_err_t nvs_write_blob(const char* key, const void* data, size_t size);
+//*size is the size of the buffer, and the size of the blob on return
+esp_err_t nvs_read_blob(const char* key, void* data, size_t* size);
+
+#endif
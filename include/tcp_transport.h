@@ -0,0 +1,24 @@
+#ifndef TCP_TRANSPORT_H_
+#define TCP_TRANSPORT_H_
+
+#include "weather_transport.h"
+
+//A plain TCP connection, for a weather server on the local network like the replay server of the host build
+class Tcp_transport : public Weather_transport
+{
+    private:
+
+    int sock = -1;
+    uint32_t read_timeout_ms;
+
+    public:
+
+    Tcp_transport(uint32_t read_timeout_ms);
+    int connect(const char* host, const char* port) override;
+    int write(const char* data, size_t length) override;
+    int read(char* buf, size_t size) override;
+    bool is_usable() override;
+    void disconnect() override;
+};
+
+#endif
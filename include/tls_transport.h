@@ -0,0 +1,43 @@
+#ifndef TLS_TRANSPORT_H_
+#define TLS_TRANSPORT_H_
+
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "weather_transport.h"
+
+/* Mbed-TLS over a TCP connection, with the certificate bundle. The session of the last handshake is offered
+ * at the next connection: if the server still knows it (by its session ticket or ID), the handshake is resumed
+ * without the certificate chain and the key exchange.
+ */
+class Tls_transport : public Weather_transport
+{
+    private:
+
+    bool set_up = false;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_context ssl;
+    mbedtls_x509_crt cacert;
+    mbedtls_ssl_config conf;
+    mbedtls_net_context server_fd;
+    mbedtls_ssl_session saved_session;
+    bool has_saved_session = false;
+
+    void forget_saved_session();
+    bool is_resumed_session(const mbedtls_ssl_session* session) const;
+    void save_session(uint32_t handshake_us);
+
+    public:
+
+    //Seeding the random number generator and configuring TLS, once. Aborts if it fails, there is no weather without it.
+    void setup(uint32_t read_timeout_ms);
+    int connect(const char* host, const char* port) override;
+    int write(const char* data, size_t length) override;
+    int read(char* buf, size_t size) override;
+    bool is_usable() override;
+    void disconnect() override;
+};
+
+#endif
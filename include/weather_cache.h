@@ -0,0 +1,21 @@
+#ifndef WEATHER_CACHE_H_
+#define WEATHER_CACHE_H_
+
+#include "esp_err.h"
+
+//The cached copy is rewritten after a fetch once it is this old, even if the weather hasn't changed (-DWEATHER_CACHE_REFRESH_S=900)
+#ifndef WEATHER_CACHE_REFRESH_S
+#define WEATHER_CACHE_REFRESH_S 1800
+#endif
+#define WEATHER_CACHE_TEMP_DELTA 0.5f      //A smaller change of the temperature doesn't rewrite the cached copy
+
+/* The last successfully fetched weather is kept in the NVS with its fetch time, so Weather isn't empty after a reboot
+ * until the first fetch succeeds. It is loaded with its age unknown (WEATHER_UNVERIFIED) until SNTP sets the clock.
+ * To spare the flash, it is rewritten only if the weather has changed noticeably or the copy is WEATHER_CACHE_REFRESH_S old.
+ */
+//Loading the cached weather into Weather. Called at boot after the configuration, before the tasks that read Weather.
+esp_err_t weather_cache_load();
+//Storing Weather after a successful fetch if it is worth a flash write
+esp_err_t weather_cache_save();
+
+#endif
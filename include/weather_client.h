@@ -0,0 +1,13 @@
+#ifndef WEATHER_CLIENT_H_
+#define WEATHER_CLIENT_H_
+
+#include "weather_transport.h"
+#include "weather_provider.h"
+
+/* One request to the provider, on the connection of the previous one if it is still open. Returns 0 if a response
+ * was received, *parsed tells if it was mapped into Weather. Returns the error of the transport otherwise.
+ */
+int weather_client_fetch(Weather_transport* transport, Weather_provider* provider, const char* request, size_t request_length,
+                         bool* parsed);
+
+#endif
@@ -5,15 +5,63 @@ using namespace std;
 #ifndef _WEATHER_DATA_H
 #define _WEATHER_DATA_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "weather_forecast.h"
+
+#define WEATHER_SNAPSHOT_MAX_IDS 4
+#define WEATHER_SNAPSHOT_MAX_ALERTS 2
+#define WEATHER_SNAPSHOT_EVENT_SIZE 48
+
+//The weather is stale after this age, and too old to be used at all after the second one (-DWEATHER_STALE_AGE_S=3600)
+#ifndef WEATHER_STALE_AGE_S
+#define WEATHER_STALE_AGE_S 7200
+#endif
+#ifndef WEATHER_EXPIRED_AGE_S
+#define WEATHER_EXPIRED_AGE_S 86400
+#endif
+#define WEATHER_CLOCK_VALID_S 1451606400        //2016-01-01, an earlier clock hasn't been set by SNTP yet
+
+enum Weather_freshness
+{
+    WEATHER_MISSING,        //Nothing has been received, or it has expired
+    WEATHER_FRESH,
+    WEATHER_UNVERIFIED,     //Loaded from the cache at boot, its age is unknown until the clock is set
+    WEATHER_STALE
+};
+
+//A copy of the weather data taken at the same moment. The vectors are copied into fixed arrays, so it doesn't allocate.
+struct Weather_snapshot
+{
+    int pressure, humidity, wind_deg, timezone_offset;
+    float temp, wind_speed, lat, lon;
+    int weather_ids[WEATHER_SNAPSHOT_MAX_IDS];
+    int weather_id_count;
+    int alert_count;        //All alerts, even if only the first WEATHER_SNAPSHOT_MAX_ALERTS events are copied
+    char alert_events[WEATHER_SNAPSHOT_MAX_ALERTS][WEATHER_SNAPSHOT_EVENT_SIZE];
+    Weather_freshness freshness;
+    int32_t age_s;          //-1 if it is unknown
+    int64_t updated_at;     //Unix time of the fetch, 0 if the clock wasn't set at the time
+};
+
 class Weather_data
 {
     private:
 
+    SemaphoreHandle_t mutex;
+
     int  pressure, humidity, wind_deg, timezone_offset;
     float temp, wind_speed, lat, lon;
     vector<string> alert_events, alert_descriptions;
     vector<int> weather_ids; 
-    
+    bool has_data;
+    int64_t updated_at;     //Unix time of the fetch, 0 if the clock wasn't set at the time
+    int64_t fetched_us;     //esp_timer time of the fetch, -1 if the data was loaded from the cache
+    Weather_forecast forecast;
+
+    int32_t calculate_age_s();
+    Weather_freshness calculate_freshness();
+
     public:
     Weather_data();
 
@@ -40,7 +88,24 @@ class Weather_data
     vector<int> get_weather_id();
     vector<string> get_alert_event();
     vector<string> get_alert_description();
+    //The forecast is replaced as a whole by the writer that holds the lock
+    void set_forecast(const Weather_forecast* forecast);
+    //Copying the forecast, without the entries that are over once the clock is set
+    void get_forecast(Weather_forecast* forecast);
+
+    //Called by the writer that holds the lock: the data was fetched now (with the Date of the response, 0 if none),
+    //or loaded from the cache with its fetch time
+    void set_fetched(int64_t server_date);
+    void set_cached(int64_t updated_at);
+    int64_t get_updated_at();
+    Weather_freshness get_freshness();
+
+    //Held by the writer while it updates several fields that belong to the same API response
+    void lock();
+    void unlock();
+    Weather_snapshot get_snapshot();
 };
 void list_vector(vector<int> vec);
+const char* weather_freshness_name(Weather_freshness freshness);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef WEATHER_FORECAST_H_
+#define WEATHER_FORECAST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define FORECAST_HOURS           48      //The hourly forecast of the One Call API
+#define FORECAST_DAYS            8       //Today and the next 7 days
+#define FORECAST_HOUR_S          3600
+#define FORECAST_DAY_S           86400
+#define FORECAST_DAY_TOLERANCE_S 3600    //The daily entries are at local noon, a change of DST makes a day 23 or 25 hours long
+#define FORECAST_TEMP_SCALE      100     //The temperatures are stored in 0.01 °C
+#define FORECAST_WIND_SCALE      100     //The wind speeds are stored in 0.01 m/s
+
+/* The entries of a forecast are kept in a ring: the entry of index 0 is the one of start, the next ones follow it
+ * every step_s seconds, give or take tolerance_s. The entries that are over are dropped by moving head,
+ * without moving the arrays.
+ */
+struct Forecast_ring
+{
+    int64_t start;          //Unix time of the first entry
+    int64_t last;           //Unix time of the last entry, the next one is expected a step later
+    uint32_t step_s;
+    uint32_t tolerance_s;
+    uint16_t capacity;
+    uint16_t head;          //The slot of the first entry
+    uint16_t count;
+};
+
+//The values are stored as arrays of the same field, int16 fixed point and 8 bit codes: 7 bytes an hour
+struct Hourly_forecast
+{
+    Forecast_ring ring;
+    int16_t temp[FORECAST_HOURS];
+    int16_t wind_speed[FORECAST_HOURS];
+    uint8_t humidity[FORECAST_HOURS];       //%
+    uint8_t pop[FORECAST_HOURS];            //Probability of precipitation, %
+    uint8_t weather[FORECAST_HOURS];        //The first weather id, packed with weather_id_pack()
+};
+
+struct Daily_forecast
+{
+    Forecast_ring ring;
+    int16_t temp_min[FORECAST_DAYS];
+    int16_t temp_max[FORECAST_DAYS];
+    int16_t wind_speed[FORECAST_DAYS];
+    uint8_t humidity[FORECAST_DAYS];
+    uint8_t pop[FORECAST_DAYS];
+    uint8_t weather[FORECAST_DAYS];
+};
+
+struct Weather_forecast
+{
+    Hourly_forecast hourly;
+    Daily_forecast daily;
+};
+
+void weather_forecast_init(Weather_forecast* forecast);
+//Adding an entry after the last one. Returns its slot, -1 if the ring is full or the time doesn't follow the last entry.
+//The time of an entry is start + index * step_s, the tolerated shifts aren't kept.
+int forecast_ring_push(Forecast_ring* ring, int64_t time);
+//The slot of the entry of the given index, counted from the first entry
+int forecast_ring_slot(const Forecast_ring* ring, int index);
+//The time of the entry of the given index
+int64_t forecast_ring_time(const Forecast_ring* ring, int index);
+//Dropping the entries that are over at the given time
+void forecast_ring_drop_before(Forecast_ring* ring, int64_t time);
+
+//Saturating at the limits of int16
+int16_t forecast_to_fixed(float value, int scale);
+float forecast_from_fixed(int16_t value, int scale);
+//The weather ids of Openweathermap (200..804) in 8 bits, 0 for an unknown id
+uint8_t weather_id_pack(int id);
+int weather_id_unpack(uint8_t packed);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef WEATHER_PROVIDER_H_
+#define WEATHER_PROVIDER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WEATHER_REQUEST_SIZE 384     //The request with a long exclude list and the host of Openweathermap
+#define WEATHER_COORDINATE_DECIMALS 4   //About 11 m, finer than the grid of any weather model
+
+//What is asked of the provider. The strings are the caller's, they only have to live until build_request() returns.
+struct Weather_query
+{
+    float latitude;
+    float longitude;
+    const char* app_id;
+    const char* units;      //The data of Weather is in °C and hPa, other units are only for testing
+    const char* exclude;    //The parts of the response that aren't needed, NULL for all of them
+    const char* lang;       //The language of the descriptions, NULL for the default of the provider
+};
+
+//What the weather service needs to know about the last response, besides the data mapped into Weather
+struct Weather_response
+{
+    int status;                 //0 if no status line was received
+    int64_t date;               //The Date header as Unix time, 0 if there was none
+    uint32_t retry_after_s;     //0 if there was no Retry-After header
+    bool keep_alive;            //The server keeps the connection open after the response
+    bool alert_active;
+    float temp;
+    int pressure;
+};
+
+/* A weather backend: where the data is requested, what the request looks like, and how the response is mapped
+ * into Weather. The response is fed to the provider as it is received, chunk by chunk.
+ */
+class Weather_provider
+{
+    public:
+
+    virtual ~Weather_provider() {}
+    virtual const char* get_name() const = 0;
+    virtual const char* get_host() const = 0;
+    virtual const char* get_port() const = 0;
+    virtual bool uses_tls() const = 0;
+    //Writing the whole HTTP request into buf. Returns its length, 0 if it doesn't fit.
+    virtual size_t build_request(char* buf, size_t size, const Weather_query* query) const = 0;
+    virtual void begin_response() = 0;
+    //Returns false once the response turned out to be invalid, the rest of it can be dropped
+    virtual bool feed_response(const char* data, size_t length) = 0;
+    virtual bool is_response_complete() const = 0;
+    //Mapping the response into Weather. Returns false if it wasn't a complete, successful response.
+    virtual bool finish_response() = 0;
+    virtual Weather_response get_response() const = 0;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WEATHER_TRANSPORT_H_
+#define WEATHER_TRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WEATHER_TRANSPORT_ERR_CLOSED (-1)      //The server closed the connection before it answered
+
+/* The connection a weather provider is reached on: TLS for the public APIs, plain TCP for a server on the local network.
+ * The errors are negative codes of the implementation, which logs them where they happen.
+ */
+class Weather_transport
+{
+    protected:
+
+    bool connected = false;
+
+    public:
+
+    virtual ~Weather_transport() {}
+    //0 once connected
+    virtual int connect(const char* host, const char* port) = 0;
+    //Writing the whole data, 0 on success
+    virtual int write(const char* data, size_t length) = 0;
+    //The number of bytes read, 0 if the server closed the connection
+    virtual int read(char* buf, size_t size) = 0;
+    //The open connection can take another request: the server hasn't closed it and hasn't sent anything unasked
+    virtual bool is_usable() = 0;
+    virtual void disconnect() = 0;
+    bool is_connected() const
+    {
+        return connected;
+    }
+};
+
+#endif
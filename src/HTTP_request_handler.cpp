@@ -1,247 +1,224 @@
-/* This module uses Mbed-TLS to connect to the openweathermap API, and get the necessary weather data from their server. Used source:
- *
- * https://github.com/espressif/esp-idf/blob/master/examples/protocols/https_mbedtls/main/https_mbedtls_example_main.c
- * 
- * License: Apache-2.0
- * 2015-2021 Espressif Systems (Shanghai) CO LTD
+/* This module runs the weather service: it asks the weather provider for the current weather at the coordinates,
+ * when the poll scheduler says so, and takes the commands of the other modules in between.
+ * The provider is Openweathermap over TLS, or with -DWEATHER_REPLAY_HOST=\"<address>\"
+ * the replay server of the host build, which serves recorded responses over plain HTTP.
  */
 
-
 #include <stdlib.h>
 #include <inttypes.h>
-#include <string>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
-#include "lwip/err.h"
-#include "lwip/sockets.h"
-#include "lwip/sys.h"
-#include "lwip/netdb.h"
-#include "lwip/dns.h"
-#include "mbedtls/platform.h"
-#include "mbedtls/net_sockets.h"
-#include "mbedtls/esp_debug.h"
-#include "mbedtls/ssl.h"
-#include "mbedtls/entropy.h"
-#include "mbedtls/ctr_drbg.h"
-#include "mbedtls/error.h"
-#include "esp_crt_bundle.h"
-#include "JSON_parser.h"
+#include "esp_timer.h"
 #include "credentials.h"
 #include "store_data.h"
 #include "weather_data.h"
+#include "metrics.h"
+#include "poll_scheduler.h"
+#include "openweathermap_provider.h"
+#include "tls_transport.h"
+#include "tcp_transport.h"
+#include "weather_client.h"
+#include "weather_cache.h"
+#include "HTTP_request_handler.h"
 
-using namespace std;
-
-#define WEB_SERVER "api.openweathermap.org"
-#define WEB_PORT "443"
+#define WEATHER_READ_TIMEOUT_MS 10000      //A kept-alive connection isn't closed by the server to end a response
 
 extern Weather_data Weather;
-string openweathermap_app_id = nvs_read_apikey();
+static char openweathermap_app_id[NVS_APIKEY_SIZE];
 static const char *TAG = "HTTPS_REQUEST";
-float latitude = LAT, longitude = LON;
-
-string GET_REQUEST(float latitude, float longitude, string openweathermap_app_id){
-    /*
-     * This function constructs a request string that will be sent to the server.The string should look like this:
-     * https://api.openweathermap.org/data/2.5/onecall?lat=%f&lon=%f&units=metric&exclude=minutely,hourly,daily&appid=%s"
-     *
-     */
-    string WEB_URL = "/data/2.5/onecall?lat=" +
-                     to_string(latitude) +
-                     "&lon=" +
-                     to_string(longitude) + 
-                     "&units=metric&exclude=minutely,hourly,daily&appid=" +
-                     openweathermap_app_id;
-                     
-    string REQUEST = "GET " + WEB_URL + " HTTP/1.0\r\n" +
-    "Host: " + WEB_SERVER + "\r\n" 
-    "User-Agent: esp-idf/1.0 esp32\r\n" +
-    "Accept: application/json\r\n" +
-    "Content-Type: application/json\r\n" + 
-    "\r\n";;
-    return REQUEST;
+static Metric_histogram fetch_duration("weather_fetch_duration_seconds", "Duration of the successful weather requests, from the connection to the parsed data.",
+                                       NULL, METRICS_BUCKETS_SLOW_US, METRICS_BUCKETS_SLOW_COUNT);
+static Metric_counter fetch_failures("weather_fetch_failures_total", "Weather requests that failed at the connection, TLS or HTTP level.");
+static Metric_gauge poll_interval("weather_poll_interval_seconds", "Delay until the next weather request, as chosen by the poll scheduler.");
+static Metric_gauge poll_calls_today("weather_poll_calls_today", "Weather requests in the current 24 hour window of the call budget.");
+
+//Static, so that the state of the parser isn't on the stack of the task
+#ifdef WEATHER_REPLAY_HOST
+static Replay_provider provider(WEATHER_REPLAY_HOST, WEATHER_REPLAY_PORT);
+#else
+static Openweathermap_provider provider;
+#endif
+static Tls_transport tls_transport;
+static Tcp_transport tcp_transport(WEATHER_READ_TIMEOUT_MS);
+static char request[WEATHER_REQUEST_SIZE];
+static size_t request_length = 0;
+static Poll_scheduler poll_scheduler;
+static QueueHandle_t commands = NULL;
+
+//Building the request with the stored API-key and coordinates, once per configuration: the fetches only send it
+static void configure_request()
+{
+    nvs_read_apikey(openweathermap_app_id, sizeof(openweathermap_app_id));
+    Weather_query query = {};
+    query.latitude = Weather.get_lat();
+    query.longitude = Weather.get_lon();
+    query.app_id = openweathermap_app_id;
+    query.units = OPENWEATHERMAP_UNITS;
+    query.exclude = OPENWEATHERMAP_EXCLUDE;
+    query.lang = OPENWEATHERMAP_LANG;
+    request_length = provider.build_request(request, sizeof(request), &query);
+    if (request_length == 0)
+        ESP_LOGE(TAG, "The weather request doesn't fit into %d bytes", WEATHER_REQUEST_SIZE);
+    else
+        ESP_LOGI(TAG, "Requesting the weather of %.2f, %.2f from %s", Weather.get_lat(), Weather.get_lon(), provider.get_name());
 }
 
-void https_request_task(void *pvParameters)
+//One request to the provider. Returns the delay until the next one.
+static uint32_t fetch(Weather_transport *transport)
 {
-    char buf[512];
-    int ret, flags, len;
-    size_t written_bytes;
-    string api_response;
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_ssl_context ssl;
-    mbedtls_x509_crt cacert;
-    mbedtls_ssl_config conf;
-    mbedtls_net_context server_fd;
-    mbedtls_ssl_init(&ssl);
-    mbedtls_x509_crt_init(&cacert);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    string REQUEST = GET_REQUEST(Weather.get_lat(), Weather.get_lon(), openweathermap_app_id);
-    
-    mbedtls_ssl_config_init(&conf); //Initializing mbedtls.
-    mbedtls_entropy_init(&entropy);
-    ESP_LOGI(TAG, "Seeding the random number generator");
-    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0)) != 0)
+    int ret = -1;       //Without a request, e.g. with a too long API-key, the call fails and is retried with backoff
+    bool parsed = false;
+    int64_t fetch_start = esp_timer_get_time();
+    if (request_length != 0)
+        ret = weather_client_fetch(transport, &provider, request, request_length, &parsed);
+
+    if (ret == 0 && parsed)
     {
-        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed returned %d", ret);
-        abort();
+        fetch_duration.observe_us((uint32_t)(esp_timer_get_time() - fetch_start));
+        weather_cache_save();
+    }
+    else
+    {
+        fetch_failures.add();
     }
-
-    ESP_LOGI(TAG, "Attaching the certificate bundle...");
-
-    ret = esp_crt_bundle_attach(&conf);
-
     if (ret < 0)
     {
-        ESP_LOGE(TAG, "esp_crt_bundle_attach returned -0x%x\n\n", -ret);
-        abort();
+        ESP_LOGE(TAG, "The weather request failed: -0x%x", -ret);
     }
 
-    ESP_LOGI(TAG, "Setting hostname for TLS session...");
-
-    if ((ret = mbedtls_ssl_set_hostname(&ssl, WEB_SERVER)) != 0)
+    Weather_response response = provider.get_response();
+    Poll_outcome outcome = {};
+    if (ret == 0 && parsed)
     {
-        ESP_LOGE(TAG, "mbedtls_ssl_set_hostname returned -0x%x", -ret);
-        abort();
+        outcome.result = POLL_SUCCESS;
+        outcome.alert_active = response.alert_active;
+        outcome.temp = response.temp;
+        outcome.pressure = response.pressure;
     }
-
-    ESP_LOGI(TAG, "Setting up the SSL/TLS structure...");
-
-    if ((ret = mbedtls_ssl_config_defaults(&conf,
-                                          MBEDTLS_SSL_IS_CLIENT,
-                                          MBEDTLS_SSL_TRANSPORT_STREAM,
-                                          MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+    else if (response.status == 429 || (response.status == 503 && response.retry_after_s > 0))
     {
-        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults returned %d", ret);
-        goto exit;
+        outcome.result = POLL_RATE_LIMITED;
+        //Clamped before the conversion, a huge Retry-After mustn't wrap around to a short delay
+        uint32_t retry_after_s = response.retry_after_s;
+        if (retry_after_s > POLL_RETRY_AFTER_MAX_MS / 1000)
+            retry_after_s = POLL_RETRY_AFTER_MAX_MS / 1000;
+        outcome.retry_after_ms = retry_after_s * 1000;
     }
+    else
+    {
+        outcome.result = POLL_FAILED;
+    }
+    uint32_t delay_ms = poll_scheduler_next_delay(&poll_scheduler, &outcome, esp_timer_get_time());
+    poll_interval.set(delay_ms / 1000.0f);
+    poll_calls_today.set(poll_scheduler.calls_today);
+
+    static int request_count;
+    ESP_LOGI(TAG, "Completed %d requests, %" PRIu32 " today, the next one in %" PRIu32 " s",
+             ++request_count, poll_scheduler.calls_today, delay_ms / 1000);
+    return delay_ms;
+}
 
-    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-    mbedtls_ssl_conf_ca_chain(&conf, &cacert, NULL);
-    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+//Fetching now instead of at the scheduled time, unless it would exceed the call budget of the day
+static void fetch_early(int64_t *next_fetch_us)
+{
+    int64_t now = esp_timer_get_time();
+    if (poll_scheduler_can_call(&poll_scheduler, now))
+        *next_fetch_us = now;
+    else
+        ESP_LOGW(TAG, "The call budget of the day is used up, the weather is fetched at the scheduled time");
+}
 
-    if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0)
+/* The weather service runs for the lifetime of the firmware. It sleeps on its command queue until the next fetch,
+ * so a command is handled at once, but never in the middle of a request: the connection and the TLS state stay intact.
+ */
+static void weather_service_task(void *pvParameters)
+{
+    Weather_transport *transport = &tcp_transport;
+    if (provider.uses_tls())
     {
-        ESP_LOGE(TAG, "mbedtls_ssl_setup returned -0x%x\n\n", -ret);
-        goto exit;
+        tls_transport.setup(WEATHER_READ_TIMEOUT_MS);
+        transport = &tls_transport;
     }
+    poll_scheduler_init(&poll_scheduler, esp_timer_get_time());
+    configure_request();
 
-    while(1) 
+    bool paused = false;
+    bool reconfigure = false;
+    int64_t next_fetch_us = esp_timer_get_time();
+    while (1)
     {
-        //Using Mbed-TLS to connect to the server, and set up SSL/TLS communication
-        mbedtls_net_init(&server_fd);
-        ESP_LOGI(TAG, "Connecting to %s:%s...", WEB_SERVER, WEB_PORT);
-        if ((ret = mbedtls_net_connect(&server_fd, WEB_SERVER, WEB_PORT, MBEDTLS_NET_PROTO_TCP)) != 0)
+        Weather_command command;
+        TickType_t wait = portMAX_DELAY;
+        if (!paused)
         {
-            ESP_LOGE(TAG, "mbedtls_net_connect returned -%x", -ret);
-            goto exit;
+            //The ticks of a long wait would overflow, it is waited in steps. A tick more doesn't wake it up too early.
+            int64_t remaining_us = next_fetch_us - esp_timer_get_time();
+            if (remaining_us > (int64_t)WEATHER_SERVICE_MAX_WAIT_MS * 1000)
+                remaining_us = (int64_t)WEATHER_SERVICE_MAX_WAIT_MS * 1000;
+            wait = remaining_us > 0 ? pdMS_TO_TICKS((uint32_t)(remaining_us / 1000)) + 1 : 0;
         }
-
-        ESP_LOGI(TAG, "Connected.");
-        mbedtls_ssl_set_bio(&ssl, &server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
-        ESP_LOGI(TAG, "Performing the SSL/TLS handshake...");
-        while ((ret = mbedtls_ssl_handshake(&ssl)) != 0)
+        if (xQueueReceive(commands, &command, wait) == pdTRUE)
         {
-            if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+            switch (command)
             {
-                ESP_LOGE(TAG, "mbedtls_ssl_handshake returned -0x%x", -ret);
-                goto exit;
+                case WEATHER_RECONFIGURE:
+                    //Applied before the next request, even if that is after a pause
+                    reconfigure = true;
+                    fetch_early(&next_fetch_us);
+                    break;
+                case WEATHER_FETCH_NOW:
+                    fetch_early(&next_fetch_us);
+                    break;
+                case WEATHER_PAUSE:
+                    ESP_LOGI(TAG, "Pausing the weather requests");
+                    paused = true;
+                    transport->disconnect();
+                    break;
+                case WEATHER_RESUME:
+                    if (paused)
+                    {
+                        ESP_LOGI(TAG, "Resuming the weather requests");
+                        paused = false;
+                        fetch_early(&next_fetch_us);
+                    }
+                    break;
             }
+            continue;
         }
+        if (esp_timer_get_time() < next_fetch_us)
+            continue;
 
-        ESP_LOGI(TAG, "Verifying peer X.509 certificate...");
-
-        if ((flags = mbedtls_ssl_get_verify_result(&ssl)) != 0)
-        {
-            ESP_LOGW(TAG, "Failed to verify peer certificate!");
-            bzero(buf, sizeof(buf));
-            mbedtls_x509_crt_verify_info(buf, sizeof(buf), "  ! ", flags);
-            ESP_LOGW(TAG, "verification info: %s", buf);
-            goto exit;
-        }
-        else
+        if (reconfigure)
         {
-            ESP_LOGI(TAG, "Certificate verified.");
-        }
-
-        ESP_LOGI(TAG, "Cipher suite is %s", mbedtls_ssl_get_ciphersuite(&ssl));
-
-        ESP_LOGI(TAG, "Writing HTTP request...");
-
-        written_bytes = 0;
-        do {
-            ret = mbedtls_ssl_write(&ssl,
-                                    (const unsigned char *)REQUEST.c_str() + written_bytes,
-                                    strlen(REQUEST.c_str()) - written_bytes);
-            if (ret >= 0) 
-            {
-                ESP_LOGI(TAG, "%d bytes written", ret);
-                written_bytes += ret;
-            } 
-            else if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ)
-            {
-                ESP_LOGE(TAG, "mbedtls_ssl_write returned -0x%x", -ret);
-                goto exit;
-            }
-        } while(written_bytes < strlen(REQUEST.c_str()));
-
-        ESP_LOGI(TAG, "Reading HTTP response...");
-        
-        do {
-            len = sizeof(buf) - 1;
-            bzero(buf, sizeof(buf));
-            ret = mbedtls_ssl_read(&ssl, (unsigned char *)buf, len);
-            
-            if(ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
-                continue;
-
-            if(ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
-                ret = 0;
-                break;
-            }
-
-            if(ret < 0)
-            {
-                ESP_LOGE(TAG, "mbedtls_ssl_read returned -0x%x", -ret);
-                break;
-            }
-
-            if(ret == 0)
-            {
-                ESP_LOGI(TAG, "connection closed");
-                break;
-            }
-
-            len = ret;
-            ESP_LOGD(TAG, "%d bytes read", len);
-            for(int i = 0; i < len; i++) {
-                if(api_response != "")
-                    api_response += buf[i];
-                else
-                    api_response = buf[i];
-            }
-            
-        } while(1);
-        //ESP_LOGI(TAG, "%s\n", api_response.c_str()); 
-        mbedtls_ssl_close_notify(&ssl);
-        parse_weather_json(api_response);
-        api_response = "";
-
-    exit:
-        mbedtls_ssl_session_reset(&ssl);
-        mbedtls_net_free(&server_fd);
-
-        if (ret != 0)
-        {
-            mbedtls_strerror(ret, buf, 100);
-            ESP_LOGE(TAG, "Last error was: -0x%x - %s", -ret, buf);
+            configure_request();
+            reconfigure = false;
         }
+        uint32_t delay_ms = fetch(transport);
+        next_fetch_us = esp_timer_get_time() + (int64_t)delay_ms * 1000;
+    }
+}
 
-        static int request_count;
-        ESP_LOGI(TAG, "Completed %d requests", ++request_count);
-        vTaskDelay(600000 / portTICK_PERIOD_MS);
+esp_err_t weather_service_start()
+{
+    if (commands != NULL)
+        return ESP_OK;
+    commands = xQueueCreate(WEATHER_COMMAND_QUEUE_DEPTH, sizeof(Weather_command));
+    if (commands == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create the weather command queue");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(&weather_service_task, "weather_service", WEATHER_SERVICE_STACK_SIZE, NULL, WEATHER_SERVICE_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the weather service task");
+        return ESP_ERR_NO_MEM;
     }
+    return ESP_OK;
 }
 
+bool weather_service_send(Weather_command command)
+{
+    return commands != NULL && xQueueSend(commands, &command, 0) == pdTRUE;
+}
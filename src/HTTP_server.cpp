@@ -8,558 +8,961 @@
 #include <esp_log.h>
 #include <esp_system.h>
 #include <sys/param.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
 #include "esp_netif.h"
 #include <esp_https_server.h>
 #include <sys/stat.h>
 #include "esp_spiffs.h"
+#include "esp_rom_crc.h"
+#include <inttypes.h>
+#include "sdkconfig.h"
 #include "room_data.h"
 #include "weather_data.h"
 #include "WiFi_STA.h"
 #include <string>
 #include "HTTP_request_handler.h"
 #include "store_data.h"
+#include "form_parser.h"
+#include "json_writer.h"
+#include "WS_telemetry.h"
+#include "HTTP_workers.h"
+#include "job_queue.h"
+#include "metrics.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 static const char *TAG = "HTTPS_SERVER";
-#define CONFIG_PAGE_HTML_PATH "/spiffs/config_page.html"
-char config_html[16384];
-char response_data[16384];
+httpd_handle_t server = NULL;
+#define WEB_ASSET_CHUNK_SIZE 1024
+#define WEB_ASSET_ETAG_SIZE 24
+#define WEB_ASSET_HEADER_SIZE 128
+#define CONFIG_JSON_SIZE 160
+#define STATUS_JSON_SIZE 768
+#define HTTP_BODY_MAX_SIZE 512           //The longest form is the Wi-Fi form, with both fields fully percent-encoded
+#define HTTP_CUSTOM_HDR_SIZE 64
+#define JOBS_JSON_SIZE 768
+#define FORECAST_JSON_SIZE 1280         //One of the two objects of the forecast, they are sent in separate chunks
+#define HTTP_MAX_URI_HANDLERS 12
+#define WEB_ASSET_PATH_SIZE 128
+//The host build serves the files of the data directory
+#ifndef WEB_ASSET_BASE_PATH
+#define WEB_ASSET_BASE_PATH "/spiffs"
+#endif
+
+//httpd keeps three of the lwIP sockets for itself
+static_assert(HTTP_MAX_OPEN_SOCKETS <= CONFIG_LWIP_MAX_SOCKETS - 3, "HTTP_MAX_OPEN_SOCKETS exceeds the lwIP sockets");
+//A deferred request keeps its socket, at least one has to be left for the new requests
+static_assert(HTTP_WORKER_COUNT < HTTP_MAX_OPEN_SOCKETS, "HTTP_WORKER_COUNT has to be less than HTTP_MAX_OPEN_SOCKETS");
+
+/* A static file served from SPIFFS. If "<path>.gz" exists, it is sent to the clients that accept gzip.
+ * The strong ETags are computed once at startup, separately for the two representations.
+ */
+struct Web_asset
+{
+    const char* uri;
+    const char* path;
+    const char* type;
+    bool has_gzip;
+    char etag[WEB_ASSET_ETAG_SIZE];
+    char gzip_etag[WEB_ASSET_ETAG_SIZE];
+    Metric_histogram* latency;
+};
+
+#define HTTP_LATENCY_NAME "http_request_duration_seconds"
+#define HTTP_LATENCY_HELP "Time spent in the handler of a URI, deferred requests are measured on the worker."
+static Metric_histogram page_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/\"",
+                                     METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram config_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/api/v1/config\"",
+                                       METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram status_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/api/v1/status\"",
+                                       METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram jobs_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/api/v1/jobs\"",
+                                     METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram forecast_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/api/v1/forecast\"",
+                                         METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram metrics_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/metrics\"",
+                                        METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram submit_wifi_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/SubmitWiFi\"",
+                                            METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram submit_api_key_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/SubmitAPI\"",
+                                               METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram submit_mode_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/SubmitMode\"",
+                                            METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_histogram submit_coordinates_latency(HTTP_LATENCY_NAME, HTTP_LATENCY_HELP, "uri=\"/SubmitCoordinates\"",
+                                                   METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+static Metric_gauge heap_free("heap_free_bytes", "Free heap at the time of the scrape.");
+static Metric_gauge heap_largest_block("heap_largest_free_block_bytes", "Largest allocatable block of the heap at the time of the scrape.");
+static Metric_gauge heap_minimum_free("heap_minimum_free_bytes", "Lowest free heap since the start.");
+static Metric_gauge uptime("uptime_seconds", "Time since the start.");
+
+static Web_asset web_assets[] =
+{
+    {"/", WEB_ASSET_BASE_PATH "/config_page.html", "text/html", false, "", "", &page_latency},
+};
+
 extern Room_data Internal_room_data;
 extern Weather_data Weather;
-extern string openweathermap_app_id;
-extern TaskHandle_t http_request_task_handle;
-
-//Because the data is URL encoded, it is necessary to decode it.
-string data_decode(string data)
-{
-    string decoded_data = "";
-    for (size_t i = 0; i < data.size(); i++) {
-        if (data[i] == '%' && i + 2 < data.size() && isxdigit(data[i + 1]) && isxdigit(data[i + 2])) {
-            //If it's a percent-encoded
-            int value;
-            sscanf(data.substr(i + 1, 2).c_str(), "%x", &value);
-            decoded_data += static_cast<char>(value);
-            i += 2; // Move ahead by 2 characters
-        } else if (data[i] == '+') {
-            //Replace '+' with space
-            decoded_data += ' ';
-        } else {
-            //Copy the character
-            decoded_data += data[i];
-        }
-    }
-    
-    return decoded_data;
-}
 
-//Parsing the data from the url
-string parse_url(string url_response, string data)
+//Computing the ETag of a file from its CRC32 and size. Returns false if the file can't be read.
+static bool compute_etag(const char* path, char* etag, size_t size)
 {
-    //Find the data in the url
-    data = data + "=";
-    size_t position = url_response.find(data);
-    //Execute the code only if the data has been found
-    if (position != string::npos)
-    {
-        //Finds the position where our data starts and where it ends
-        size_t start = position + data.length();
-        size_t end = url_response.find_first_of("&", start);
-        //Copies the substring where the data is located.
-        if (end == string::npos)
-        {
-            data = url_response.substr(start);
-        }
-        else
-        {
-            data = url_response.substr(start, end-start);
-        }
-        return data;
-    }
-    else
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return false;
+
+    char chunk[WEB_ASSET_CHUNK_SIZE];
+    uint32_t crc = 0;
+    size_t file_size = 0;
+    size_t length;
+    while ((length = fread(chunk, 1, sizeof(chunk), fp)) > 0)
     {
-        return "";
+        crc = esp_rom_crc32_le(crc, (const uint8_t*)chunk, length);
+        file_size += length;
     }
+    fclose(fp);
+    snprintf(etag, size, "\"%08" PRIx32 "-%x\"", crc, (unsigned)file_size);
+    return true;
 }
 
-void config_web_page_buffer()
+//Mounting the SPIFFS partition and looking up the web assets on it
+void init_web_assets()
 {
     //Define the flash SPIFFS partition
     esp_vfs_spiffs_conf_t conf = {
-        .base_path = "/spiffs",
+        .base_path = WEB_ASSET_BASE_PATH,
         .partition_label = NULL,
         .max_files = 5,
         .format_if_mount_failed = true};
 
     ESP_ERROR_CHECK(esp_vfs_spiffs_register(&conf));
 
-    //Read the file from the filesystem
-    memset((void *)config_html, 0, sizeof(config_html));
-    struct stat st;
-    if (stat(CONFIG_PAGE_HTML_PATH, &st))
+    char gzip_path[WEB_ASSET_PATH_SIZE];
+    for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++)
     {
-        ESP_LOGE(TAG, "config_page.html not found");
-        return;
+        Web_asset* asset = &web_assets[i];
+        if (!compute_etag(asset->path, asset->etag, sizeof(asset->etag)))
+        {
+            ESP_LOGE(TAG, "%s not found", asset->path);
+            asset->etag[0] = '\0';
+        }
+        snprintf(gzip_path, sizeof(gzip_path), "%s.gz", asset->path);
+        asset->has_gzip = compute_etag(gzip_path, asset->gzip_etag, sizeof(asset->gzip_etag));
+        ESP_LOGI(TAG, "Web asset %s: ETag %s, gzip %s", asset->uri, asset->etag, asset->has_gzip ? asset->gzip_etag : "not available");
     }
+}
 
-    FILE *fp = fopen(CONFIG_PAGE_HTML_PATH, "r");
-    if (fread(config_html, st.st_size, 1, fp) == 0)
+typedef esp_err_t (*request_handler_t)(httpd_req_t *req);
+
+//Running a GET handler on a worker with the asynchronous copy of its request
+static void run_deferred_request(void* arg, void* context)
+{
+    httpd_req_t* req = (httpd_req_t*)arg;
+    request_handler_t handler = (request_handler_t)context;
+    if (handler(req) != ESP_OK)
     {
-        ESP_LOGE(TAG, "fread failed");
+        httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
     }
-    fclose(fp);
+    httpd_req_async_handler_complete(req);
 }
 
-void fill_config_page()
+/* The read-only handlers call this first. If an idle worker takes the request, the handler returns at once and
+ * the httpd task carries on with the other connections, while the worker calls the same handler again.
+ * Returns false on the worker itself and when the request has to be served on the httpd task (every worker is busy).
+ * The POST handlers are not deferred: they stay on the httpd task, which keeps the changes of the settings in order.
+ */
+static bool defer_to_worker(httpd_req_t *req, request_handler_t handler)
 {
-    /*Depending on the operation mode of the window opener (auto or manual)
-      The radio-buttons on the config page must be checked accordingly.
-      This part of the code writes in the config page.
-     */
-    
-    if (Internal_room_data.get_is_auto())
-    {
-        sprintf(response_data, config_html, Internal_room_data.get_window_deg()*100,
-                                            Internal_room_data.get_desired_temperature(),
-                                            Internal_room_data.get_desired_temperature(),
-                                            "true");
-    }
-    else
+    if (http_worker_is_current())
+        return false;
+
+    httpd_req_t* copy = NULL;
+    if (httpd_req_async_handler_begin(req, &copy) != ESP_OK)
+        return false;
+    if (!http_workers_submit(run_deferred_request, copy, (void*)handler))
     {
-        sprintf(response_data, config_html, Internal_room_data.get_window_deg()*100,
-                                            Internal_room_data.get_desired_temperature(),
-                                            Internal_room_data.get_desired_temperature(),
-                                            "false");
+        httpd_req_async_handler_complete(copy);
+        return false;
     }
+    return true;
 }
 
-//The HTTP-GET handler of the config page which returns the page itself.
-static esp_err_t root_get_handler(httpd_req_t *req)
+//Checking whether a request header contains the given token. A truncated header value is searched as well.
+static bool header_contains(httpd_req_t *req, const char* field, const char* token)
 {
-    fill_config_page();
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, response_data, HTTPD_RESP_USE_STRLEN);
-
-    return ESP_OK;
+    char value[WEB_ASSET_HEADER_SIZE];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, field, value, sizeof(value));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC)
+        return false;
+    return strstr(value, token) != NULL || strcmp(value, "*") == 0;
 }
 
-static const httpd_uri_t root_get = 
+//The q parameter among the parameters of a list element, 1 if it has none
+static float get_quality(const char* params, const char* end)
 {
-    .uri = "/",
-    .method  = HTTP_GET,
-    .handler = root_get_handler,
-    .user_ctx  = NULL,
-    .is_websocket = NULL,
-    .handle_ws_control_frames = NULL,
-    .supported_subprotocol = NULL
-};
+    while ((params = (const char*)memchr(params, ';', end - params)) != NULL)
+    {
+        params++;
+        while (params < end && (*params == ' ' || *params == '\t'))
+            params++;
+        if (end - params >= 2 && (params[0] == 'q' || params[0] == 'Q') && params[1] == '=')
+            return strtof(params + 2, NULL);
+    }
+    return 1.0f;
+}
 
-//Handling the HTTP-POST requests of the client.
-static esp_err_t submit_wifi_post_handler(httpd_req_t *req)
+/* Checking whether a list header like Accept-Encoding accepts the given token: it is listed, or "*" is, with a q above 0.
+ * The token itself decides over "*", "gzip;q=0" refuses gzip whatever the wildcard says.
+ */
+static bool header_accepts(httpd_req_t *req, const char* field, const char* token)
 {
-    
-    ESP_LOGI(TAG, "/ content length %d", req->content_len);
-
-    char*  buf = (char*)malloc(req->content_len + 1);
-    size_t off = 0;
-    int ret;
-    string ssid, pass;
+    char value[WEB_ASSET_HEADER_SIZE];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, field, value, sizeof(value));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC)
+        return false;
+
+    size_t token_length = strlen(token);
+    bool wildcard = false;
+    const char* item = value;
+    while (*item != '\0')
+    {
+        const char* end = strchr(item, ',');
+        if (end == NULL)
+            end = item + strlen(item);
+        while (item < end && (*item == ' ' || *item == '\t'))
+            item++;
+        size_t name_length = strcspn(item, ";, \t");
+        float quality = get_quality(item + name_length, end);
+        if (name_length == token_length && strncasecmp(item, token, token_length) == 0)
+            return quality > 0;
+        if (name_length == 1 && *item == '*')
+            wildcard = quality > 0;
+        item = *end == ',' ? end + 1 : end;
+    }
+    return wildcard;
+}
 
-    if (!buf)
+//Streaming a file as the body of the response
+static esp_err_t send_file(httpd_req_t *req, const char* path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", req->content_len + 1);
-        httpd_resp_send_500(req);
+        ESP_LOGE(TAG, "%s not found", path);
+        httpd_resp_send_404(req);
         return ESP_FAIL;
     }
 
-    while (off < req->content_len)
+    char chunk[WEB_ASSET_CHUNK_SIZE];
+    esp_err_t ret = ESP_OK;
+    size_t length;
+    while (ret == ESP_OK && (length = fread(chunk, 1, sizeof(chunk), fp)) > 0)
     {
-        //Read data received in the request
-        ret = httpd_req_recv(req, buf + off, req->content_len - off);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                httpd_resp_send_408(req);
-            }
-            free (buf);
-            return ESP_FAIL;
-        }
-        off += ret;
-        ESP_LOGI(TAG, "/ Recv length %d", ret);
+        ret = httpd_resp_send_chunk(req, chunk, length);
     }
-    buf[off] = '\0';
+    fclose(fp);
 
-    if (req->content_len < 128) {
-        ESP_LOGI(TAG, "/ data: %s", buf);
+    if (ret != ESP_OK)
+    {
+        //Aborting the chunked response, the connection is closed
+        ESP_LOGE(TAG, "Sending %s failed", path);
+        httpd_resp_send_chunk(req, NULL, 0);
+        return ESP_FAIL;
     }
+    //End response
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+/* The HTTP-GET handler of the static files. The browser has to revalidate every time (no-cache),
+ * which costs a 304 without a body as long as the file on the flash hasn't changed.
+ */
+static esp_err_t web_asset_get_handler(httpd_req_t *req)
+{
+    if (defer_to_worker(req, web_asset_get_handler))
+        return ESP_OK;
 
-    //Search for Custom header field
-    char*  req_hdr = 0;
-    size_t hdr_len = httpd_req_get_hdr_value_len(req, "Custom");
-    if (hdr_len)
+    const Web_asset* asset = (const Web_asset*)req->user_ctx;
+    Metric_timer timer(asset->latency);
+    bool gzip = asset->has_gzip && header_accepts(req, "Accept-Encoding", "gzip");
+    const char* etag = gzip ? asset->gzip_etag : asset->etag;
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+    if (etag[0] != '\0')
     {
-        //Read Custom header value
-        req_hdr = (char*)malloc(hdr_len + 1);
-        if (!req_hdr)
+        httpd_resp_set_hdr(req, "ETag", etag);
+        if (header_contains(req, "If-None-Match", etag))
         {
-            ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", hdr_len + 1);
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
+            httpd_resp_set_status(req, "304 Not Modified");
+            return httpd_resp_send(req, NULL, 0);
         }
-        httpd_req_get_hdr_value_str(req, "Custom", req_hdr, hdr_len + 1);
+    }
 
-        //Set as additional header for response packet
-        httpd_resp_set_hdr(req, "Custom", req_hdr);
+    httpd_resp_set_type(req, asset->type);
+    if (gzip)
+    {
+        char gzip_path[WEB_ASSET_PATH_SIZE];
+        snprintf(gzip_path, sizeof(gzip_path), "%s.gz", asset->path);
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+        return send_file(req, gzip_path);
     }
- 
-    ssid = parse_url(buf, "ssid");
-    ssid = data_decode(ssid);
-    ESP_LOGI(TAG, "The SSID has been updated: %s", ssid.c_str());
+    return send_file(req, asset->path);
+}
 
-    pass = parse_url(buf, "password");
-    pass = data_decode(pass);
-    ESP_LOGI(TAG, "The password has been updated: ***");
+static esp_err_t send_json(httpd_req_t *req, Json_writer* writer)
+{
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    int length = json_finish(writer);
+    if (length < 0)
+    {
+        ESP_LOGE(TAG, "The JSON response of %s doesn't fit into %u bytes", req->uri, (unsigned)writer->size);
+        return httpd_resp_send_500(req);
+    }
+    return httpd_resp_send(req, writer->buffer, length);
+}
 
-    nvs_write_wifi_ssid(ssid.c_str());
-    nvs_write_wifi_pass(pass.c_str());
+//The dynamic values of the config page. It is also the response of the POST handlers, with the id of their job if they queued one.
+static esp_err_t send_config_json(httpd_req_t *req, uint32_t job_id = 0)
+{
+    Room_snapshot room = Internal_room_data.get_snapshot();
+    Weather_snapshot weather = Weather.get_snapshot();
+
+    char buffer[CONFIG_JSON_SIZE];
+    Json_writer json;
+    json_init(&json, buffer, sizeof(buffer));
+    json_object_begin(&json, NULL);
+    json_float(&json, "window_deg", room.window_deg, 1);
+    json_int(&json, "desired_temp", room.desired_temperature);
+    json_bool(&json, "auto", room.is_auto);
+    json_float(&json, "lat", weather.lat, 2);
+    json_float(&json, "lon", weather.lon, 2);
+    if (job_id != 0)
+        json_uint(&json, "job", job_id);
+    json_object_end(&json);
+    return send_json(req, &json);
+}
 
-    fill_config_page();
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, response_data, HTTPD_RESP_USE_STRLEN);
-    //End response
-    free (req_hdr);
-    free (buf);
+static esp_err_t config_json_get_handler(httpd_req_t *req)
+{
+    if (defer_to_worker(req, config_json_get_handler))
+        return ESP_OK;
+    Metric_timer timer(&config_latency);
+    return send_config_json(req);
+}
 
-    ssid = nvs_read_wifi_ssid();
-    pass = nvs_read_wifi_pass();
-    wifi_restart(ssid.c_str(), pass.c_str());
+//The measurements and the latest weather data. Each object is a consistent snapshot of its source.
+static esp_err_t status_json_get_handler(httpd_req_t *req)
+{
+    if (defer_to_worker(req, status_json_get_handler))
+        return ESP_OK;
+    Metric_timer timer(&status_latency);
+
+    Room_snapshot room = Internal_room_data.get_snapshot();
+    Weather_snapshot weather = Weather.get_snapshot();
+
+    char buffer[STATUS_JSON_SIZE];
+    Json_writer json;
+    json_init(&json, buffer, sizeof(buffer));
+    json_object_begin(&json, NULL);
+    json_uint(&json, "uptime_s", (uint32_t)(esp_timer_get_time() / 1000000));
+    json_uint(&json, "free_heap", esp_get_free_heap_size());
+
+    json_object_begin(&json, "room");
+    json_float(&json, "temperature", room.internal_temperature, 2);
+    json_float(&json, "humidity", room.internal_humidity, 2);
+    json_float(&json, "gas_resistance", room.gas_resistance, 0);
+    json_float(&json, "window_deg", room.window_deg, 1);
+    json_int(&json, "desired_temp", room.desired_temperature);
+    json_bool(&json, "auto", room.is_auto);
+    json_object_end(&json);
+
+    json_object_begin(&json, "weather");
+    json_float(&json, "temp", weather.temp, 2);
+    json_int(&json, "pressure", weather.pressure);
+    json_int(&json, "humidity", weather.humidity);
+    json_float(&json, "wind_speed", weather.wind_speed, 2);
+    json_int(&json, "wind_deg", weather.wind_deg);
+    json_int(&json, "timezone_offset", weather.timezone_offset);
+    json_float(&json, "lat", weather.lat, 2);
+    json_float(&json, "lon", weather.lon, 2);
+    json_array_begin(&json, "weather_ids");
+    for (int i = 0; i < weather.weather_id_count; i++)
+        json_int(&json, NULL, weather.weather_ids[i]);
+    json_array_end(&json);
+    json_int(&json, "alert_count", weather.alert_count);
+    json_array_begin(&json, "alerts");
+    for (int i = 0; i < weather.alert_count && i < WEATHER_SNAPSHOT_MAX_ALERTS; i++)
+        json_string(&json, NULL, weather.alert_events[i]);
+    json_array_end(&json);
+    json_string(&json, "freshness", weather_freshness_name(weather.freshness));
+    json_int(&json, "age_s", weather.age_s);
+    json_object_end(&json);
+
+    json_object_end(&json);
+    return send_json(req, &json);
+}
 
-    return ESP_OK;
+static void write_job(Json_writer* json, const Job_status* job)
+{
+    int64_t now = esp_timer_get_time();
+    json_object_begin(json, NULL);
+    json_uint(json, "id", job->id);
+    json_string(json, "type", job_type_name(job->type));
+    json_string(json, "state", job_state_name(job->state));
+    json_uint(json, "age_ms", (uint32_t)((now - job->queued_us) / 1000));
+    if (job->state == JOB_DONE || job->state == JOB_FAILED)
+    {
+        json_uint(json, "duration_ms", (uint32_t)((job->finished_us - job->started_us) / 1000));
+        json_string(json, "result", esp_err_to_name(job->result));
+    }
+    json_object_end(json);
 }
 
-static esp_err_t submit_api_key_post_handler(httpd_req_t *req)
+//A single job with ?id=<job>, the latest jobs without a query
+static esp_err_t jobs_json_get_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "/ content length %d", req->content_len);
+    if (defer_to_worker(req, jobs_json_get_handler))
+        return ESP_OK;
+    Metric_timer timer(&jobs_latency);
+
+    char buffer[JOBS_JSON_SIZE];
+    Json_writer json;
+    json_init(&json, buffer, sizeof(buffer));
+
+    char query[32];
+    char id[12];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+        && httpd_query_key_value(query, "id", id, sizeof(id)) == ESP_OK)
+    {
+        Job_status job;
+        if (!job_get_status(strtoul(id, NULL, 10), &job))
+            return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown job");
+        write_job(&json, &job);
+        return send_json(req, &json);
+    }
+
+    Job_status jobs[JOB_HISTORY_SIZE];
+    int count = job_get_recent(jobs, JOB_HISTORY_SIZE);
+    json_array_begin(&json, NULL);
+    for (int i = 0; i < count; i++)
+        write_job(&json, &jobs[i]);
+    json_array_end(&json);
+    return send_json(req, &json);
+}
 
-    char*  buf = (char*)malloc(req->content_len + 1);
-    size_t off = 0;
-    int ret;
+static const httpd_uri_t jobs_json_get =
+{
+    .uri = "/api/v1/jobs",
+    .method  = HTTP_GET,
+    .handler = jobs_json_get_handler,
+    .user_ctx  = NULL,
+    .is_websocket = NULL,
+    .handle_ws_control_frames = NULL,
+    .supported_subprotocol = NULL
+};
 
-    if (!buf)
+//The entries of a forecast as one array per field, like they are stored
+static void write_forecast_ring(Json_writer* json, const Forecast_ring* ring)
+{
+    json_uint(json, "start", (uint32_t)ring->start);
+    json_uint(json, "step_s", ring->step_s);
+}
+
+static void write_forecast_temps(Json_writer* json, const char* key, const Forecast_ring* ring, const int16_t* temps)
+{
+    json_array_begin(json, key);
+    for (int i = 0; i < ring->count; i++)
+        json_float(json, NULL, forecast_from_fixed(temps[forecast_ring_slot(ring, i)], FORECAST_TEMP_SCALE), 1);
+    json_array_end(json);
+}
+
+static void write_forecast_common(Json_writer* json, const Forecast_ring* ring, const int16_t* wind_speed, const uint8_t* humidity,
+                                  const uint8_t* pop, const uint8_t* weather)
+{
+    json_array_begin(json, "wind_speed");
+    for (int i = 0; i < ring->count; i++)
+        json_float(json, NULL, forecast_from_fixed(wind_speed[forecast_ring_slot(ring, i)], FORECAST_WIND_SCALE), 1);
+    json_array_end(json);
+    json_array_begin(json, "humidity");
+    for (int i = 0; i < ring->count; i++)
+        json_uint(json, NULL, humidity[forecast_ring_slot(ring, i)]);
+    json_array_end(json);
+    json_array_begin(json, "pop");
+    for (int i = 0; i < ring->count; i++)
+        json_uint(json, NULL, pop[forecast_ring_slot(ring, i)]);
+    json_array_end(json);
+    json_array_begin(json, "weather_ids");
+    for (int i = 0; i < ring->count; i++)
+        json_int(json, NULL, weather_id_unpack(weather[forecast_ring_slot(ring, i)]));
+    json_array_end(json);
+}
+
+static esp_err_t send_json_chunk(httpd_req_t *req, Json_writer* json)
+{
+    int length = json_finish(json);
+    if (length < 0)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", req->content_len + 1);
-        httpd_resp_send_500(req);
+        ESP_LOGE(TAG, "A chunk of %s doesn't fit into %u bytes", req->uri, (unsigned)json->size);
         return ESP_FAIL;
     }
+    return httpd_resp_send_chunk(req, json->buffer, length);
+}
 
-    while (off < req->content_len)
+//The hourly and the daily forecast, without the entries that are over
+static esp_err_t forecast_json_get_handler(httpd_req_t *req)
+{
+    if (defer_to_worker(req, forecast_json_get_handler))
+        return ESP_OK;
+    Metric_timer timer(&forecast_latency);
+
+    Weather_forecast forecast;
+    Weather.get_forecast(&forecast);
+    const Hourly_forecast* hourly = &forecast.hourly;
+    const Daily_forecast* daily = &forecast.daily;
+
+    char buffer[FORECAST_JSON_SIZE];
+    Json_writer json;
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    esp_err_t err = httpd_resp_send_chunk(req, "{\"hourly\":", HTTPD_RESP_USE_STRLEN);
+
+    json_init(&json, buffer, sizeof(buffer));
+    json_object_begin(&json, NULL);
+    write_forecast_ring(&json, &hourly->ring);
+    write_forecast_temps(&json, "temp", &hourly->ring, hourly->temp);
+    write_forecast_common(&json, &hourly->ring, hourly->wind_speed, hourly->humidity, hourly->pop, hourly->weather);
+    json_object_end(&json);
+    if (err == ESP_OK)
+        err = send_json_chunk(req, &json);
+    if (err == ESP_OK)
+        err = httpd_resp_send_chunk(req, ",\"daily\":", HTTPD_RESP_USE_STRLEN);
+
+    json_init(&json, buffer, sizeof(buffer));
+    json_object_begin(&json, NULL);
+    write_forecast_ring(&json, &daily->ring);
+    write_forecast_temps(&json, "temp_min", &daily->ring, daily->temp_min);
+    write_forecast_temps(&json, "temp_max", &daily->ring, daily->temp_max);
+    write_forecast_common(&json, &daily->ring, daily->wind_speed, daily->humidity, daily->pop, daily->weather);
+    json_object_end(&json);
+    if (err == ESP_OK)
+        err = send_json_chunk(req, &json);
+    if (err == ESP_OK)
+        err = httpd_resp_send_chunk(req, "}", 1);
+
+    //An aborted chunked response closes the connection
+    httpd_resp_send_chunk(req, NULL, 0);
+    return err;
+}
+
+static const httpd_uri_t forecast_json_get =
+{
+    .uri = "/api/v1/forecast",
+    .method  = HTTP_GET,
+    .handler = forecast_json_get_handler,
+    .user_ctx  = NULL,
+    .is_websocket = NULL,
+    .handle_ws_control_frames = NULL,
+    .supported_subprotocol = NULL
+};
+
+static bool send_metrics_chunk(void* ctx, const char* data, size_t length)
+{
+    return httpd_resp_send_chunk((httpd_req_t*)ctx, data, length) == ESP_OK;
+}
+
+//Every metric of the firmware in the Prometheus text format
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+    if (defer_to_worker(req, metrics_get_handler))
+        return ESP_OK;
+    Metric_timer timer(&metrics_latency);
+
+    heap_free.set(esp_get_free_heap_size());
+    heap_largest_block.set(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    heap_minimum_free.set(esp_get_minimum_free_heap_size());
+    uptime.set(esp_timer_get_time() / 1000000);
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    if (!metrics_render(send_metrics_chunk, req))
     {
-        //Read data received in the request
-        ret = httpd_req_recv(req, buf + off, req->content_len - off);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                httpd_resp_send_408(req);
-            }
-            free (buf);
-            return ESP_FAIL;
-        }
-        off += ret;
-        ESP_LOGI(TAG, "/ Recv length %d", ret);
+        //Aborting the chunked response, the connection is closed
+        httpd_resp_send_chunk(req, NULL, 0);
+        return ESP_FAIL;
     }
-    buf[off] = '\0';
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
 
-    if (req->content_len < 128) {
-        ESP_LOGI(TAG, "/ data: %s", buf);
-    }
+static const httpd_uri_t metrics_get =
+{
+    .uri = "/metrics",
+    .method  = HTTP_GET,
+    .handler = metrics_get_handler,
+    .user_ctx  = NULL,
+    .is_websocket = NULL,
+    .handle_ws_control_frames = NULL,
+    .supported_subprotocol = NULL
+};
 
-    //Search for Custom header field
-    char*  req_hdr = 0;
-    size_t hdr_len = httpd_req_get_hdr_value_len(req, "Custom");
-    if (hdr_len)
-    {
-        //Read Custom header value
-        req_hdr = (char*)malloc(hdr_len + 1);
-        if (!req_hdr)
-        {
-            ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", hdr_len + 1);
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
-        }
-        httpd_req_get_hdr_value_str(req, "Custom", req_hdr, hdr_len + 1);
+static const httpd_uri_t status_json_get =
+{
+    .uri = "/api/v1/status",
+    .method  = HTTP_GET,
+    .handler = status_json_get_handler,
+    .user_ctx  = NULL,
+    .is_websocket = NULL,
+    .handle_ws_control_frames = NULL,
+    .supported_subprotocol = NULL
+};
 
-        //Set as additional header for response packet
-        httpd_resp_set_hdr(req, "Custom", req_hdr);
-    }
-    
-    //Parsing the Openweathermap API-key and restarting the request task that gets the data from the API
-    if (parse_url(buf, "apikey") != "")
+static const httpd_uri_t config_json_get =
+{
+    .uri = "/api/v1/config",
+    .method  = HTTP_GET,
+    .handler = config_json_get_handler,
+    .user_ctx  = NULL,
+    .is_websocket = NULL,
+    .handle_ws_control_frames = NULL,
+    .supported_subprotocol = NULL
+};
+
+/* The body of a POST request is read into an arena that belongs to the connection (the session context of httpd).
+ * It is allocated at the first POST of a connection and freed by httpd when the connection is closed,
+ * so the requests themselves don't touch the heap. A body that doesn't fit is refused with 413.
+ */
+struct Request_arena
+{
+    char body[HTTP_BODY_MAX_SIZE + 1];
+    char custom_hdr[HTTP_CUSTOM_HDR_SIZE];
+};
+
+//The part of a POST handler that comes after the body has been parsed
+typedef esp_err_t (*form_handler_t)(httpd_req_t *req, const Form_fields* form);
+
+//The user context of a POST endpoint
+struct Post_route
+{
+    form_handler_t handler;
+    Metric_histogram* latency;
+};
+
+static Request_arena* get_request_arena(httpd_req_t *req)
+{
+    if (req->sess_ctx == NULL)
     {
-        openweathermap_app_id = parse_url(buf, "apikey");
-        openweathermap_app_id = data_decode(openweathermap_app_id);
-        nvs_write_apikey(openweathermap_app_id.c_str());
-        vTaskDelete(http_request_task_handle);
-        xTaskCreate(&https_request_task, "https_request_task", 8192, NULL, 5, &http_request_task_handle);
-        ESP_LOGI(TAG, "The Openweathermap API-key has been updated!");
+        req->sess_ctx = malloc(sizeof(Request_arena));
+        req->free_ctx = free;
     }
-    
-    fill_config_page();
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, response_data, HTTPD_RESP_USE_STRLEN);
-    //End response
-    free (req_hdr);
-    free (buf);
-
-    return ESP_OK;
+    return (Request_arena*)req->sess_ctx;
 }
 
-static esp_err_t submit_mode_post_handler(httpd_req_t *req)
+//Every POST endpoint is registered with this handler, the user context is its form handler.
+static esp_err_t post_body_handler(httpd_req_t *req)
 {
-    ESP_LOGI(TAG, "/ content length %d", req->content_len);
+    const Post_route* route = (const Post_route*)req->user_ctx;
+    Metric_timer timer(route->latency);
+    ESP_LOGI(TAG, "%s content length %u", req->uri, (unsigned)req->content_len);
 
-    char*  buf = (char*)malloc(req->content_len + 1);
-    size_t off = 0;
-    int ret;
+    if (req->content_len > HTTP_BODY_MAX_SIZE)
+    {
+        //The body is not read, so the connection is closed by returning ESP_FAIL
+        ESP_LOGW(TAG, "%s body of %u bytes refused", req->uri, (unsigned)req->content_len);
+        httpd_resp_set_status(req, "413 Content Too Large");
+        httpd_resp_send(req, "Request body is too large", HTTPD_RESP_USE_STRLEN);
+        return ESP_FAIL;
+    }
 
-    if (!buf)
+    Request_arena* arena = get_request_arena(req);
+    if (arena == NULL)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", req->content_len + 1);
+        ESP_LOGE(TAG, "Failed to allocate memory of %u bytes!", (unsigned)sizeof(Request_arena));
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
+    size_t off = 0;
     while (off < req->content_len)
     {
         //Read data received in the request
-        ret = httpd_req_recv(req, buf + off, req->content_len - off);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        int ret = httpd_req_recv(req, arena->body + off, req->content_len - off);
+        if (ret <= 0)
+        {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+            {
                 httpd_resp_send_408(req);
             }
-            free (buf);
             return ESP_FAIL;
         }
         off += ret;
-        ESP_LOGI(TAG, "/ Recv length %d", ret);
     }
-    buf[off] = '\0';
+    arena->body[off] = '\0';
 
-    if (req->content_len < 128) {
-        ESP_LOGI(TAG, "/ data: %s", buf);
+    //Echoing the Custom header field, if it fits into the arena
+    if (httpd_req_get_hdr_value_str(req, "Custom", arena->custom_hdr, sizeof(arena->custom_hdr)) == ESP_OK)
+    {
+        httpd_resp_set_hdr(req, "Custom", arena->custom_hdr);
+    }
+
+    //JSON clients get the same fields as the forms of the config page
+    //A truncated value still has the media type at its start, any other error counts as no Content-Type
+    char content_type[32] = "";
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+    bool is_json = (err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC)
+                   && strncmp(content_type, "application/json", strlen("application/json")) == 0;
+    Form_fields form;
+    int field_count = is_json ? form_parse_json(arena->body, off, &form) : form_parse(arena->body, off, &form);
+    if (field_count < 0)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, is_json ? "Expected a flat JSON object" : "Too many form fields");
+        return ESP_OK;
     }
+    return route->handler(req, &form);
+}
 
-    //Search for Custom header field
-    char*  req_hdr = 0;
-    size_t hdr_len = httpd_req_get_hdr_value_len(req, "Custom");
-    if (hdr_len)
+/* The response of a POST handler that queued a job: 202 with the job id and its status URI.
+ * If the queue is full, the settings are already stored, the client may retry the side effect later.
+ */
+static esp_err_t send_job_accepted(httpd_req_t *req, uint32_t job_id)
+{
+    if (job_id == 0)
     {
-        //Read Custom header value
-        req_hdr = (char*)malloc(hdr_len + 1);
-        if (!req_hdr)
-        {
-            ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", hdr_len + 1);
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
-        }
-        httpd_req_get_hdr_value_str(req, "Custom", req_hdr, hdr_len + 1);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, "The job queue is full", HTTPD_RESP_USE_STRLEN);
+    }
+    char location[32];
+    snprintf(location, sizeof(location), "/api/v1/jobs?id=%" PRIu32, job_id);
+    httpd_resp_set_status(req, "202 Accepted");
+    httpd_resp_set_hdr(req, "Location", location);
+    return send_config_json(req, job_id);
+}
 
-        //Set as additional header for response packet
-        httpd_resp_set_hdr(req, "Custom", req_hdr);
+static esp_err_t submit_wifi(httpd_req_t *req, const Form_fields* form)
+{
+    const char* ssid = form_get(form, "ssid");
+    const char* pass = form_get(form, "password");
+    if (ssid == NULL || pass == NULL)
+    {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ssid and password are required");
+        return ESP_OK;
     }
-    
-    //Parsing the data regarding the operation mode of the microcontroller
-    if (parse_url(buf, "choosemode") == "auto")
+    ESP_LOGI(TAG, "The SSID has been updated: %s", ssid);
+    ESP_LOGI(TAG, "The password has been updated: ***");
+
+    //The credentials are only usable together, so they are committed in one transaction
+    Config_transaction wifi_config;
+    wifi_config.set_wifi_ssid(ssid);
+    wifi_config.set_wifi_pass(pass);
+    wifi_config.commit();
+
+    //The reconnection takes seconds and drops this connection, the response goes out first
+    return send_job_accepted(req, job_submit(JOB_WIFI_RESTART));
+}
+
+static esp_err_t submit_api_key(httpd_req_t *req, const Form_fields* form)
+{
+    //Storing the Openweathermap API-key, the weather service that gets the data from the API is reconfigured by a job
+    const char* apikey = form_get(form, "apikey");
+    if (apikey != NULL && apikey[0] != '\0')
+    {
+        nvs_write_apikey(apikey);
+        ESP_LOGI(TAG, "The Openweathermap API-key has been updated!");
+        return send_job_accepted(req, job_submit(JOB_WEATHER_RECONFIGURE));
+    }
+    return send_config_json(req);
+}
+
+//Applying the operation mode, desired temperature and window degree fields. The WebSocket commands use it as well.
+void apply_mode_settings(const Form_fields* form)
+{
+    //Parsing the data regarding the operation mode of the microcontroller. JSON clients may use the keys of /api/v1/config.
+    const char* mode = form_get(form, "choosemode");
+    const char* is_auto = form_get(form, "auto");
+    if ((mode != NULL && strcmp(mode, "auto") == 0) || (is_auto != NULL && strcmp(is_auto, "true") == 0))
     {
         Internal_room_data.set_is_auto(true);
         ESP_LOGI(TAG, "The operation mode has been set to automatic!");
         nvs_write_operation_mode(Internal_room_data.get_is_auto());
     }
-    else if (parse_url(buf, "choosemode") == "manual")
+    else if ((mode != NULL && strcmp(mode, "manual") == 0) || (is_auto != NULL && strcmp(is_auto, "false") == 0))
     {
         Internal_room_data.set_is_auto(false);
         ESP_LOGI(TAG, "The operation mode has been set to manual!");
         nvs_write_operation_mode(Internal_room_data.get_is_auto());
     }
-    if (parse_url(buf, "temp") != "")
+    const char* temp = form_get(form, "temp");
+    if (temp == NULL)
+        temp = form_get(form, "desired_temp");
+    if (temp != NULL && temp[0] != '\0')
     {
-        Internal_room_data.set_desired_temperature(stoi(parse_url(buf, "temp")));
+        Internal_room_data.set_desired_temperature(atoi(temp));
         ESP_LOGI(TAG, "Desired temperature has been changed to: %d", Internal_room_data.get_desired_temperature());
         nvs_write_desired_temp(Internal_room_data.get_desired_temperature());
     }
-    if (parse_url(buf, "window") != "")
+    const char* window = form_get(form, "window");
+    if (window == NULL)
+        window = form_get(form, "window_deg");
+    if (window != NULL && window[0] != '\0')
     {
-        Internal_room_data.set_window_deg(stof(parse_url(buf, "window")));
+        Internal_room_data.set_window_deg(atof(window));
         ESP_LOGI(TAG, "Window angle has been changed to : %f", Internal_room_data.get_window_deg());
         nvs_write_window_deg(Internal_room_data.get_window_deg());
     }
-    
-    fill_config_page();
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, response_data, HTTPD_RESP_USE_STRLEN);
-    //End response
-    free (req_hdr);
-    free (buf);
-    return ESP_OK;
+    telemetry_notify(TELEMETRY_ROOM);
 }
 
-static esp_err_t submit_coordinates_post_handler(httpd_req_t *req)
+static esp_err_t submit_mode(httpd_req_t *req, const Form_fields* form)
 {
-    ESP_LOGI(TAG, "/ content length %d", req->content_len);
-
-    char*  buf = (char*)malloc(req->content_len + 1);
-    size_t off = 0;
-    int ret;
-
-    if (!buf)
-    {
-        ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", req->content_len + 1);
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
-
-    while (off < req->content_len)
-    {
-        //Read data received in the request
-        ret = httpd_req_recv(req, buf + off, req->content_len - off);
-        if (ret <= 0) {
-            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-                httpd_resp_send_408(req);
-            }
-            free (buf);
-            return ESP_FAIL;
-        }
-        off += ret;
-        ESP_LOGI(TAG, "/ Recv length %d", ret);
-    }
-    buf[off] = '\0';
-
-    if (req->content_len < 128) {
-        ESP_LOGI(TAG, "/ data: %s", buf);
-    }
-
-    //Search for Custom header field
-    char*  req_hdr = 0;
-    size_t hdr_len = httpd_req_get_hdr_value_len(req, "Custom");
-    if (hdr_len)
-    {
-        //Read Custom header value
-        req_hdr = (char*)malloc(hdr_len + 1);
-        if (!req_hdr)
-        {
-            ESP_LOGE(TAG, "Failed to allocate memory of %d bytes!", hdr_len + 1);
-            httpd_resp_send_500(req);
-            return ESP_FAIL;
-        }
-        httpd_req_get_hdr_value_str(req, "Custom", req_hdr, hdr_len + 1);
+    apply_mode_settings(form);
+    return send_config_json(req);
+}
 
-        //Set as additional header for response packet
-        httpd_resp_set_hdr(req, "Custom", req_hdr);
-    }
-    
+static esp_err_t submit_coordinates(httpd_req_t *req, const Form_fields* form)
+{
     //Parsing the coordinates
-    if (parse_url(buf, "lon") != "" && parse_url(buf, "lat") != "")
+    const char* lat = form_get(form, "lat");
+    const char* lon = form_get(form, "lon");
+    if (lat != NULL && lat[0] != '\0' && lon != NULL && lon[0] != '\0')
     {
-        Weather.set_lat(stof(parse_url(buf, "lat")));
+        Weather.set_lat(atof(lat));
         ESP_LOGI(TAG, "Latitude has been changed to: %f", Weather.get_lat());
-        nvs_write_latitude(Weather.get_lat());
 
-        Weather.set_lon(stof(parse_url(buf, "lon")));
+        Weather.set_lon(atof(lon));
         ESP_LOGI(TAG, "Longitude has been changed to: %f", Weather.get_lon());
-        nvs_write_longitude(Weather.get_lon());
-        //Resetting the weather task
-        vTaskDelete(http_request_task_handle);
-        xTaskCreate(&https_request_task, "https_request_task", 8192, NULL, 5, &http_request_task_handle);
-    }
-    
-    
-    fill_config_page();
-    httpd_resp_set_type(req, "text/html");
-    httpd_resp_send(req, response_data, HTTPD_RESP_USE_STRLEN);
-    //End response
-    free (req_hdr);
-    free (buf);
-    return ESP_OK;
+
+        Config_transaction coordinates;
+        coordinates.set_latitude(Weather.get_lat());
+        coordinates.set_longitude(Weather.get_lon());
+        coordinates.commit();
+        //Reconfiguring the weather service
+        return send_job_accepted(req, job_submit(JOB_WEATHER_RECONFIGURE));
+    }
+    return send_config_json(req);
 }
 
+static const Post_route submit_wifi_route = {submit_wifi, &submit_wifi_latency};
+
 static const httpd_uri_t submit_wifi_post =
 {
     .uri = "/SubmitWiFi",
     .method = HTTP_POST,
-    .handler  = submit_wifi_post_handler,
-    .user_ctx  = NULL,
+    .handler  = post_body_handler,
+    .user_ctx  = (void*)&submit_wifi_route,
     .is_websocket = NULL,
     .handle_ws_control_frames = NULL,
     .supported_subprotocol = NULL
 };
 
+static const Post_route submit_api_key_route = {submit_api_key, &submit_api_key_latency};
+
 static const httpd_uri_t submit_api_key_post =
 {
     .uri = "/SubmitAPI",
     .method = HTTP_POST,
-    .handler  = submit_api_key_post_handler,
-    .user_ctx  = NULL,
+    .handler  = post_body_handler,
+    .user_ctx  = (void*)&submit_api_key_route,
     .is_websocket = NULL,
     .handle_ws_control_frames = NULL,
     .supported_subprotocol = NULL
 };
 
+static const Post_route submit_mode_route = {submit_mode, &submit_mode_latency};
+
 static const httpd_uri_t submit_mode_post =
 {
     .uri = "/SubmitMode",
     .method = HTTP_POST,
-    .handler  = submit_mode_post_handler,
-    .user_ctx  = NULL,
+    .handler  = post_body_handler,
+    .user_ctx  = (void*)&submit_mode_route,
     .is_websocket = NULL,
     .handle_ws_control_frames = NULL,
     .supported_subprotocol = NULL
 };
 
+static const Post_route submit_coordinates_route = {submit_coordinates, &submit_coordinates_latency};
+
 static const httpd_uri_t submit_coordinates_post =
 {
     .uri = "/SubmitCoordinates",
     .method = HTTP_POST,
-    .handler  = submit_coordinates_post_handler,
-    .user_ctx  = NULL,
+    .handler  = post_body_handler,
+    .user_ctx  = (void*)&submit_coordinates_route,
     .is_websocket = NULL,
     .handle_ws_control_frames = NULL,
     .supported_subprotocol = NULL
 };
 
 
+//Returns the handle of the started server, the connect handler keeps it in server
 httpd_handle_t start_webserver(void)
 {
-    httpd_handle_t server = NULL;
+    httpd_handle_t handle = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
+    config.max_open_sockets = HTTP_MAX_OPEN_SOCKETS;
+    config.max_uri_handlers = HTTP_MAX_URI_HANDLERS;
+    config.close_fn = ws_telemetry_close_fn;
+
+    if (http_workers_start(HTTP_WORKER_COUNT) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Every request is served on the httpd task");
+    }
 
     //Start the httpd server
     ESP_LOGI(TAG, "Starting server on port: '%d'", config.server_port);
-    if (httpd_start(&server, &config) == ESP_OK)
+    if (httpd_start(&handle, &config) == ESP_OK)
     {
         //Set URI handlers
         ESP_LOGI(TAG, "Registering URI handlers");
-        httpd_register_uri_handler(server, &root_get);
-        httpd_register_uri_handler(server, &submit_wifi_post);
-        httpd_register_uri_handler(server, &submit_api_key_post);
-        httpd_register_uri_handler(server, &submit_mode_post);
-        httpd_register_uri_handler(server, &submit_coordinates_post);
-        return server;
+        for (size_t i = 0; i < sizeof(web_assets) / sizeof(web_assets[0]); i++)
+        {
+            httpd_uri_t asset_get =
+            {
+                .uri = web_assets[i].uri,
+                .method = HTTP_GET,
+                .handler = web_asset_get_handler,
+                .user_ctx = &web_assets[i],
+                .is_websocket = NULL,
+                .handle_ws_control_frames = NULL,
+                .supported_subprotocol = NULL
+            };
+            httpd_register_uri_handler(handle, &asset_get);
+        }
+        httpd_register_uri_handler(handle, &config_json_get);
+        httpd_register_uri_handler(handle, &status_json_get);
+        httpd_register_uri_handler(handle, &jobs_json_get);
+        httpd_register_uri_handler(handle, &forecast_json_get);
+        httpd_register_uri_handler(handle, &metrics_get);
+        ws_telemetry_register(handle);
+        httpd_register_uri_handler(handle, &submit_wifi_post);
+        httpd_register_uri_handler(handle, &submit_api_key_post);
+        httpd_register_uri_handler(handle, &submit_mode_post);
+        httpd_register_uri_handler(handle, &submit_coordinates_post);
+        return handle;
     }
 
     ESP_LOGI(TAG, "Error starting server!");
     return NULL;
 }
 
-static esp_err_t stop_webserver(httpd_handle_t server)
+static esp_err_t stop_webserver(httpd_handle_t handle)
 {
-    //Stop the httpd server
-    return httpd_ssl_stop(server);
+    //Stop the httpd server, after the deferred requests are done
+    http_workers_stop();
+    ws_telemetry_stop();
+    return httpd_ssl_stop(handle);
 }
 
 void disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
-    httpd_handle_t* server = (httpd_handle_t*) arg;
-    if (*server)
+    httpd_handle_t* handle = (httpd_handle_t*) arg;
+    if (*handle)
     {
-        if (stop_webserver(*server) == ESP_OK)
+        if (stop_webserver(*handle) == ESP_OK)
         {
-            *server = NULL;
+            *handle = NULL;
         }
         else
         {
@@ -570,9 +973,9 @@ void disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id
 
 void connect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
 {
-    httpd_handle_t* server = (httpd_handle_t*) arg;
-    if (*server == NULL)
+    httpd_handle_t* handle = (httpd_handle_t*) arg;
+    if (*handle == NULL)
     {
-        *server = start_webserver();
+        *handle = start_webserver();
     }
 }
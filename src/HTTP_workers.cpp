@@ -0,0 +1,128 @@
+/* This module is the pool of worker tasks of the webserver. The httpd task only parses the requests and
+ * hands the slow ones over (the static files and the JSON endpoints), so a slow client or a file read from SPIFFS
+ * doesn't hold up the other connections. Work is only accepted by an idle worker, it never waits in the queue
+ * behind a busy one: the caller does it itself instead. (Waiting for a worker measured slower on bench_http_workers,
+ * the quick JSON requests got stuck behind the file transfers.)
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "HTTP_workers.h"
+
+static const char *TAG = "HTTP_WORKERS";
+
+struct Http_work
+{
+    http_work_fn_t work;    //NULL stops the worker
+    void* arg;
+    void* context;
+};
+
+static QueueHandle_t work_queue = NULL;
+static TaskHandle_t worker_handles[HTTP_WORKER_MAX_COUNT];
+static int worker_count = 0;
+static int idle_workers = 0;
+static bool accepting = false;
+static portMUX_TYPE idle_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t stopping_task = NULL;
+
+static void http_worker_task(void *params)
+{
+    Http_work work;
+    while (true)
+    {
+        xQueueReceive(work_queue, &work, portMAX_DELAY);
+        if (work.work == NULL)
+            break;
+        work.work(work.arg, work.context);
+
+        taskENTER_CRITICAL(&idle_lock);
+        idle_workers++;
+        taskEXIT_CRITICAL(&idle_lock);
+    }
+    xTaskNotifyGive(stopping_task);
+    vTaskDelete(NULL);
+}
+
+esp_err_t http_workers_start(int count)
+{
+    if (work_queue != NULL || count <= 0)
+        return ESP_OK;
+    if (count > HTTP_WORKER_MAX_COUNT)
+        count = HTTP_WORKER_MAX_COUNT;
+
+    //A slot for every worker, so accepted work never blocks the caller
+    work_queue = xQueueCreate(count, sizeof(Http_work));
+    if (work_queue == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create the work queue");
+        return ESP_ERR_NO_MEM;
+    }
+    for (worker_count = 0; worker_count < count; worker_count++)
+    {
+        if (xTaskCreate(&http_worker_task, "http_worker", HTTP_WORKER_STACK_SIZE, NULL, HTTP_WORKER_PRIORITY,
+                        &worker_handles[worker_count]) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Failed to create worker %d", worker_count);
+            break;
+        }
+    }
+    taskENTER_CRITICAL(&idle_lock);
+    idle_workers = worker_count;
+    accepting = true;
+    taskEXIT_CRITICAL(&idle_lock);
+    ESP_LOGI(TAG, "%d worker(s) started", worker_count);
+    return worker_count > 0 ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void http_workers_stop()
+{
+    if (work_queue == NULL)
+        return;
+
+    //Nothing is accepted from now on, the stop requests queue up behind the running work
+    taskENTER_CRITICAL(&idle_lock);
+    accepting = false;
+    taskEXIT_CRITICAL(&idle_lock);
+    stopping_task = xTaskGetCurrentTaskHandle();
+    Http_work stop = {NULL, NULL, NULL};
+    for (int i = 0; i < worker_count; i++)
+        xQueueSend(work_queue, &stop, portMAX_DELAY);
+    for (int i = 0; i < worker_count; i++)
+        ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+    vQueueDelete(work_queue);
+    work_queue = NULL;
+    worker_count = 0;
+    ESP_LOGI(TAG, "Workers stopped");
+}
+
+bool http_workers_submit(http_work_fn_t work, void* arg, void* context)
+{
+    bool accepted = false;
+    taskENTER_CRITICAL(&idle_lock);
+    if (accepting && idle_workers > 0)
+    {
+        idle_workers--;
+        accepted = true;
+    }
+    taskEXIT_CRITICAL(&idle_lock);
+    if (!accepted)
+        return false;
+
+    Http_work item = {work, arg, context};
+    xQueueSend(work_queue, &item, portMAX_DELAY);
+    return true;
+}
+
+bool http_worker_is_current()
+{
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < worker_count; i++)
+    {
+        if (worker_handles[i] == current)
+            return true;
+    }
+    return false;
+}
@@ -1,12 +1,17 @@
 /* This module is responsible for parsing the data requested from the Openweathermap API.
- * The server responds by sending the data in JSON format, which is then parsed using cJSON.
+ * The response is parsed while it is received: the bytes of every TLS read go through the HTTP layer of
+ * http_response.cpp, which checks the status and removes the framing, and the JSON body is tokenized by a state machine.
+ * Only the values that Weather_data stores are copied into a Weather_report, nothing else of the response is kept.
  */
 
 #include "esp_log.h"
-#include "cJSON.h"
 #include "weather_data.h"
-#include <string>
+#include "WS_telemetry.h"
+#include "JSON_parser.h"
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <string>
 #include <vector>
 
 using namespace std;
@@ -15,141 +20,608 @@ extern Weather_data Weather;
 
 static const char *TAG = "JSON_PARSER";
 
-void parse_weather_json(string response_string)
-{   
-    cJSON *current_JSON = NULL;
-    cJSON *current_temp_JSON = NULL, *current_pressure = NULL, *current_humidity_JSON = NULL, *current_wind_speed_JSON = NULL, *current_wind_deg_JSON = NULL;
-    cJSON *current_weathers_JSON = NULL, *current_weather = NULL, *current_weather_id_JSON = NULL;
-    cJSON *alerts_JSON = NULL, *alert_JSON = NULL, *alert_event_JSON = NULL, *alert_description_JSON = NULL;
+enum Parser_state
+{
+    PARSER_VALUE,               //The first state of the body
+    PARSER_VALUE_OR_END,        //After '['
+    PARSER_KEY_OR_END,          //After '{'
+    PARSER_KEY,                 //After ',' in an object
+    PARSER_COLON,
+    PARSER_STRING,
+    PARSER_NUMBER,
+    PARSER_LITERAL,
+    PARSER_AFTER_VALUE,
+    PARSER_DONE
+};
+
+enum String_state
+{
+    STRING_CHARS,
+    STRING_ESCAPE,
+    STRING_UNICODE
+};
+
+//What a container is, derived from its parent and its key. The highest bit marks the arrays.
+enum Parser_context
+{
+    CONTEXT_OTHER,
+    CONTEXT_ROOT,
+    CONTEXT_CURRENT,
+    CONTEXT_WEATHER_ITEM,
+    CONTEXT_ALERT_ITEM,
+    CONTEXT_HOURLY_ITEM,
+    CONTEXT_HOURLY_WEATHER_ITEM,
+    CONTEXT_DAILY_ITEM,
+    CONTEXT_DAILY_TEMP,
+    CONTEXT_DAILY_WEATHER_ITEM,
+    CONTEXT_WEATHER_ARRAY = 0x80 | 1,
+    CONTEXT_ALERTS_ARRAY = 0x80 | 2,
+    CONTEXT_HOURLY_ARRAY = 0x80 | 3,
+    CONTEXT_HOURLY_WEATHER_ARRAY = 0x80 | 4,
+    CONTEXT_DAILY_ARRAY = 0x80 | 5,
+    CONTEXT_DAILY_WEATHER_ARRAY = 0x80 | 6,
+    CONTEXT_OTHER_ARRAY = 0x80
+};
+
+#define CONTEXT_IS_ARRAY(context) (((context) & 0x80) != 0)
 
-    char *response = (char*)malloc(4096+1);
-    if (response == NULL)
+void weather_parser_init(Weather_parser* parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    http_response_init(&parser->http);
+    weather_forecast_init(&parser->report.forecast);
+    parser->state = PARSER_VALUE;
+    parser->forecast_slot = -1;
+}
+
+static uint8_t get_parent_context(const Weather_parser* parser)
+{
+    return parser->depth > 0 ? parser->contexts[parser->depth - 1] : (uint8_t)CONTEXT_OTHER;
+}
+
+//The containers of the "hourly" and "daily" arrays. An entry gets its slot at its "dt", which is its first key.
+static uint8_t get_forecast_context(Weather_parser* parser, uint8_t parent, bool is_array)
+{
+    if (is_array && parent == CONTEXT_ROOT && strcmp(parser->key, "hourly") == 0)
     {
-        ESP_LOGE(TAG, "Failed to allocate memory.");
-        return;
+        parser->report.fields |= WEATHER_FIELD_HOURLY;
+        return CONTEXT_HOURLY_ARRAY;
+    }
+    if (is_array && parent == CONTEXT_ROOT && strcmp(parser->key, "daily") == 0)
+    {
+        parser->report.fields |= WEATHER_FIELD_DAILY;
+        return CONTEXT_DAILY_ARRAY;
+    }
+    if (!is_array && (parent == CONTEXT_HOURLY_ARRAY || parent == CONTEXT_DAILY_ARRAY))
+    {
+        parser->forecast_slot = -1;
+        return parent == CONTEXT_HOURLY_ARRAY ? CONTEXT_HOURLY_ITEM : CONTEXT_DAILY_ITEM;
     }
+    if (is_array && parent == CONTEXT_HOURLY_ITEM && strcmp(parser->key, "weather") == 0)
+        return CONTEXT_HOURLY_WEATHER_ARRAY;
+    if (is_array && parent == CONTEXT_DAILY_ITEM && strcmp(parser->key, "weather") == 0)
+        return CONTEXT_DAILY_WEATHER_ARRAY;
+    if (!is_array && parent == CONTEXT_HOURLY_WEATHER_ARRAY)
+        return CONTEXT_HOURLY_WEATHER_ITEM;
+    if (!is_array && parent == CONTEXT_DAILY_WEATHER_ARRAY)
+        return CONTEXT_DAILY_WEATHER_ITEM;
+    if (!is_array && parent == CONTEXT_DAILY_ITEM && strcmp(parser->key, "temp") == 0)
+        return CONTEXT_DAILY_TEMP;
+    return is_array ? CONTEXT_OTHER_ARRAY : CONTEXT_OTHER;
+}
 
-    
-    size_t location = response_string.find("\r\n\r\n"); //Finding the location of the JSON data
-    response_string = response_string.substr(location, response_string.length() - 1); 
-    strcpy(response, response_string.c_str());
-    cJSON *openweathermap_data = cJSON_Parse(response); //Parsing the JSON content from the HTTP response. 
-    free(response);
-    if (openweathermap_data == NULL)
+static uint8_t get_container_context(Weather_parser* parser, bool is_array)
+{
+    uint8_t parent = get_parent_context(parser);
+    if (parser->depth == 0)
+        return is_array ? CONTEXT_OTHER_ARRAY : CONTEXT_ROOT;
+    if (!is_array && parent == CONTEXT_ROOT && strcmp(parser->key, "current") == 0)
+        return CONTEXT_CURRENT;
+    if (is_array && parent == CONTEXT_CURRENT && strcmp(parser->key, "weather") == 0)
     {
-        ESP_LOGE(TAG, "%s",cJSON_GetErrorPtr() );
-        ESP_LOGE(TAG, "Failed to get the JSON file from Openweathermap.");
-        goto json_parse_end;
+        parser->report.fields |= WEATHER_FIELD_WEATHER;
+        return CONTEXT_WEATHER_ARRAY;
     }
-   
-    current_JSON = cJSON_GetObjectItem(openweathermap_data, "current");
-    if (!cJSON_IsObject(current_JSON))
-        ESP_LOGE(TAG, "Failed to get current weather data.");
-    
-    //Copying the data to an object member by member using a class Setter.
-    current_temp_JSON = cJSON_GetObjectItem(current_JSON, "temp");
-    if (cJSON_IsNumber(current_temp_JSON) )
+    if (is_array && parent == CONTEXT_ROOT && strcmp(parser->key, "alerts") == 0)
     {
-        ESP_LOGI(TAG, "Current temperature: %f", current_temp_JSON -> valuedouble);
-        Weather.set_temp(current_temp_JSON -> valuedouble);
+        parser->report.fields |= WEATHER_FIELD_ALERTS;
+        return CONTEXT_ALERTS_ARRAY;
     }
-    else
-        ESP_LOGE(TAG, "Failed to get current_JSON temperature.");
-    
-    current_pressure = cJSON_GetObjectItem(current_JSON, "pressure");
-    if (cJSON_IsNumber(current_pressure) )
+    if (!is_array && parent == CONTEXT_WEATHER_ARRAY)
+        return CONTEXT_WEATHER_ITEM;
+    if (!is_array && parent == CONTEXT_ALERTS_ARRAY)
     {
-        ESP_LOGI(TAG, "Current pressure: %d", current_pressure -> valueint);
-        Weather.set_pressure(current_pressure -> valueint);
+        parser->report.alert_count++;
+        return CONTEXT_ALERT_ITEM;
     }
-    else
-        ESP_LOGE(TAG, "Failed to get current_JSON pressure.");
-    
-    current_humidity_JSON = cJSON_GetObjectItem(current_JSON, "humidity");
-    if (cJSON_IsNumber(current_humidity_JSON) )
+    return get_forecast_context(parser, parent, is_array);
+}
+
+static bool open_container(Weather_parser* parser, bool is_array)
+{
+    if (parser->depth >= WEATHER_PARSER_MAX_DEPTH)
+        return false;
+    parser->contexts[parser->depth] = get_container_context(parser, is_array);
+    parser->depth++;
+    parser->state = is_array ? PARSER_VALUE_OR_END : PARSER_KEY_OR_END;
+    return true;
+}
+
+static bool close_container(Weather_parser* parser, bool is_array)
+{
+    if (parser->depth == 0 || CONTEXT_IS_ARRAY(parser->contexts[parser->depth - 1]) != is_array)
+        return false;
+    parser->depth--;
+    parser->state = parser->depth == 0 ? PARSER_DONE : PARSER_AFTER_VALUE;
+    return true;
+}
+
+//The string values that are kept are the events and the descriptions of the alerts
+static void begin_string(Weather_parser* parser, bool is_key)
+{
+    parser->is_key = is_key;
+    parser->string_state = STRING_CHARS;
+    parser->string = NULL;
+    if (is_key)
     {
-        ESP_LOGI(TAG, "Current humidity: %d", current_humidity_JSON -> valueint);
-        Weather.set_humidity(current_humidity_JSON -> valueint);
+        parser->key_length = 0;
+        parser->key[0] = '\0';
     }
-    else
-        ESP_LOGE(TAG, "Failed to get current_JSON humidity.");
+    else if (get_parent_context(parser) == CONTEXT_ALERT_ITEM && parser->report.alert_count <= WEATHER_PARSER_MAX_ALERTS)
+    {
+        int alert = parser->report.alert_count - 1;
+        if (strcmp(parser->key, "event") == 0)
+        {
+            parser->string = parser->report.alert_events[alert];
+            parser->string_size = sizeof(parser->report.alert_events[alert]);
+        }
+        else if (strcmp(parser->key, "description") == 0)
+        {
+            parser->string = parser->report.alert_descriptions[alert];
+            parser->string_size = sizeof(parser->report.alert_descriptions[alert]);
+        }
+    }
+    parser->string_length = 0;
+    parser->state = PARSER_STRING;
+}
 
-    current_wind_speed_JSON = cJSON_GetObjectItem(current_JSON, "wind_speed");
-    if (cJSON_IsNumber(current_wind_speed_JSON) )
+static void append_string_char(Weather_parser* parser, char c)
+{
+    if (parser->is_key)
     {
-        ESP_LOGI(TAG, "Current wind speed: %f", current_wind_speed_JSON -> valuedouble);
-        Weather.set_wind_speed(current_wind_speed_JSON -> valuedouble);
+        //A key that doesn't fit can't be one of the extracted keys, it is emptied
+        if (parser->key_length < sizeof(parser->key) - 1)
+        {
+            parser->key[parser->key_length++] = c;
+            parser->key[parser->key_length] = '\0';
+        }
+        else
+        {
+            parser->key[0] = '\0';
+        }
     }
-    else
-        ESP_LOGE(TAG, "Failed to get current_JSON wind speed.");
+    else if (parser->string != NULL && parser->string_length < parser->string_size - 1)
+    {
+        parser->string[parser->string_length++] = c;
+        parser->string[parser->string_length] = '\0';
+    }
+}
 
-    current_wind_deg_JSON = cJSON_GetObjectItem(current_JSON, "wind_deg");
-    if (cJSON_IsNumber(current_wind_deg_JSON) )
+//Encoding a \uXXXX escape as UTF-8. The halves of the surrogate pairs are replaced.
+static void append_unicode(Weather_parser* parser, uint32_t code_point)
+{
+    if (code_point < 0x80)
     {
-        ESP_LOGI(TAG, "Current wind direction: %d", current_wind_deg_JSON -> valueint);
-        Weather.set_wind_deg(current_wind_deg_JSON -> valueint);
+        append_string_char(parser, (char)code_point);
+    }
+    else if (code_point < 0x800)
+    {
+        append_string_char(parser, (char)(0xC0 | (code_point >> 6)));
+        append_string_char(parser, (char)(0x80 | (code_point & 0x3F)));
+    }
+    else if (code_point >= 0xD800 && code_point <= 0xDFFF)
+    {
+        append_string_char(parser, '?');
     }
-    else
-        ESP_LOGE(TAG, "Failed to get current_JSON wind direction.");
-    
-    /*Because Openweathermap describes the weather by using multiple weather types if necessary, we store the weather IDs
-     * and descriptions using vectors, which are dynamic arrays.
-     */
-    current_weathers_JSON = cJSON_GetObjectItem(current_JSON, "weather");
-    if (!cJSON_IsArray(current_weathers_JSON) )
-        ESP_LOGE(TAG, "Failed to get weather description.");
     else
     {
-        vector<int> temp_id;
-        ESP_LOGI(TAG, "Weather count: %d", cJSON_GetArraySize(current_weathers_JSON) );
-        cJSON_ArrayForEach(current_weather, current_weathers_JSON)
+        append_string_char(parser, (char)(0xE0 | (code_point >> 12)));
+        append_string_char(parser, (char)(0x80 | ((code_point >> 6) & 0x3F)));
+        append_string_char(parser, (char)(0x80 | (code_point & 0x3F)));
+    }
+}
+
+static void end_string(Weather_parser* parser)
+{
+    parser->state = parser->is_key ? PARSER_COLON : PARSER_AFTER_VALUE;
+}
+
+static bool string_char(Weather_parser* parser, char c)
+{
+    if (parser->string_state == STRING_ESCAPE)
+    {
+        static const char escapes[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+        parser->string_state = STRING_CHARS;
+        if (c == 'u')
+        {
+            parser->string_state = STRING_UNICODE;
+            parser->unicode = 0;
+            parser->unicode_digits = 0;
+            return true;
+        }
+        for (size_t i = 0; i < sizeof(escapes) - 1; i += 2)
         {
-            current_weather_id_JSON = cJSON_GetObjectItem(current_weather, "id");
-            if (cJSON_IsNumber(current_weather_id_JSON) )
+            if (escapes[i] == c)
             {
-                ESP_LOGI(TAG, "Weather id: %d", current_weather_id_JSON -> valueint);
-                temp_id.push_back(current_weather_id_JSON -> valueint);
+                append_string_char(parser, escapes[i + 1]);
+                return true;
             }
-            else
-                ESP_LOGE(TAG, "Failed to get weather id.");
         }
-        Weather.set_weather_id(temp_id);
+        return false;
     }
-    //We do similarly with weather alerts.
-    alerts_JSON = cJSON_GetObjectItem(openweathermap_data, "alerts");
-    if (alerts_JSON == NULL)
+    if (parser->string_state == STRING_UNICODE)
     {
-        ESP_LOGI(TAG, "No weather alerts at the moment.");
+        int digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+        parser->unicode = (parser->unicode << 4) | digit;
+        if (++parser->unicode_digits == 4)
+        {
+            append_unicode(parser, parser->unicode);
+            parser->string_state = STRING_CHARS;
+        }
+        return true;
     }
-    else if (!cJSON_IsArray(alerts_JSON) )
-        ESP_LOGE(TAG, "Failed to get weather alerts");
+    if (c == '"')
+        end_string(parser);
+    else if (c == '\\')
+        parser->string_state = STRING_ESCAPE;
+    else if ((unsigned char)c < 0x20)
+        return false;
     else
+        append_string_char(parser, c);
+    return true;
+}
+
+//Storing a number of an hourly entry, as fixed point
+static void store_hourly_number(Weather_parser* parser, uint8_t context, double value)
+{
+    Hourly_forecast* hourly = &parser->report.forecast.hourly;
+    if (context == CONTEXT_HOURLY_ITEM && strcmp(parser->key, "dt") == 0)
     {
-        vector<string> temp_event, temp_description;
-        ESP_LOGI(TAG, "Alert count: %d", cJSON_GetArraySize(alerts_JSON) );
-        cJSON_ArrayForEach(alert_JSON, alerts_JSON)
+        parser->forecast_slot = forecast_ring_push(&hourly->ring, (int64_t)value);
+        return;
+    }
+    int slot = parser->forecast_slot;
+    if (slot < 0)
+        return;
+    if (context == CONTEXT_HOURLY_WEATHER_ITEM)
+    {
+        //Only the first, the primary condition is kept
+        if (strcmp(parser->key, "id") == 0 && hourly->weather[slot] == 0)
+            hourly->weather[slot] = weather_id_pack((int)value);
+    }
+    else if (strcmp(parser->key, "temp") == 0)
+        hourly->temp[slot] = forecast_to_fixed(value, FORECAST_TEMP_SCALE);
+    else if (strcmp(parser->key, "wind_speed") == 0)
+        hourly->wind_speed[slot] = forecast_to_fixed(value, FORECAST_WIND_SCALE);
+    else if (strcmp(parser->key, "humidity") == 0)
+        hourly->humidity[slot] = (uint8_t)value;
+    else if (strcmp(parser->key, "pop") == 0)
+        hourly->pop[slot] = (uint8_t)lround(value * 100);
+}
+
+static void store_daily_number(Weather_parser* parser, uint8_t context, double value)
+{
+    Daily_forecast* daily = &parser->report.forecast.daily;
+    if (context == CONTEXT_DAILY_ITEM && strcmp(parser->key, "dt") == 0)
+    {
+        parser->forecast_slot = forecast_ring_push(&daily->ring, (int64_t)value);
+        return;
+    }
+    int slot = parser->forecast_slot;
+    if (slot < 0)
+        return;
+    if (context == CONTEXT_DAILY_WEATHER_ITEM)
+    {
+        if (strcmp(parser->key, "id") == 0 && daily->weather[slot] == 0)
+            daily->weather[slot] = weather_id_pack((int)value);
+    }
+    else if (context == CONTEXT_DAILY_TEMP)
+    {
+        if (strcmp(parser->key, "min") == 0)
+            daily->temp_min[slot] = forecast_to_fixed(value, FORECAST_TEMP_SCALE);
+        else if (strcmp(parser->key, "max") == 0)
+            daily->temp_max[slot] = forecast_to_fixed(value, FORECAST_TEMP_SCALE);
+    }
+    else if (strcmp(parser->key, "wind_speed") == 0)
+        daily->wind_speed[slot] = forecast_to_fixed(value, FORECAST_WIND_SCALE);
+    else if (strcmp(parser->key, "humidity") == 0)
+        daily->humidity[slot] = (uint8_t)value;
+    else if (strcmp(parser->key, "pop") == 0)
+        daily->pop[slot] = (uint8_t)lround(value * 100);
+}
+
+//Storing a number if its container and key are one of the extracted fields
+static void end_number(Weather_parser* parser)
+{
+    Weather_report* report = &parser->report;
+    uint8_t context = get_parent_context(parser);
+    parser->number[parser->number_length] = '\0';
+    double value = strtod(parser->number, NULL);
+    parser->state = PARSER_AFTER_VALUE;
+
+    if (context == CONTEXT_CURRENT)
+    {
+        if (strcmp(parser->key, "temp") == 0)
+        {
+            report->temp = value;
+            report->fields |= WEATHER_FIELD_TEMP;
+        }
+        else if (strcmp(parser->key, "pressure") == 0)
+        {
+            report->pressure = (int)value;
+            report->fields |= WEATHER_FIELD_PRESSURE;
+        }
+        else if (strcmp(parser->key, "humidity") == 0)
+        {
+            report->humidity = (int)value;
+            report->fields |= WEATHER_FIELD_HUMIDITY;
+        }
+        else if (strcmp(parser->key, "wind_speed") == 0)
         {
-            alert_event_JSON = cJSON_GetObjectItem(alert_JSON, "event");
-            if (cJSON_IsString(alert_event_JSON) )
+            report->wind_speed = value;
+            report->fields |= WEATHER_FIELD_WIND_SPEED;
+        }
+        else if (strcmp(parser->key, "wind_deg") == 0)
+        {
+            report->wind_deg = (int)value;
+            report->fields |= WEATHER_FIELD_WIND_DEG;
+        }
+    }
+    else if (context == CONTEXT_ROOT && strcmp(parser->key, "timezone_offset") == 0)
+    {
+        report->timezone_offset = (int)value;
+        report->fields |= WEATHER_FIELD_TIMEZONE_OFFSET;
+    }
+    else if (context == CONTEXT_WEATHER_ITEM && strcmp(parser->key, "id") == 0
+             && report->weather_id_count < WEATHER_SNAPSHOT_MAX_IDS)
+    {
+        report->weather_ids[report->weather_id_count++] = (int)value;
+    }
+    else if (context == CONTEXT_HOURLY_ITEM || context == CONTEXT_HOURLY_WEATHER_ITEM)
+    {
+        store_hourly_number(parser, context, value);
+    }
+    else if (context == CONTEXT_DAILY_ITEM || context == CONTEXT_DAILY_TEMP || context == CONTEXT_DAILY_WEATHER_ITEM)
+    {
+        store_daily_number(parser, context, value);
+    }
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool begin_value(Weather_parser* parser, char c)
+{
+    if (c == '{' || c == '[')
+        return open_container(parser, c == '[');
+    if (c == '"')
+    {
+        begin_string(parser, false);
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9'))
+    {
+        parser->number[0] = c;
+        parser->number_length = 1;
+        parser->state = PARSER_NUMBER;
+        return true;
+    }
+    if (c == 't' || c == 'f' || c == 'n')
+    {
+        parser->state = PARSER_LITERAL;
+        return true;
+    }
+    return false;
+}
+
+/* Processing one character of the JSON body. Returns false if the body is invalid.
+ * The end of a number or a literal is only seen at the next character, which is processed again.
+ */
+static bool parse_char(Weather_parser* parser, char c, bool* consumed)
+{
+    *consumed = true;
+    switch (parser->state)
+    {
+        case PARSER_VALUE:
+            return is_space(c) || begin_value(parser, c);
+        case PARSER_VALUE_OR_END:
+            if (c == ']')
+                return close_container(parser, true);
+            return is_space(c) || begin_value(parser, c);
+        case PARSER_KEY_OR_END:
+            if (c == '}')
+                return close_container(parser, false);
+            //Fall through
+        case PARSER_KEY:
+            if (c == '"')
             {
-                ESP_LOGI(TAG, "Alert event: %s", alert_event_JSON -> valuestring);
-                temp_event.push_back(alert_event_JSON -> valuestring);
+                begin_string(parser, true);
+                return true;
             }
-            else
-                ESP_LOGE(TAG, "Failed to get alert.");
-            alert_description_JSON = cJSON_GetObjectItem(alert_JSON, "description");
-            if (cJSON_IsString(alert_description_JSON) )
+            return is_space(c);
+        case PARSER_COLON:
+            if (c == ':')
             {
-                ESP_LOGI(TAG, "Alert description: %s", alert_description_JSON -> valuestring);
-                temp_description.push_back(alert_description_JSON -> valuestring);
+                parser->state = PARSER_VALUE;
+                return true;
             }
-            else
-                ESP_LOGE(TAG, "Failed to get alert description.");
-        }
-        Weather.set_alert_event(temp_event);
-        Weather.set_alert_description(temp_description);
+            return is_space(c);
+        case PARSER_STRING:
+            return string_char(parser, c);
+        case PARSER_NUMBER:
+            if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+            {
+                if (parser->number_length >= sizeof(parser->number) - 1)
+                    return false;
+                parser->number[parser->number_length++] = c;
+                return true;
+            }
+            end_number(parser);
+            *consumed = false;
+            return true;
+        case PARSER_LITERAL:
+            if (c >= 'a' && c <= 'z')
+                return true;
+            parser->state = PARSER_AFTER_VALUE;
+            *consumed = false;
+            return true;
+        case PARSER_AFTER_VALUE:
+            if (c == ',')
+            {
+                parser->state = CONTEXT_IS_ARRAY(get_parent_context(parser)) ? PARSER_VALUE : PARSER_KEY;
+                return true;
+            }
+            if (c == '}' || c == ']')
+                return close_container(parser, c == ']');
+            return is_space(c);
+        case PARSER_DONE:
+            return true;
+    }
+    return false;
+}
+
+static bool parse_json(Weather_parser* parser, const char* data, size_t length)
+{
+    size_t i = 0;
+    while (i < length)
+    {
+        bool consumed;
+        if (!parse_char(parser, data[i], &consumed))
+            return false;
+        if (consumed)
+            i++;
+    }
+    return true;
+}
+
+bool weather_parser_feed(Weather_parser* parser, const char* data, size_t length)
+{
+    size_t i = 0;
+    while (!parser->failed && i < length)
+    {
+        const char* body;
+        size_t body_length;
+        i += http_response_feed(&parser->http, data + i, length - i, &body, &body_length);
+        if (parser->http.failed || (body_length > 0 && !parse_json(parser, body, body_length)))
+            parser->failed = true;
+    }
+    return !parser->failed;
+}
+
+bool weather_parser_is_complete(const Weather_parser* parser)
+{
+    return http_response_is_complete(&parser->http);
+}
+
+bool weather_parser_finish(Weather_parser* parser)
+{
+    if (parser->http.status != 0 && !http_response_is_success(&parser->http))
+        ESP_LOGE(TAG, "Openweathermap answered with HTTP status %d", parser->http.status);
+    else if (parser->failed)
+        ESP_LOGE(TAG, "Invalid response from Openweathermap, HTTP status %d", parser->http.status);
+    else if (parser->state != PARSER_DONE)
+        ESP_LOGE(TAG, "The response from Openweathermap is incomplete, HTTP status %d", parser->http.status);
+    return http_response_is_success(&parser->http) && !parser->failed && parser->state == PARSER_DONE;
+}
+
+void apply_weather_report(const Weather_report* report, int64_t server_date)
+{
+    //The readers must not see half of a response
+    Weather.lock();
+    if (report->fields & WEATHER_FIELD_TEMP)
+    {
+        ESP_LOGI(TAG, "Current temperature: %f", report->temp);
+        Weather.set_temp(report->temp);
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get current temperature.");
+
+    if (report->fields & WEATHER_FIELD_PRESSURE)
+    {
+        ESP_LOGI(TAG, "Current pressure: %d", report->pressure);
+        Weather.set_pressure(report->pressure);
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get current pressure.");
+
+    if (report->fields & WEATHER_FIELD_HUMIDITY)
+    {
+        ESP_LOGI(TAG, "Current humidity: %d", report->humidity);
+        Weather.set_humidity(report->humidity);
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get current humidity.");
+
+    if (report->fields & WEATHER_FIELD_WIND_SPEED)
+    {
+        ESP_LOGI(TAG, "Current wind speed: %f", report->wind_speed);
+        Weather.set_wind_speed(report->wind_speed);
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get current wind speed.");
+
+    if (report->fields & WEATHER_FIELD_WIND_DEG)
+    {
+        ESP_LOGI(TAG, "Current wind direction: %d", report->wind_deg);
+        Weather.set_wind_deg(report->wind_deg);
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get current wind direction.");
+
+    if (report->fields & WEATHER_FIELD_TIMEZONE_OFFSET)
+        Weather.set_timezone_offset(report->timezone_offset);
+
+    //Excluded from the request, the forecast of the former responses runs out by itself
+    if (report->fields & (WEATHER_FIELD_HOURLY | WEATHER_FIELD_DAILY))
+    {
+        ESP_LOGI(TAG, "Forecast: %d hours, %d days", report->forecast.hourly.ring.count, report->forecast.daily.ring.count);
+        Weather.set_forecast(&report->forecast);
+    }
+
+    if (report->fields & WEATHER_FIELD_WEATHER)
+    {
+        ESP_LOGI(TAG, "Weather count: %d", report->weather_id_count);
+        Weather.set_weather_id(vector<int>(report->weather_ids, report->weather_ids + report->weather_id_count));
+    }
+    else
+        ESP_LOGE(TAG, "Failed to get weather description.");
+
+    //A response without alerts clears the former ones
+    vector<string> events, descriptions;
+    int stored_alerts = report->alert_count < WEATHER_PARSER_MAX_ALERTS ? report->alert_count : WEATHER_PARSER_MAX_ALERTS;
+    if (stored_alerts == 0)
+        ESP_LOGI(TAG, "No weather alerts at the moment.");
+    else
+        ESP_LOGI(TAG, "Alert count: %d", report->alert_count);
+    for (int i = 0; i < stored_alerts; i++)
+    {
+        ESP_LOGI(TAG, "Alert event: %s", report->alert_events[i]);
+        events.push_back(report->alert_events[i]);
+        descriptions.push_back(report->alert_descriptions[i]);
     }
-    json_parse_end:
-    cJSON_Delete(openweathermap_data);
-    
-}
\ No newline at end of file
+    Weather.set_alert_event(events);
+    Weather.set_alert_description(descriptions);
+    Weather.set_fetched(server_date);
+    Weather.unlock();
+    telemetry_notify(TELEMETRY_WEATHER);
+}
@@ -14,6 +14,8 @@
 #include "weather_data.h"
 #include "credentials.h"
 #include "store_data.h"
+#include "WS_telemetry.h"
+#include "metrics.h"
 
 #define LED_PIN GPIO_NUM_2
 
@@ -29,6 +31,19 @@ extern Weather_data Weather;
 esp_mqtt_client_handle_t client = NULL;
 void Publisher_Task(void *params);
 
+#define MQTT_PUBLISH_HELP "MQTT messages handed to the client, by result."
+static Metric_counter publish_ok("mqtt_publish_total", MQTT_PUBLISH_HELP, "result=\"ok\"");
+static Metric_counter publish_failed("mqtt_publish_total", MQTT_PUBLISH_HELP, "result=\"error\"");
+
+//Sending the data to the MQTT broker and counting the result
+static void publish(const char* publish_topic, const char* data)
+{
+    if (esp_mqtt_client_publish(client, publish_topic, data, 0, 0, 0) < 0)
+        publish_failed.add();
+    else
+        publish_ok.add();
+}
+
 //Parsing the window position data from the acquired JSON file.
 void mqtt_json_parser(const char* const json_data){
 
@@ -88,6 +103,7 @@ void mqtt_json_parser(const char* const json_data){
         nvs_write_operation_mode(Internal_room_data.get_is_auto());
         gpio_set_level(LED_PIN, 1);
     }
+    telemetry_notify(TELEMETRY_ROOM);
     end:
     cJSON_Delete(data);
 }
@@ -149,7 +165,7 @@ void MQTT_publish()
                                     ",\"weather_id\":" + weather_id_JSON + ",\"weather_alert_event\":" + weather_alert_event_JSON + ",\"weather_alert_description\":" + weather_alert_desc_JSON +"}";
         string MCU_data_JSON = "{\"internal_data\":" + internal_data_JSON + ",\"weather_data\":" + weather_data_JSON + "}" ;
         //Sending the data to the MQTT broker
-        esp_mqtt_client_publish(client, "/topic/MCU_data", MCU_data_JSON.c_str(), 0, 0, 0);
+        publish("/topic/MCU_data", MCU_data_JSON.c_str());
     }
 }
 
@@ -161,7 +177,7 @@ void MQTT_Publish_Controls()
                                     ",\"desired_temperature\":"+ to_string(Internal_room_data.get_desired_temperature()) + 
                                     ",\"is_auto\":"+ to_string(Internal_room_data.get_is_auto()) + "}";
         //Sending the data to the MQTT broker
-        esp_mqtt_client_publish(client, "/topic/MCU_data", internal_data_JSON.c_str(), 0, 0, 0);
+        publish("/topic/MCU_data", internal_data_JSON.c_str());
     }
 }
 
@@ -0,0 +1,349 @@
+/* This module pushes the changes of the sensor, weather and actuator data to the browsers over a WebSocket (/ws),
+ * and accepts the slider commands of the config page as small JSON frames, e.g. {"window_deg":30} or {"desired_temp":22}.
+ * Every client has a bounded queue of messages and at most one frame in flight, so a slow client only delays itself.
+ * When its queue is full, the queue is replaced by one message with every section (a resync), so no change is lost.
+ */
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "room_data.h"
+#include "weather_data.h"
+#include "motor_control.h"
+#include "form_parser.h"
+#include "json_writer.h"
+#include "HTTP_server.h"
+#include "WS_telemetry.h"
+
+static const char *TAG = "WS_TELEMETRY";
+
+#define WS_MAX_CLIENTS 4
+#define WS_QUEUE_DEPTH 4
+#define WS_MESSAGE_SIZE 512
+#define WS_COMMAND_MAX_SIZE 128
+#define WS_PUSH_COALESCE_MS 100     //Changes arriving within this time are pushed in one message
+
+extern Room_data Internal_room_data;
+extern Weather_data Weather;
+
+struct Ws_client
+{
+    int fd;                 //-1 if the slot is free
+    bool in_flight;         //The frame at the head of the queue is being sent
+    uint8_t head;
+    uint8_t count;
+    uint32_t resyncs;
+    uint16_t lengths[WS_QUEUE_DEPTH];
+    char queue[WS_QUEUE_DEPTH][WS_MESSAGE_SIZE];
+};
+
+static Ws_client clients[WS_MAX_CLIENTS];
+static SemaphoreHandle_t clients_mutex = NULL;
+static httpd_handle_t ws_server = NULL;
+static TaskHandle_t push_task_handle = NULL;
+static volatile uint32_t pending_changes = 0;
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void telemetry_notify(uint32_t changes)
+{
+    if (push_task_handle == NULL)
+        return;
+    taskENTER_CRITICAL(&pending_lock);
+    pending_changes |= changes;
+    taskEXIT_CRITICAL(&pending_lock);
+    xTaskNotifyGive(push_task_handle);
+}
+
+//Writing the given sections of the telemetry. Returns the length of the message, -1 if it didn't fit.
+static int build_message(char* buffer, size_t size, uint32_t sections)
+{
+    Json_writer json;
+    json_init(&json, buffer, size);
+    json_object_begin(&json, NULL);
+    json_string(&json, "type", "telemetry");
+    if (sections & TELEMETRY_ROOM)
+    {
+        Room_snapshot room = Internal_room_data.get_snapshot();
+        json_object_begin(&json, "room");
+        json_float(&json, "temperature", room.internal_temperature, 2);
+        json_float(&json, "humidity", room.internal_humidity, 2);
+        json_float(&json, "gas_resistance", room.gas_resistance, 0);
+        json_float(&json, "window_deg", room.window_deg, 1);
+        json_int(&json, "desired_temp", room.desired_temperature);
+        json_bool(&json, "auto", room.is_auto);
+        json_object_end(&json);
+    }
+    if (sections & TELEMETRY_WEATHER)
+    {
+        Weather_snapshot weather = Weather.get_snapshot();
+        json_object_begin(&json, "weather");
+        json_float(&json, "temp", weather.temp, 2);
+        json_int(&json, "pressure", weather.pressure);
+        json_int(&json, "humidity", weather.humidity);
+        json_float(&json, "wind_speed", weather.wind_speed, 2);
+        json_int(&json, "wind_deg", weather.wind_deg);
+        json_array_begin(&json, "weather_ids");
+        for (int i = 0; i < weather.weather_id_count; i++)
+            json_int(&json, NULL, weather.weather_ids[i]);
+        json_array_end(&json);
+        json_array_begin(&json, "alerts");
+        for (int i = 0; i < weather.alert_count && i < WEATHER_SNAPSHOT_MAX_ALERTS; i++)
+            json_string(&json, NULL, weather.alert_events[i]);
+        json_array_end(&json);
+        json_string(&json, "freshness", weather_freshness_name(weather.freshness));
+        json_int(&json, "age_s", weather.age_s);
+        json_object_end(&json);
+    }
+    if (sections & TELEMETRY_ACTUATOR)
+    {
+        json_object_begin(&json, "actuator");
+        json_int(&json, "window_angle", motor_get_commanded_angle());
+        json_object_end(&json);
+    }
+    json_object_end(&json);
+    return json_finish(&json);
+}
+
+//Freeing the slot of a client. The caller must hold the mutex.
+static void remove_client(Ws_client* client)
+{
+    ESP_LOGI(TAG, "Client %d removed", client->fd);
+    client->fd = -1;
+    client->in_flight = false;
+    client->count = 0;
+}
+
+//Dropping a client that can't be sent to. Its socket is closed too, so the browser notices it and reconnects.
+static void drop_client(Ws_client* client)
+{
+    int fd = client->fd;
+    remove_client(client);
+    httpd_sess_trigger_close(ws_server, fd);
+}
+
+static void send_complete(esp_err_t err, int socket, void *arg);
+
+//Starting the transfer of the next queued message, if nothing is in flight. The caller must hold the mutex.
+static void pump_client(Ws_client* client)
+{
+    if (client->fd < 0 || client->in_flight || client->count == 0)
+        return;
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.final = true;
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.payload = (uint8_t*)client->queue[client->head];
+    frame.len = client->lengths[client->head];
+    client->in_flight = true;
+    if (httpd_ws_send_data_async(ws_server, client->fd, &frame, send_complete, (void*)(client - clients)) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Sending to client %d failed", client->fd);
+        drop_client(client);
+    }
+}
+
+//Called by the httpd task when a frame has been sent
+static void send_complete(esp_err_t err, int socket, void *arg)
+{
+    xSemaphoreTake(clients_mutex, portMAX_DELAY);
+    Ws_client* client = &clients[(intptr_t)arg];
+    if (client->fd == socket && client->in_flight)
+    {
+        client->in_flight = false;
+        client->head = (client->head + 1) % WS_QUEUE_DEPTH;
+        client->count--;
+        if (err != ESP_OK)
+            drop_client(client);
+        else
+            pump_client(client);
+    }
+    xSemaphoreGive(clients_mutex);
+}
+
+//Queueing a message for a client. The caller must hold the mutex.
+static void enqueue(Ws_client* client, const char* message, int length)
+{
+    if (client->count == WS_QUEUE_DEPTH)
+    {
+        //The client can't keep up: everything but the frame in flight is replaced by a full snapshot
+        client->resyncs++;
+        client->count = client->in_flight ? 1 : 0;
+        int full_length = build_message(client->queue[(client->head + client->count) % WS_QUEUE_DEPTH], WS_MESSAGE_SIZE, TELEMETRY_ALL);
+        if (full_length > 0)
+        {
+            client->lengths[(client->head + client->count) % WS_QUEUE_DEPTH] = full_length;
+            client->count++;
+        }
+        return;
+    }
+    uint8_t tail = (client->head + client->count) % WS_QUEUE_DEPTH;
+    memcpy(client->queue[tail], message, length);
+    client->lengths[tail] = length;
+    client->count++;
+}
+
+static void broadcast(uint32_t sections)
+{
+    char message[WS_MESSAGE_SIZE];
+    int length = build_message(message, sizeof(message), sections);
+    if (length < 0)
+    {
+        ESP_LOGE(TAG, "The telemetry message doesn't fit into %d bytes", WS_MESSAGE_SIZE);
+        return;
+    }
+    xSemaphoreTake(clients_mutex, portMAX_DELAY);
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd >= 0)
+        {
+            enqueue(&clients[i], message, length);
+            pump_client(&clients[i]);
+        }
+    }
+    xSemaphoreGive(clients_mutex);
+}
+
+static void push_task(void *params)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(WS_PUSH_COALESCE_MS));
+        taskENTER_CRITICAL(&pending_lock);
+        uint32_t changes = pending_changes;
+        pending_changes = 0;
+        taskEXIT_CRITICAL(&pending_lock);
+        if (changes != 0 && ws_server != NULL)
+            broadcast(changes);
+    }
+}
+
+static esp_err_t add_client(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+    xSemaphoreTake(clients_mutex, portMAX_DELAY);
+    Ws_client* client = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS && client == NULL; i++)
+    {
+        if (clients[i].fd < 0)
+            client = &clients[i];
+    }
+    if (client != NULL)
+    {
+        client->fd = fd;
+        client->in_flight = false;
+        client->head = 0;
+        client->count = 0;
+        client->resyncs = 0;
+        //A new client starts with the whole state
+        int length = build_message(client->queue[0], WS_MESSAGE_SIZE, TELEMETRY_ALL);
+        if (length > 0)
+        {
+            client->lengths[0] = length;
+            client->count = 1;
+        }
+        pump_client(client);
+        ESP_LOGI(TAG, "Client %d connected", fd);
+    }
+    xSemaphoreGive(clients_mutex);
+
+    if (client == NULL)
+    {
+        ESP_LOGW(TAG, "Too many WebSocket clients, %d refused", fd);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+//The handshake and the frames received from the clients
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET)
+        return add_client(req);
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    esp_err_t ret = httpd_ws_recv_frame(req, &frame, 0);
+    if (ret != ESP_OK)
+        return ret;
+    if (frame.len > WS_COMMAND_MAX_SIZE)
+    {
+        ESP_LOGW(TAG, "Frame of %d bytes refused", frame.len);
+        return ESP_FAIL;
+    }
+
+    char command[WS_COMMAND_MAX_SIZE + 1];
+    frame.payload = (uint8_t*)command;
+    ret = httpd_ws_recv_frame(req, &frame, WS_COMMAND_MAX_SIZE);
+    if (ret != ESP_OK)
+        return ret;
+    if (frame.type != HTTPD_WS_TYPE_TEXT)
+        return ESP_OK;
+    command[frame.len] = '\0';
+
+    Form_fields form;
+    if (form_parse_json(command, frame.len, &form) < 0)
+    {
+        ESP_LOGW(TAG, "Invalid command: %s", command);
+        return ESP_OK;
+    }
+    apply_mode_settings(&form);
+    return ESP_OK;
+}
+
+static const httpd_uri_t ws_uri =
+{
+    .uri = "/ws",
+    .method = HTTP_GET,
+    .handler = ws_handler,
+    .user_ctx = NULL,
+    .is_websocket = true,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+};
+
+esp_err_t ws_telemetry_register(httpd_handle_t server)
+{
+    if (clients_mutex == NULL)
+    {
+        clients_mutex = xSemaphoreCreateMutex();
+        for (int i = 0; i < WS_MAX_CLIENTS; i++)
+            clients[i].fd = -1;
+    }
+    ws_server = server;
+    if (push_task_handle == NULL)
+        xTaskCreate(push_task, "ws_telemetry", 4096, NULL, 4, &push_task_handle);
+    return httpd_register_uri_handler(server, &ws_uri);
+}
+
+void ws_telemetry_close_fn(httpd_handle_t server, int sockfd)
+{
+    if (clients_mutex != NULL)
+    {
+        xSemaphoreTake(clients_mutex, portMAX_DELAY);
+        for (int i = 0; i < WS_MAX_CLIENTS; i++)
+        {
+            if (clients[i].fd == sockfd)
+                remove_client(&clients[i]);
+        }
+        xSemaphoreGive(clients_mutex);
+    }
+    close(sockfd);
+}
+
+void ws_telemetry_stop()
+{
+    if (clients_mutex == NULL)
+        return;
+    xSemaphoreTake(clients_mutex, portMAX_DELAY);
+    ws_server = NULL;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++)
+    {
+        if (clients[i].fd >= 0)
+            remove_client(&clients[i]);
+    }
+    xSemaphoreGive(clients_mutex);
+}
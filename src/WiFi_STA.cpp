@@ -17,6 +17,7 @@
 #include "credentials.h"
 
 #include "HTTP_server.h"
+#include "HTTP_request_handler.h"
 #include <esp_https_server.h>
 
 #define ESP_MAXIMUM_RETRY (10)
@@ -62,6 +63,8 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         ESP_LOGI(STA_TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        //The retries of the weather service may be backing off since the connection was lost, the weather is fetched now instead
+        weather_service_send(WEATHER_FETCH_NOW);
         ESP_LOGI(STA_TAG, "got ip: starting MQTT Client\n");
         vTaskDelay(2000 / portTICK_PERIOD_MS);
         mqtt_app_start();
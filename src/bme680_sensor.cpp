@@ -9,6 +9,8 @@
 #include <bme680.h>
 #include <string.h>
 #include <room_data.h>
+#include "WS_telemetry.h"
+#include "metrics.h"
 
 #define PORT (i2c_port_t)0
 #define I2C_MASTER_SDA (gpio_num_t)21
@@ -23,6 +25,7 @@ extern Room_data Internal_room_data;
 
 bme680_t sensor;
 bme680_values_float_t values;
+static Metric_counter read_errors("sensor_read_errors_total", "BME680 measurements that couldn't be started or read.");
 uint32_t duration;
 
 void bme680_measure(void *pvParameters)
@@ -61,14 +64,18 @@ void bme680_measure(void *pvParameters)
             {
                 ESP_LOGI("BME680", "BME680 Sensor: %.2f °C, %.2f %%, %.2f Ohm",
                 values.temperature, values.humidity,  values.gas_resistance);
-                Internal_room_data.set_internal_temperature(values.temperature);
-                Internal_room_data.set_internal_humidity(values.humidity);
-                Internal_room_data.set_gas_resistance(values.gas_resistance);
+                Internal_room_data.set_measurement(values.temperature, values.humidity, values.gas_resistance);
+                telemetry_notify(TELEMETRY_ROOM);
+            }
+            else
+            {
+                read_errors.add();
             }
             vTaskDelay(60000 / portTICK_PERIOD_MS);
         }
         else
         {
+            read_errors.add();
             vTaskDelay(5000 / portTICK_PERIOD_MS);
         }
     }
@@ -0,0 +1,219 @@
+/* This module parses the URL encoded bodies of the forms of the config page.
+ * The body is scanned only once and decoded in place, the fields are views into the body.
+ * Flat JSON objects are parsed into the same table, so every POST endpoint accepts both.
+ */
+#include <string.h>
+#include "form_parser.h"
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+int form_parse(char* body, size_t length, Form_fields* form)
+{
+    form->count = 0;
+    size_t read = 0;
+    while (read < length)
+    {
+        if (form->count == FORM_MAX_FIELDS)
+            return -1;
+
+        //The decoded text never gets longer, so it is written over the part that has already been read
+        Form_field* field = &form->fields[form->count];
+        char* write = body + read;
+        field->key = write;
+        field->value = NULL;
+        bool in_value = false;
+        while (read < length && body[read] != '&')
+        {
+            char c = body[read++];
+            if (c == '=' && !in_value)
+            {
+                field->key_length = write - field->key;
+                *write++ = '\0';
+                field->value = write;
+                in_value = true;
+                continue;
+            }
+            if (c == '+')
+            {
+                c = ' ';
+            }
+            else if (c == '%' && read + 1 < length)
+            {
+                //A malformed escape is kept as it is
+                int high = hex_value(body[read]);
+                int low = hex_value(body[read + 1]);
+                if (high >= 0 && low >= 0)
+                {
+                    c = (char)(high << 4 | low);
+                    read += 2;
+                }
+            }
+            *write++ = c;
+        }
+        if (in_value)
+        {
+            field->value_length = write - field->value;
+        }
+        else
+        {
+            //A key without '=' has an empty value
+            field->key_length = write - field->key;
+            field->value_length = 0;
+        }
+        *write = '\0';
+        if (field->value == NULL)
+            field->value = write;
+        read++;     //Skipping the '&'
+
+        if (field->key_length > 0)
+            form->count++;
+    }
+    body[length] = '\0';
+    return form->count;
+}
+
+static size_t skip_space(const char* body, size_t position, size_t length)
+{
+    while (position < length && (body[position] == ' ' || body[position] == '\t' || body[position] == '\r' || body[position] == '\n'))
+        position++;
+    return position;
+}
+
+/* Unescaping a JSON string in place. position points after the opening quote.
+ * Returns the position after the closing quote, or 0 if the string is not terminated.
+ * Escaped code points above 0x7f are replaced by '?', the configuration only uses ASCII.
+ */
+static size_t parse_json_string(char* body, size_t position, size_t length, const char** out, size_t* out_length)
+{
+    char* write = body + position;
+    *out = write;
+    while (position < length)
+    {
+        char c = body[position++];
+        if (c == '"')
+        {
+            *out_length = write - *out;
+            *write = '\0';
+            return position;
+        }
+        if (c == '\\')
+        {
+            if (position >= length)
+                return 0;
+            c = body[position++];
+            switch (c)
+            {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u':
+                {
+                    if (position + 4 > length)
+                        return 0;
+                    int code_point = 0;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        int digit = hex_value(body[position++]);
+                        if (digit < 0)
+                            return 0;
+                        code_point = code_point << 4 | digit;
+                    }
+                    c = code_point < 0x80 ? (char)code_point : '?';
+                    break;
+                }
+                default:
+                    break;      //'"', '\\' and '/' stand for themselves
+            }
+        }
+        *write++ = c;
+    }
+    return 0;
+}
+
+int form_parse_json(char* body, size_t length, Form_fields* form)
+{
+    form->count = 0;
+    size_t position = skip_space(body, 0, length);
+    if (position >= length || body[position] != '{')
+        return -1;
+    position = skip_space(body, position + 1, length);
+    if (position < length && body[position] == '}')
+        return 0;
+
+    while (position < length)
+    {
+        if (form->count == FORM_MAX_FIELDS || body[position] != '"')
+            return -1;
+        Form_field* field = &form->fields[form->count];
+        position = parse_json_string(body, position + 1, length, &field->key, &field->key_length);
+        if (position == 0)
+            return -1;
+        position = skip_space(body, position, length);
+        if (position >= length || body[position] != ':')
+            return -1;
+        position = skip_space(body, position + 1, length);
+        if (position >= length)
+            return -1;
+
+        bool is_null = false;
+        if (body[position] == '"')
+        {
+            position = parse_json_string(body, position + 1, length, &field->value, &field->value_length);
+            if (position == 0)
+                return -1;
+        }
+        else
+        {
+            //A number or a literal, it ends at the next separator
+            size_t start = position;
+            while (position < length && body[position] != ',' && body[position] != '}'
+                   && body[position] != ' ' && body[position] != '\t' && body[position] != '\r' && body[position] != '\n')
+            {
+                if (body[position] == '{' || body[position] == '[' || body[position] == '"')
+                    return -1;      //Nested values are not supported
+                position++;
+            }
+            if (position == start)
+                return -1;
+            field->value = body + start;
+            field->value_length = position - start;
+            //A null is the same as a missing key, so {"apikey": null} doesn't store the text "null"
+            is_null = field->value_length == 4 && strncmp(field->value, "null", 4) == 0;
+        }
+        if (!is_null)
+            form->count++;
+
+        //The separator is read before the value gets its terminating zero written over it
+        size_t value_end = field->value + field->value_length - body;
+        position = skip_space(body, position, length);
+        char separator = position < length ? body[position] : '\0';
+        body[value_end] = '\0';
+        if (separator == '}')
+            return form->count;
+        if (separator != ',')
+            return -1;
+        position = skip_space(body, position + 1, length);
+    }
+    return -1;
+}
+
+const char* form_get(const Form_fields* form, const char* key)
+{
+    for (int i = 0; i < form->count; i++)
+    {
+        if (strcmp(form->fields[i].key, key) == 0)
+            return form->fields[i].value;
+    }
+    return NULL;
+}
@@ -0,0 +1,279 @@
+/* This module reads the head and the framing of the HTTP responses of the weather providers, see http_response.h.
+ * It works on the bytes as they are received and keeps only the current line, so a response is never held as a whole.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "http_response.h"
+
+enum Http_state
+{
+    HTTP_STATUS_LINE,
+    HTTP_HEADER_LINE,
+    HTTP_BODY
+};
+
+//How the end of the body is found
+enum Body_state
+{
+    BODY_LENGTH,                //Content-Length
+    BODY_UNTIL_CLOSE,           //Neither Content-Length nor chunked, the server closes the connection
+    BODY_CHUNK_SIZE,
+    BODY_CHUNK_DATA,
+    BODY_CHUNK_END,             //The "\r\n" after the data of a chunk
+    BODY_TRAILER,
+    BODY_COMPLETE
+};
+
+void http_response_init(Http_response* response)
+{
+    memset(response, 0, sizeof(*response));
+    response->state = HTTP_STATUS_LINE;
+    response->body_state = BODY_UNTIL_CLOSE;
+}
+
+//Collecting a line of the head or the size line of a chunk. Returns true at its end, without the "\r\n".
+static bool collect_line(Http_response* response, char c)
+{
+    if (c == '\n')
+    {
+        if (response->line_length > 0 && response->line[response->line_length - 1] == '\r')
+            response->line_length--;
+        response->line[response->line_length] = '\0';
+        return true;
+    }
+    //Only the start of a long line is kept, the headers that matter are short
+    if (response->line_length < sizeof(response->line) - 1)
+        response->line[response->line_length++] = c;
+    return false;
+}
+
+//The value of a header line if it has the given name, NULL otherwise
+static const char* get_header_value(const char* line, const char* name)
+{
+    size_t name_length = strlen(name);
+    if (strncasecmp(line, name, name_length) != 0 || line[name_length] != ':')
+        return NULL;
+    const char* value = line + name_length + 1;
+    while (*value == ' ' || *value == '\t')
+        value++;
+    return value;
+}
+
+static int parse_digits(const char* text, int count)
+{
+    int value = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return -1;
+        value = value * 10 + text[i] - '0';
+    }
+    return value;
+}
+
+//The days since 1970-01-01 of a date of the proleptic Gregorian calendar
+static int64_t get_days_from_epoch(int year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = year / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+int64_t http_parse_date(const char* text)
+{
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    //"Sun, 06 Nov 1994 08:49:37 GMT", the obsolete formats aren't sent by the servers in use
+    const char* comma = strchr(text, ',');
+    if (comma == NULL || strlen(comma) < 26 || strncmp(comma + 22, " GMT", 4) != 0)
+        return 0;
+    const char* date = comma + 2;
+    int month = 0;
+    while (month < 12 && strncmp(date + 3, months + month * 3, 3) != 0)
+        month++;
+    int day = parse_digits(date, 2);
+    int year = parse_digits(date + 7, 4);
+    int hour = parse_digits(date + 12, 2);
+    int minute = parse_digits(date + 15, 2);
+    int second = parse_digits(date + 18, 2);
+    if (month == 12 || day < 1 || day > 31 || year < 1970 || hour < 0 || hour > 23 || minute < 0 || minute > 59
+        || second < 0 || second > 60)
+        return 0;
+    return get_days_from_epoch(year, month + 1, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+//The head is read, deciding what happens to the body
+static bool end_of_head(Http_response* response)
+{
+    if (response->status < 200)
+        return false;
+    if (response->retry_after_date != 0 && response->date != 0 && response->retry_after_date > response->date)
+        response->retry_after_s = (uint32_t)(response->retry_after_date - response->date);
+
+    if (response->body_state == BODY_UNTIL_CLOSE)
+    {
+        response->keep_alive = false;
+        //The body of an error isn't read, the connection is closed anyway
+        if (!http_response_is_success(response))
+            return false;
+    }
+    else if (response->status == 204 || response->status == 304
+             || (response->body_state == BODY_LENGTH && response->body_remaining == 0))
+    {
+        response->body_state = BODY_COMPLETE;
+    }
+    else if (!http_response_is_success(response) && response->body_state == BODY_LENGTH
+             && response->body_remaining > HTTP_RESPONSE_MAX_ERROR_BODY)
+    {
+        return false;
+    }
+    response->state = HTTP_BODY;
+    return true;
+}
+
+static bool end_of_line(Http_response* response)
+{
+    const char* line = response->line;
+    response->line_length = 0;
+    if (response->state == HTTP_STATUS_LINE)
+    {
+        //"HTTP/1.1 200 OK", a 1.1 server keeps the connection open unless it says otherwise
+        if (strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ')
+            return false;
+        response->keep_alive = line[7] == '1';
+        response->status = atoi(line + 9);
+        response->state = HTTP_HEADER_LINE;
+        return true;
+    }
+    if (line[0] == '\0')
+        return end_of_head(response);
+
+    const char* value;
+    if ((value = get_header_value(line, "Content-Length")) != NULL)
+    {
+        response->body_remaining = strtoul(value, NULL, 10);
+        if (response->body_state != BODY_CHUNK_SIZE)
+            response->body_state = BODY_LENGTH;
+    }
+    else if ((value = get_header_value(line, "Transfer-Encoding")) != NULL && strcasestr(value, "chunked") != NULL)
+    {
+        response->body_state = BODY_CHUNK_SIZE;
+    }
+    else if ((value = get_header_value(line, "Connection")) != NULL)
+    {
+        if (strcasecmp(value, "close") == 0)
+            response->keep_alive = false;
+        else if (strcasecmp(value, "keep-alive") == 0)
+            response->keep_alive = true;
+    }
+    else if ((value = get_header_value(line, "Date")) != NULL)
+    {
+        response->date = http_parse_date(value);
+    }
+    else if ((value = get_header_value(line, "Retry-After")) != NULL)
+    {
+        //Delay-seconds, or a date that is compared with the Date of the server, the clock of the device may not be set
+        if (*value >= '0' && *value <= '9')
+            response->retry_after_s = strtoul(value, NULL, 10);
+        else
+            response->retry_after_date = http_parse_date(value);
+    }
+    return true;
+}
+
+//Taking the data of the body up to the end of the Content-Length or of the chunk. The body of an error is dropped.
+static size_t body_data(Http_response* response, const char* data, size_t length, const char** body, size_t* body_length)
+{
+    size_t count = length;
+    if (response->body_state != BODY_UNTIL_CLOSE)
+    {
+        if (count > response->body_remaining)
+            count = response->body_remaining;
+        response->body_remaining -= count;
+        if (response->body_remaining == 0)
+            response->body_state = response->body_state == BODY_LENGTH ? BODY_COMPLETE : BODY_CHUNK_END;
+    }
+    if (http_response_is_success(response))
+    {
+        *body = data;
+        *body_length = count;
+    }
+    else
+    {
+        response->error_body_length += count;
+        if (response->error_body_length > HTTP_RESPONSE_MAX_ERROR_BODY)
+            response->failed = true;
+    }
+    return count;
+}
+
+size_t http_response_feed(Http_response* response, const char* data, size_t length, const char** body, size_t* body_length)
+{
+    size_t i = 0;
+    *body = NULL;
+    *body_length = 0;
+    while (!response->failed && i < length)
+    {
+        if (response->state != HTTP_BODY)
+        {
+            if (collect_line(response, data[i++]) && !end_of_line(response))
+                response->failed = true;
+            continue;
+        }
+        switch (response->body_state)
+        {
+            case BODY_LENGTH:
+            case BODY_UNTIL_CLOSE:
+            case BODY_CHUNK_DATA:
+                i += body_data(response, data + i, length - i, body, body_length);
+                //Every piece of the body is handed over on its own
+                if (*body_length > 0)
+                    return i;
+                break;
+            case BODY_CHUNK_SIZE:
+                if (collect_line(response, data[i++]))
+                {
+                    //The chunk extensions after ';' are ignored
+                    response->body_remaining = strtoul(response->line, NULL, 16);
+                    response->body_state = response->body_remaining > 0 ? BODY_CHUNK_DATA : BODY_TRAILER;
+                    response->line_length = 0;
+                }
+                break;
+            case BODY_CHUNK_END:
+                if (data[i++] == '\n')
+                    response->body_state = BODY_CHUNK_SIZE;
+                break;
+            case BODY_TRAILER:
+                if (collect_line(response, data[i++]))
+                {
+                    if (response->line_length == 0)
+                        response->body_state = BODY_COMPLETE;
+                    response->line_length = 0;
+                }
+                break;
+            case BODY_COMPLETE:
+                //Nothing is sent after the response, the request isn't pipelined
+                response->failed = true;
+                break;
+        }
+    }
+    return i;
+}
+
+bool http_response_is_success(const Http_response* response)
+{
+    return response->status >= 200 && response->status <= 299;
+}
+
+bool http_response_is_complete(const Http_response* response)
+{
+    return response->state == HTTP_BODY && response->body_state == BODY_COMPLETE;
+}
+
+bool http_response_can_reuse(const Http_response* response)
+{
+    return http_response_is_complete(response) && response->keep_alive && !response->failed;
+}
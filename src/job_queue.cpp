@@ -0,0 +1,194 @@
+/* This module runs the slow side effects of the configuration changes (restarting the Wi-Fi, reconfiguring the weather service)
+ * on a task of its own, so the HTTP handlers only store the new settings, queue a job and answer at once.
+ * The jobs run one after the other, in the order they were queued.
+ */
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "WiFi_STA.h"
+#include "HTTP_request_handler.h"
+#include "store_data.h"
+#include "job_queue.h"
+
+static const char *TAG = "JOB_QUEUE";
+
+static QueueHandle_t job_ids = NULL;
+static SemaphoreHandle_t history_mutex = NULL;
+static Job_status history[JOB_HISTORY_SIZE];    //The status of job n is in slot n % JOB_HISTORY_SIZE
+static uint32_t next_id = 1;
+
+static esp_err_t run_wifi_restart()
+{
+    char ssid[NVS_SSID_SIZE];
+    char pass[NVS_PASS_SIZE];
+    nvs_read_wifi_ssid(ssid, sizeof(ssid));
+    nvs_read_wifi_pass(pass, sizeof(pass));
+    wifi_restart(ssid, pass);
+    return ESP_OK;
+}
+
+//The weather service applies the new settings before its next request, it keeps its connection and TLS session
+static esp_err_t run_weather_reconfigure()
+{
+    return weather_service_send(WEATHER_RECONFIGURE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+static void set_state(uint32_t id, Job_state state, esp_err_t result)
+{
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    Job_status* status = &history[id % JOB_HISTORY_SIZE];
+    if (status->id == id)
+    {
+        status->state = state;
+        status->result = result;
+        if (state == JOB_RUNNING)
+            status->started_us = esp_timer_get_time();
+        else
+            status->finished_us = esp_timer_get_time();
+    }
+    xSemaphoreGive(history_mutex);
+}
+
+static void job_task(void *params)
+{
+    uint32_t id;
+    while (true)
+    {
+        xQueueReceive(job_ids, &id, portMAX_DELAY);
+        Job_status status;
+        if (!job_get_status(id, &status))
+            continue;
+
+        set_state(id, JOB_RUNNING, ESP_OK);
+        ESP_LOGI(TAG, "Job %" PRIu32 " (%s) started", id, job_type_name(status.type));
+        esp_err_t result = ESP_ERR_INVALID_ARG;
+        switch (status.type)
+        {
+            case JOB_WIFI_RESTART:
+                result = run_wifi_restart();
+                break;
+            case JOB_WEATHER_RECONFIGURE:
+                result = run_weather_reconfigure();
+                break;
+        }
+        set_state(id, result == ESP_OK ? JOB_DONE : JOB_FAILED, result);
+        ESP_LOGI(TAG, "Job %" PRIu32 " finished: %s", id, esp_err_to_name(result));
+    }
+}
+
+esp_err_t job_queue_init()
+{
+    job_ids = xQueueCreate(JOB_QUEUE_DEPTH, sizeof(uint32_t));
+    history_mutex = xSemaphoreCreateMutex();
+    if (job_ids == NULL || history_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create the job queue");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(&job_task, "job_task", JOB_TASK_STACK_SIZE, NULL, JOB_TASK_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create the job task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+uint32_t job_submit(Job_type type)
+{
+    if (job_ids == NULL)
+        return 0;
+
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (int i = 0; i < JOB_HISTORY_SIZE; i++)
+    {
+        if (history[i].id != 0 && history[i].type == type && history[i].state == JOB_QUEUED)
+        {
+            uint32_t queued_id = history[i].id;
+            xSemaphoreGive(history_mutex);
+            return queued_id;
+        }
+    }
+
+    uint32_t id = next_id;
+    Job_status* status = &history[id % JOB_HISTORY_SIZE];
+    Job_status evicted = *status;
+    *status = {};
+    status->id = id;
+    status->type = type;
+    status->state = JOB_QUEUED;
+    status->result = ESP_OK;
+    status->queued_us = esp_timer_get_time();
+    //The slot is filled before the id is sent, the task may pick it up at once
+    if (xQueueSend(job_ids, &id, 0) == pdTRUE)
+    {
+        next_id++;
+    }
+    else
+    {
+        //A refused job leaves no trace, the status it would have evicted is kept
+        *status = evicted;
+        id = 0;
+        ESP_LOGW(TAG, "The job queue is full, %s refused", job_type_name(type));
+    }
+    xSemaphoreGive(history_mutex);
+    return id;
+}
+
+bool job_get_status(uint32_t id, Job_status* status)
+{
+    if (id == 0 || history_mutex == NULL)
+        return false;
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    bool found = history[id % JOB_HISTORY_SIZE].id == id;
+    if (found)
+        *status = history[id % JOB_HISTORY_SIZE];
+    xSemaphoreGive(history_mutex);
+    return found;
+}
+
+int job_get_recent(Job_status* statuses, int max_count)
+{
+    if (history_mutex == NULL)
+        return 0;
+    int count = 0;
+    xSemaphoreTake(history_mutex, portMAX_DELAY);
+    for (uint32_t id = next_id - 1; id > 0 && count < max_count && next_id - id <= JOB_HISTORY_SIZE; id--)
+    {
+        if (history[id % JOB_HISTORY_SIZE].id == id)
+            statuses[count++] = history[id % JOB_HISTORY_SIZE];
+    }
+    xSemaphoreGive(history_mutex);
+    return count;
+}
+
+const char* job_type_name(Job_type type)
+{
+    switch (type)
+    {
+        case JOB_WIFI_RESTART:
+            return "wifi_restart";
+        case JOB_WEATHER_RECONFIGURE:
+            return "weather_reconfigure";
+    }
+    return "unknown";
+}
+
+const char* job_state_name(Job_state state)
+{
+    switch (state)
+    {
+        case JOB_QUEUED:
+            return "queued";
+        case JOB_RUNNING:
+            return "running";
+        case JOB_DONE:
+            return "done";
+        case JOB_FAILED:
+            return "failed";
+    }
+    return "unknown";
+}
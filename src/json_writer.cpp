@@ -0,0 +1,169 @@
+/* This module writes the JSON responses of the webserver into buffers owned by the caller.
+ * snprintf is only used for the numbers, the structure and the escaping are written character by character.
+ */
+#include <stdio.h>
+#include <math.h>
+#include <inttypes.h>
+#include "json_writer.h"
+
+static void put_char(Json_writer* writer, char c)
+{
+    if (writer->length + 1 < writer->size)
+        writer->buffer[writer->length++] = c;
+    else
+        writer->overflow = true;
+}
+
+static void put_escaped(Json_writer* writer, const char* text)
+{
+    static const char hex[] = "0123456789abcdef";
+    put_char(writer, '"');
+    for (const char* c = text; *c != '\0'; c++)
+    {
+        switch (*c)
+        {
+            case '"':  put_char(writer, '\\'); put_char(writer, '"'); break;
+            case '\\': put_char(writer, '\\'); put_char(writer, '\\'); break;
+            case '\n': put_char(writer, '\\'); put_char(writer, 'n'); break;
+            case '\r': put_char(writer, '\\'); put_char(writer, 'r'); break;
+            case '\t': put_char(writer, '\\'); put_char(writer, 't'); break;
+            default:
+                if ((unsigned char)*c < 0x20)
+                {
+                    put_char(writer, '\\');
+                    put_char(writer, 'u');
+                    put_char(writer, '0');
+                    put_char(writer, '0');
+                    put_char(writer, hex[(*c >> 4) & 0x0f]);
+                    put_char(writer, hex[*c & 0x0f]);
+                }
+                else
+                {
+                    put_char(writer, *c);
+                }
+                break;
+        }
+    }
+    put_char(writer, '"');
+}
+
+//Writing the separator and the key of the next item of the current level
+static void begin_item(Json_writer* writer, const char* key)
+{
+    uint32_t level_bit = 1u << writer->depth;
+    if (writer->has_items & level_bit)
+        put_char(writer, ',');
+    writer->has_items |= level_bit;
+    if (key != NULL)
+    {
+        put_escaped(writer, key);
+        put_char(writer, ':');
+    }
+}
+
+static void put_text(Json_writer* writer, const char* text)
+{
+    for (const char* c = text; *c != '\0'; c++)
+        put_char(writer, *c);
+}
+
+void json_init(Json_writer* writer, char* buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->depth = 0;
+    writer->has_items = 0;
+    writer->overflow = size == 0;
+}
+
+static void open_level(Json_writer* writer, const char* key, char bracket)
+{
+    begin_item(writer, key);
+    put_char(writer, bracket);
+    if (writer->depth + 1 < JSON_WRITER_MAX_DEPTH)
+        writer->depth++;
+    else
+        writer->overflow = true;
+    writer->has_items &= ~(1u << writer->depth);
+}
+
+static void close_level(Json_writer* writer, char bracket)
+{
+    if (writer->depth > 0)
+        writer->depth--;
+    put_char(writer, bracket);
+}
+
+void json_object_begin(Json_writer* writer, const char* key)
+{
+    open_level(writer, key, '{');
+}
+
+void json_object_end(Json_writer* writer)
+{
+    close_level(writer, '}');
+}
+
+void json_array_begin(Json_writer* writer, const char* key)
+{
+    open_level(writer, key, '[');
+}
+
+void json_array_end(Json_writer* writer)
+{
+    close_level(writer, ']');
+}
+
+void json_int(Json_writer* writer, const char* key, int32_t value)
+{
+    char number[12];
+    snprintf(number, sizeof(number), "%" PRId32, value);
+    begin_item(writer, key);
+    put_text(writer, number);
+}
+
+void json_uint(Json_writer* writer, const char* key, uint32_t value)
+{
+    char number[12];
+    snprintf(number, sizeof(number), "%" PRIu32, value);
+    begin_item(writer, key);
+    put_text(writer, number);
+}
+
+//NaN and infinity have no JSON representation, they are written as null
+void json_float(Json_writer* writer, const char* key, float value, int decimals)
+{
+    char number[24];
+    begin_item(writer, key);
+    if (isfinite(value) && snprintf(number, sizeof(number), "%.*f", decimals, value) < (int)sizeof(number))
+        put_text(writer, number);
+    else
+        put_text(writer, "null");
+}
+
+void json_bool(Json_writer* writer, const char* key, bool value)
+{
+    begin_item(writer, key);
+    put_text(writer, value ? "true" : "false");
+}
+
+void json_string(Json_writer* writer, const char* key, const char* value)
+{
+    begin_item(writer, key);
+    put_escaped(writer, value != NULL ? value : "");
+}
+
+void json_null(Json_writer* writer, const char* key)
+{
+    begin_item(writer, key);
+    put_text(writer, "null");
+}
+
+int json_finish(Json_writer* writer)
+{
+    if (writer->size == 0)
+        return -1;
+    writer->buffer[writer->length < writer->size ? writer->length : writer->size - 1] = '\0';
+    return writer->overflow ? -1 : (int)writer->length;
+}
@@ -24,17 +24,19 @@
 #include <bme680.h>
 #include "bme680_sensor.h"
 #include "motor_control.h"
+#include "job_queue.h"
+#include "weather_cache.h"
 
 #define LED_PIN GPIO_NUM_2
 
 extern "C"
 {
     void app_main(void);
-    TaskHandle_t http_request_task_handle;
 };
 
-char def_ssid[33] = WIFI_SSID_DEFAULT;
-char def_pass[64] = WIFI_PWD_DEFAULT;
+//The Wi-Fi credentials are copied here from the stored configuration
+static char wifi_ssid[NVS_SSID_SIZE];
+static char wifi_pass[NVS_PASS_SIZE];
 
 Room_data Internal_room_data;
 Weather_data Weather;
@@ -65,19 +67,15 @@ void control_LED_task(void *params)
 //Setting up the flash memory.
 void init_flash_settings()
 {
-    //Initializing the flash memory, and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
-    {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
-    Internal_room_data.set_window_deg(nvs_read_window_deg()/100);
+    //Opening the NVS and loading the stored configuration into RAM, the reads below don't touch the flash.
+    ESP_ERROR_CHECK(nvs_config_init());
+    Internal_room_data.set_window_deg(nvs_read_window_deg());
     Internal_room_data.set_desired_temperature(nvs_read_desired_temp());
     Internal_room_data.set_is_auto(nvs_read_operation_mode());
-    Weather.set_lat(nvs_read_latitude()/100);
-    Weather.set_lon(nvs_read_longitude()/100);
+    Weather.set_lat(nvs_read_latitude());
+    Weather.set_lon(nvs_read_longitude());
+    //The last fetched weather, so the control loop has an outside temperature from the start
+    weather_cache_load();
 }
 
 //Starting the Wi-Fi module.
@@ -85,9 +83,9 @@ void init_wifi_settings(void)
 {
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    const char* ssid = nvs_read_wifi_ssid();
-    const char* pass = nvs_read_wifi_pass();
-    wifi_init_sta(ssid, pass);
+    nvs_read_wifi_ssid(wifi_ssid, sizeof(wifi_ssid));
+    nvs_read_wifi_pass(wifi_pass, sizeof(wifi_pass));
+    wifi_init_sta(wifi_ssid, wifi_pass);
 }
 
 void app_main(void)
@@ -95,8 +93,8 @@ void app_main(void)
     //Initializing NVS
     init_flash_settings();
     vTaskDelay(100 / portTICK_PERIOD_MS);
-    //Loading the configuration page from the flash memory
-    config_web_page_buffer();
+    //Mounting the filesystem of the configuration page
+    init_web_assets();
     vTaskDelay(100 / portTICK_PERIOD_MS);
     //Configuring the onboard LED
     setup_LED_GPIO();
@@ -105,11 +103,13 @@ void app_main(void)
     ESP_ERROR_CHECK(i2cdev_init());
     xTaskCreatePinnedToCore(bme680_measure, "bme680_measure", configMINIMAL_STACK_SIZE * 8, NULL, 5, NULL, APP_CPU_NUM); //2048?
     vTaskDelay(100 / portTICK_PERIOD_MS);
+    //Starting the task of the slow configuration changes, before the webserver can queue any
+    ESP_ERROR_CHECK(job_queue_init());
     //Initializing the Wi-Fi settings
     init_wifi_settings();
     vTaskDelay(100 / portTICK_PERIOD_MS);
-    //Creating the weather data request task
-    xTaskCreate(&https_request_task, "https_request_task", 8192, NULL, 5, &http_request_task_handle);
+    //Starting the weather service, which requests the weather data
+    ESP_ERROR_CHECK(weather_service_start());
     vTaskDelay(100 / portTICK_PERIOD_MS);
     //Creating the LED turn-off task
     xTaskCreate(control_LED_task, "control_LED_task", 2048, NULL, 5, NULL);
@@ -0,0 +1,206 @@
+/* This module is the registry of the counters, gauges and latency histograms of the firmware,
+ * and renders them in the Prometheus text exposition format for the /metrics endpoint of the webserver.
+ * Nothing is allocated: the metrics are static objects chained into a list, the rendering uses a stack buffer.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_timer.h"
+#include "metrics.h"
+
+//1 ms .. 2.5 s
+const uint32_t METRICS_BUCKETS_FAST_US[] = {1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000, 2500000};
+const size_t METRICS_BUCKETS_FAST_COUNT = sizeof(METRICS_BUCKETS_FAST_US) / sizeof(METRICS_BUCKETS_FAST_US[0]);
+//100 ms .. 30 s
+const uint32_t METRICS_BUCKETS_SLOW_US[] = {100000, 250000, 500000, 1000000, 2000000, 5000000, 10000000, 30000000};
+const size_t METRICS_BUCKETS_SLOW_COUNT = sizeof(METRICS_BUCKETS_SLOW_US) / sizeof(METRICS_BUCKETS_SLOW_US[0]);
+
+//Only written by the constructors, before app_main
+static Metric* metrics_head = NULL;
+static Metric* metrics_tail = NULL;
+
+Metric::Metric(Metric_type type, const char* name, const char* help, const char* labels)
+    : type(type), name(name), help(help), labels(labels), next(NULL)
+{
+    //Appending keeps the order of the definitions within a module
+    if (metrics_tail == NULL)
+        metrics_head = this;
+    else
+        metrics_tail -> next = this;
+    metrics_tail = this;
+}
+
+Metric_counter::Metric_counter(const char* name, const char* help, const char* labels)
+    : Metric(METRIC_COUNTER, name, help, labels), value(0)
+{
+}
+
+Metric_gauge::Metric_gauge(const char* name, const char* help, const char* labels)
+    : Metric(METRIC_GAUGE, name, help, labels), value(0)
+{
+}
+
+Metric_histogram::Metric_histogram(const char* name, const char* help, const char* labels, const uint32_t* bounds_us, size_t bound_count)
+    : Metric(METRIC_HISTOGRAM, name, help, labels), bounds_us(bounds_us), sum_us(0), count(0)
+{
+    this -> bound_count = bound_count < METRICS_MAX_BUCKETS ? bound_count : METRICS_MAX_BUCKETS;
+    memset(counts, 0, sizeof(counts));
+    portMUX_INITIALIZE(&lock);
+}
+
+void Metric_histogram::observe_us(uint32_t duration_us)
+{
+    size_t bucket = 0;
+    while (bucket < bound_count && duration_us > bounds_us[bucket])
+        bucket++;
+    taskENTER_CRITICAL(&lock);
+    counts[bucket]++;
+    sum_us += duration_us;
+    count++;
+    taskEXIT_CRITICAL(&lock);
+}
+
+Histogram_snapshot Metric_histogram::get_snapshot()
+{
+    Histogram_snapshot snapshot;
+    taskENTER_CRITICAL(&lock);
+    memcpy(snapshot.counts, counts, sizeof(counts));
+    snapshot.sum_us = sum_us;
+    snapshot.count = count;
+    taskEXIT_CRITICAL(&lock);
+    return snapshot;
+}
+
+Metric_timer::Metric_timer(Metric_histogram* histogram) : histogram(histogram), start_us(esp_timer_get_time())
+{
+}
+
+Metric_timer::~Metric_timer()
+{
+    histogram -> observe_us((uint32_t)(esp_timer_get_time() - start_us));
+}
+
+/* ---- Rendering ---- */
+
+#define METRICS_LINE_MAX 160
+
+struct Render_buffer
+{
+    char data[METRICS_RENDER_CHUNK];
+    size_t length;
+    metrics_write_fn_t write;
+    void* ctx;
+    bool failed;
+};
+
+static void render_flush(Render_buffer* buffer)
+{
+    if (!buffer->failed && buffer->length > 0 && !buffer->write(buffer->ctx, buffer->data, buffer->length))
+        buffer->failed = true;
+    buffer->length = 0;
+}
+
+static void render_line(Render_buffer* buffer, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+//Lines longer than METRICS_LINE_MAX are truncated
+static void render_line(Render_buffer* buffer, const char* format, ...)
+{
+    if (sizeof(buffer->data) - buffer->length < METRICS_LINE_MAX)
+        render_flush(buffer);
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer->data + buffer->length, METRICS_LINE_MAX, format, args);
+    va_end(args);
+    if (length > 0)
+        buffer->length += length < METRICS_LINE_MAX ? length : METRICS_LINE_MAX - 1;
+}
+
+//The label set of a sample: the labels of the metric, and the extra one of the histogram buckets
+static void format_labels(char* out, size_t size, const char* labels, const char* extra)
+{
+    if (labels == NULL && extra == NULL)
+        out[0] = '\0';
+    else if (labels == NULL)
+        snprintf(out, size, "{%s}", extra);
+    else if (extra == NULL)
+        snprintf(out, size, "{%s}", labels);
+    else
+        snprintf(out, size, "{%s,%s}", labels, extra);
+}
+
+static void render_histogram(Render_buffer* buffer, Metric_histogram* histogram)
+{
+    Histogram_snapshot snapshot = histogram->get_snapshot();
+    const uint32_t* bounds_us = histogram->get_bounds_us();
+    char labels[96];
+    char le[24];
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i <= histogram->get_bound_count(); i++)
+    {
+        cumulative += snapshot.counts[i];
+        if (i < histogram->get_bound_count())
+            snprintf(le, sizeof(le), "le=\"%g\"", bounds_us[i] / 1e6);
+        else
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        format_labels(labels, sizeof(labels), histogram->labels, le);
+        render_line(buffer, "%s_bucket%s %" PRIu32 "\n", histogram->name, labels, cumulative);
+    }
+    format_labels(labels, sizeof(labels), histogram->labels, NULL);
+    render_line(buffer, "%s_sum%s %.6f\n", histogram->name, labels, snapshot.sum_us / 1e6);
+    render_line(buffer, "%s_count%s %" PRIu32 "\n", histogram->name, labels, snapshot.count);
+}
+
+static void render_sample(Render_buffer* buffer, Metric* metric)
+{
+    char labels[96];
+    format_labels(labels, sizeof(labels), metric->labels, NULL);
+    switch (metric->type)
+    {
+        case METRIC_COUNTER:
+            render_line(buffer, "%s%s %" PRIu32 "\n", metric->name, labels, ((Metric_counter*)metric)->get());
+            break;
+        case METRIC_GAUGE:
+            render_line(buffer, "%s%s %.7g\n", metric->name, labels, ((Metric_gauge*)metric)->get());
+            break;
+        case METRIC_HISTOGRAM:
+            render_histogram(buffer, (Metric_histogram*)metric);
+            break;
+    }
+}
+
+static bool is_first_of_name(Metric* metric)
+{
+    for (Metric* other = metrics_head; other != metric; other = other->next)
+    {
+        if (strcmp(other->name, metric->name) == 0)
+            return false;
+    }
+    return true;
+}
+
+bool metrics_render(metrics_write_fn_t write, void* ctx)
+{
+    static const char* const type_names[] = {"counter", "gauge", "histogram"};
+    Render_buffer buffer;
+    buffer.length = 0;
+    buffer.write = write;
+    buffer.ctx = ctx;
+    buffer.failed = false;
+
+    //The samples of a name are written together, after its HELP and TYPE lines
+    for (Metric* metric = metrics_head; metric != NULL && !buffer.failed; metric = metric->next)
+    {
+        if (!is_first_of_name(metric))
+            continue;
+        render_line(&buffer, "# HELP %s %s\n", metric->name, metric->help);
+        render_line(&buffer, "# TYPE %s %s\n", metric->name, type_names[metric->type]);
+        for (Metric* sample = metric; sample != NULL; sample = sample->next)
+        {
+            if (strcmp(sample->name, metric->name) == 0)
+                render_sample(&buffer, sample);
+        }
+    }
+    render_flush(&buffer);
+    return !buffer.failed;
+}
@@ -9,6 +9,8 @@
 #include "driver/mcpwm_prelude.h"
 #include "room_data.h"
 #include "weather_data.h"
+#include "motor_control.h"
+#include "WS_telemetry.h"
 
 static const char *TAG = "MOTOR_CONTROL";
 
@@ -22,6 +24,9 @@ static const char *TAG = "MOTOR_CONTROL";
 #define SERVO_TIMEBASE_RESOLUTION_HZ 1000000  //1MHz, 1us per tick
 #define SERVO_TIMEBASE_PERIOD        20000    //20000 ticks, 20ms
 
+//A stale or unverified outside temperature is only trusted if it differs from the room temperature by this much
+#define STALE_WEATHER_MARGIN 3.0f
+
 extern Room_data Internal_room_data;
 extern Weather_data Weather;
 
@@ -31,6 +36,25 @@ static inline uint32_t create_pwm_signal(int angle)
     return (angle - SERVO_MIN_DEGREE) * (SERVO_MAX_PULSEWIDTH_US - SERVO_MIN_PULSEWIDTH_US) / (SERVO_MAX_DEGREE - SERVO_MIN_DEGREE) + SERVO_MIN_PULSEWIDTH_US;
 }
 
+//The last angle the servo was driven to, reported in the telemetry
+static volatile int commanded_angle = 0;
+
+int motor_get_commanded_angle()
+{
+    return commanded_angle;
+}
+
+//Driving the servo to an angle. The telemetry is only notified when the angle changes.
+static void drive_window(mcpwm_cmpr_handle_t comparator, int angle)
+{
+    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(angle)));
+    if (angle != commanded_angle)
+    {
+        commanded_angle = angle;
+        telemetry_notify(TELEMETRY_ACTUATOR);
+    }
+}
+
 void motor_control_task(void *params)
 {
     //Setting up the timer using the MCPWM peripheral
@@ -68,7 +92,8 @@ void motor_control_task(void *params)
     ESP_ERROR_CHECK(mcpwm_new_generator(oper, &generator_config, &generator));
 
     //Set the initial position of the motor to the one read from the NVS
-    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(Internal_room_data.get_window_deg())));
+    commanded_angle = Internal_room_data.get_window_deg();
+    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(commanded_angle)));
     ESP_LOGI(TAG, "Window angle set to: %f", Internal_room_data.get_window_deg());
 
     //Sets the generation action on timer and compare events
@@ -81,46 +106,63 @@ void motor_control_task(void *params)
     ESP_ERROR_CHECK(mcpwm_timer_enable(timer));
     ESP_ERROR_CHECK(mcpwm_timer_start_stop(timer, MCPWM_TIMER_START_NO_STOP));
 
+    Weather_freshness previous_freshness = WEATHER_MISSING;
     while (1) {
 
         //Manual mode
         if (!Internal_room_data.get_is_auto())
         {
             //Open the window as much as the user likes
-            ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(Internal_room_data.get_window_deg())));
+            drive_window(comparator, Internal_room_data.get_window_deg());
         }
         //Automatic mode
         else
         {
+            Weather_freshness freshness = Weather.get_freshness();
+            if (freshness != previous_freshness)
+            {
+                ESP_LOGI(TAG, "The outside temperature is %s", weather_freshness_name(freshness));
+                previous_freshness = freshness;
+            }
+            float internal_temperature = Internal_room_data.get_internal_temperature();
+            float desired_temperature = Internal_room_data.get_desired_temperature();
+            float outside_temperature = Weather.get_temp();
+            float margin = freshness == WEATHER_FRESH ? 0 : STALE_WEATHER_MARGIN;
+
+            //Without an outside temperature the window stays closed, an open one could make it worse
+            if (freshness == WEATHER_MISSING)
+            {
+                drive_window(comparator, -90);
+            }
             //If the room temperature is higher than the desired and outside temperatures, open the window to cool down the room
-            if (Internal_room_data.get_internal_temperature() > Internal_room_data.get_desired_temperature())
+            else if (internal_temperature > desired_temperature)
             {
-                if(Internal_room_data.get_internal_temperature() > Weather.get_temp())
+                if (internal_temperature > outside_temperature + margin)
                 {   
                     //Open the window
-                    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(90)));
+                    drive_window(comparator, 90);
                 }
                 else
                 {   //Close the window
-                    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(-90)));
+                    drive_window(comparator, -90);
                 }
             }
             //If the room temperature is lower than the desired and outside temperature, open the window to heat up the room
-            else if (Internal_room_data.get_internal_temperature() < Internal_room_data.get_desired_temperature())
+            else if (internal_temperature < desired_temperature)
             {
-                if(Internal_room_data.get_internal_temperature() < Weather.get_temp())
+                if (internal_temperature < outside_temperature - margin)
                 {   
                     //Open the window
-                    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(90)));
+                    drive_window(comparator, 90);
                 }
                 else
                 {   //Close the window
-                    ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(-90)));
+                    drive_window(comparator, -90);
                 }
             }
             else
             {   //Close the window
-                ESP_ERROR_CHECK(mcpwm_comparator_set_compare_value(comparator, create_pwm_signal(-90)));
+                drive_window(comparator, -90);
             }
 
         }
@@ -0,0 +1,111 @@
+/* This module builds the requests of the One Call API 2.5 of Openweathermap, and maps its responses into Weather
+ * with the streaming parser of JSON_parser.cpp. The replay provider asks a local server for recorded responses instead.
+ */
+#include "request_writer.h"
+#include "openweathermap_provider.h"
+
+const char* Openweathermap_provider::get_name() const
+{
+    return "openweathermap";
+}
+
+const char* Openweathermap_provider::get_host() const
+{
+    return OPENWEATHERMAP_HOST;
+}
+
+const char* Openweathermap_provider::get_port() const
+{
+    return OPENWEATHERMAP_PORT;
+}
+
+bool Openweathermap_provider::uses_tls() const
+{
+    return true;
+}
+
+size_t Openweathermap_provider::build_request(char* buf, size_t size, const Weather_query* query) const
+{
+    Request_writer writer;
+    request_init(&writer, buf, size);
+    request_begin(&writer, "GET", "/data/2.5/onecall");
+    request_query_fixed(&writer, "lat", query->latitude, WEATHER_COORDINATE_DECIMALS);
+    request_query_fixed(&writer, "lon", query->longitude, WEATHER_COORDINATE_DECIMALS);
+    if (query->units != NULL)
+        request_query(&writer, "units", query->units);
+    if (query->exclude != NULL && query->exclude[0] != '\0')
+        request_query(&writer, "exclude", query->exclude);
+    if (query->lang != NULL)
+        request_query(&writer, "lang", query->lang);
+    request_query(&writer, "appid", query->app_id);
+    request_end_line(&writer);
+    request_header(&writer, "Host", get_host());
+    request_header(&writer, "User-Agent", "esp-idf/1.0 esp32");
+    request_header(&writer, "Accept", "application/json");
+    request_header(&writer, "Connection", "keep-alive");
+    int length = request_finish(&writer);
+    return length > 0 ? (size_t)length : 0;
+}
+
+void Openweathermap_provider::begin_response()
+{
+    weather_parser_init(&parser);
+}
+
+bool Openweathermap_provider::feed_response(const char* data, size_t length)
+{
+    return weather_parser_feed(&parser, data, length);
+}
+
+bool Openweathermap_provider::is_response_complete() const
+{
+    return weather_parser_is_complete(&parser);
+}
+
+bool Openweathermap_provider::finish_response()
+{
+    if (!weather_parser_finish(&parser))
+        return false;
+    apply_weather_report(&parser.report, parser.http.date);
+    return true;
+}
+
+Weather_response Openweathermap_provider::get_response() const
+{
+    Weather_response response;
+    response.status = parser.http.status;
+    response.date = parser.http.date;
+    response.retry_after_s = parser.http.retry_after_s;
+    //The body of an error is read to its end too, the connection is only lost with an invalid response
+    response.keep_alive = http_response_can_reuse(&parser.http);
+    response.alert_active = parser.report.alert_count > 0;
+    response.temp = parser.report.temp;
+    response.pressure = parser.report.pressure;
+    return response;
+}
+
+Replay_provider::Replay_provider(const char* host, const char* port)
+{
+    this -> host = host;
+    this -> port = port;
+}
+
+const char* Replay_provider::get_name() const
+{
+    return "replay";
+}
+
+const char* Replay_provider::get_host() const
+{
+    return host;
+}
+
+const char* Replay_provider::get_port() const
+{
+    return port;
+}
+
+bool Replay_provider::uses_tls() const
+{
+    return false;
+}
@@ -0,0 +1,94 @@
+/* This module decides when the weather service polls the API next, see poll_scheduler.h.
+ * It only does the arithmetic, the caller measures the time and sleeps.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include "esp_random.h"
+#include "poll_scheduler.h"
+
+void poll_scheduler_init(Poll_scheduler* scheduler, int64_t now_us)
+{
+    scheduler->consecutive_failures = 0;
+    scheduler->calls_today = 0;
+    scheduler->day_start_us = now_us;
+    scheduler->has_previous = false;
+    scheduler->previous_temp = 0;
+    scheduler->previous_pressure = 0;
+}
+
+//A random delay in [interval - jitter, interval + jitter]
+static uint32_t add_jitter(uint32_t interval_ms)
+{
+    uint32_t jitter_ms = interval_ms / 100 * POLL_JITTER_PERCENT;
+    return interval_ms - jitter_ms + esp_random() % (2 * jitter_ms + 1);
+}
+
+//Exponential backoff with "equal jitter": half of the current step is fixed, the other half is random
+static uint32_t get_backoff(uint32_t failures)
+{
+    uint32_t step_ms = POLL_BACKOFF_MAX_MS;
+    if (failures <= 16 && ((uint64_t)POLL_BACKOFF_BASE_MS << (failures - 1)) < POLL_BACKOFF_MAX_MS)
+        step_ms = POLL_BACKOFF_BASE_MS << (failures - 1);
+    return step_ms / 2 + esp_random() % (step_ms / 2 + 1);
+}
+
+static bool is_changing_quickly(const Poll_scheduler* scheduler, const Poll_outcome* outcome)
+{
+    return scheduler->has_previous
+           && (fabsf(outcome->temp - scheduler->previous_temp) >= POLL_FAST_TEMP_DELTA
+               || abs(outcome->pressure - scheduler->previous_pressure) >= POLL_FAST_PRESSURE_DELTA);
+}
+
+uint32_t poll_scheduler_next_delay(Poll_scheduler* scheduler, const Poll_outcome* outcome, int64_t now_us)
+{
+    //The budget is counted for 24 hour windows from the start
+    while (now_us - scheduler->day_start_us >= POLL_DAY_US)
+    {
+        scheduler->day_start_us += POLL_DAY_US;
+        scheduler->calls_today = 0;
+    }
+    scheduler->calls_today++;
+
+    uint32_t delay_ms;
+    if (outcome->result == POLL_SUCCESS)
+    {
+        bool fast = outcome->alert_active || is_changing_quickly(scheduler, outcome);
+        scheduler->consecutive_failures = 0;
+        scheduler->has_previous = true;
+        scheduler->previous_temp = outcome->temp;
+        scheduler->previous_pressure = outcome->pressure;
+        delay_ms = add_jitter(fast ? POLL_FAST_INTERVAL_MS : POLL_INTERVAL_MS);
+    }
+    else
+    {
+        scheduler->consecutive_failures++;
+        delay_ms = get_backoff(scheduler->consecutive_failures);
+        if (outcome->result == POLL_RATE_LIMITED && outcome->retry_after_ms > delay_ms)
+            delay_ms = outcome->retry_after_ms < POLL_RETRY_AFTER_MAX_MS ? outcome->retry_after_ms : POLL_RETRY_AFTER_MAX_MS;
+    }
+
+    /* The calls beyond one per normal interval for the rest of the day are spare, the fast polls and the retries use them.
+     * Without spare calls the rest of the budget is spread evenly, with an empty budget the next call waits for the next day.
+     * Both delays are jittered too, otherwise the devices that ran out of calls would poll together again.
+     */
+    int64_t remaining_us = scheduler->day_start_us + POLL_DAY_US - now_us;
+    int64_t remaining_calls = (int64_t)WEATHER_DAILY_CALL_BUDGET - scheduler->calls_today;
+    int64_t reserved_calls = remaining_us / ((int64_t)POLL_INTERVAL_MS * 1000);
+    if (remaining_calls <= 0)
+    {
+        delay_ms = (uint32_t)(remaining_us / 1000) + esp_random() % POLL_INTERVAL_MS;
+    }
+    else if (remaining_calls <= reserved_calls)
+    {
+        uint32_t even_ms = add_jitter((uint32_t)(remaining_us / remaining_calls / 1000));
+        if (delay_ms < even_ms)
+            delay_ms = even_ms;
+    }
+    return delay_ms;
+}
+
+bool poll_scheduler_can_call(const Poll_scheduler* scheduler, int64_t now_us)
+{
+    return now_us - scheduler->day_start_us >= POLL_DAY_US || scheduler->calls_today < WEATHER_DAILY_CALL_BUDGET;
+}
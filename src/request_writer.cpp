@@ -0,0 +1,145 @@
+/* This module writes the HTTP requests of the weather providers into buffers owned by the caller.
+ * The text is copied with its exact length, the fixed point numbers are written from integers.
+ */
+#include <string.h>
+#include <math.h>
+#include "request_writer.h"
+
+static void put_text(Request_writer* writer, const char* text, size_t length)
+{
+    if (writer->length + length < writer->size)
+    {
+        memcpy(writer->buffer + writer->length, text, length);
+        writer->length += length;
+    }
+    else
+    {
+        writer->overflow = true;
+    }
+}
+
+static void put_string(Request_writer* writer, const char* text)
+{
+    put_text(writer, text, strlen(text));
+}
+
+static void put_char(Request_writer* writer, char c)
+{
+    put_text(writer, &c, 1);
+}
+
+//The unreserved characters of RFC 3986, and the comma of the lists like exclude=minutely,hourly
+static bool is_plain(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+           || c == '-' || c == '.' || c == '_' || c == '~' || c == ',';
+}
+
+static void put_encoded(Request_writer* writer, const char* text)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    const char* plain = text;
+    for (const char* c = text; ; c++)
+    {
+        if (*c != '\0' && is_plain(*c))
+            continue;
+        //The plain characters are copied at once
+        put_text(writer, plain, c - plain);
+        if (*c == '\0')
+            break;
+        char escaped[3] = {'%', hex[(unsigned char)*c >> 4], hex[*c & 0x0f]};
+        put_text(writer, escaped, sizeof(escaped));
+        plain = c + 1;
+    }
+}
+
+static void begin_query(Request_writer* writer, const char* key)
+{
+    put_char(writer, writer->has_query ? '&' : '?');
+    writer->has_query = true;
+    put_string(writer, key);
+    put_char(writer, '=');
+}
+
+void request_init(Request_writer* writer, char* buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->has_query = false;
+    writer->overflow = size == 0;
+}
+
+void request_begin(Request_writer* writer, const char* method, const char* path)
+{
+    put_string(writer, method);
+    put_char(writer, ' ');
+    put_string(writer, path);
+}
+
+void request_query(Request_writer* writer, const char* key, const char* value)
+{
+    begin_query(writer, key);
+    put_encoded(writer, value);
+}
+
+void request_query_fixed(Request_writer* writer, const char* key, float value, int decimals)
+{
+    static const uint32_t scales[REQUEST_WRITER_MAX_DECIMALS + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (decimals < 0)
+        decimals = 0;
+    if (decimals > REQUEST_WRITER_MAX_DECIMALS)
+        decimals = REQUEST_WRITER_MAX_DECIMALS;
+
+    begin_query(writer, key);
+    double scaled = nearbyint(fabs((double)value) * scales[decimals]);
+    //A coordinate always fits, anything that doesn't isn't a number the API would take either
+    if (!isfinite(scaled) || scaled >= 4294967296.0 * scales[decimals])
+    {
+        writer->overflow = true;
+        return;
+    }
+    uint64_t fixed = (uint64_t)scaled;
+    if (value < 0 && fixed != 0)
+        put_char(writer, '-');
+
+    //The digits are written from the end of the buffer, the fraction padded with zeros
+    char digits[24];
+    char* start = digits + sizeof(digits);
+    for (int i = 0; i < decimals; i++)
+    {
+        *--start = '0' + fixed % 10;
+        fixed /= 10;
+    }
+    if (decimals > 0)
+        *--start = '.';
+    do
+    {
+        *--start = '0' + fixed % 10;
+        fixed /= 10;
+    }
+    while (fixed != 0);
+    put_text(writer, start, digits + sizeof(digits) - start);
+}
+
+void request_end_line(Request_writer* writer)
+{
+    put_text(writer, " HTTP/1.1\r\n", 11);
+}
+
+void request_header(Request_writer* writer, const char* name, const char* value)
+{
+    put_string(writer, name);
+    put_text(writer, ": ", 2);
+    put_string(writer, value);
+    put_text(writer, "\r\n", 2);
+}
+
+int request_finish(Request_writer* writer)
+{
+    put_text(writer, "\r\n", 2);
+    if (writer->size == 0)
+        return -1;
+    writer->buffer[writer->length < writer->size ? writer->length : writer->size - 1] = '\0';
+    return writer->overflow ? -1 : (int)writer->length;
+}
@@ -60,4 +60,30 @@ int Room_data::get_desired_temperature()
 bool Room_data::get_is_auto()
 {
     return is_auto;
-}
\ No newline at end of file
+}
+
+/* The single-field setters and getters are atomic on their own, the lock only keeps the fields
+ * that belong together consistent: a snapshot never mixes two measurements.
+ */
+void Room_data::set_measurement(float internal_temperature, float internal_humidity, float gas_resistance)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    this -> internal_temperature = internal_temperature;
+    this -> internal_humidity = internal_humidity;
+    this -> gas_resistance = gas_resistance;
+    xSemaphoreGive(mutex);
+}
+
+Room_snapshot Room_data::get_snapshot()
+{
+    Room_snapshot snapshot;
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    snapshot.internal_temperature = internal_temperature;
+    snapshot.internal_humidity = internal_humidity;
+    snapshot.gas_resistance = gas_resistance;
+    snapshot.window_deg = window_deg;
+    snapshot.desired_temperature = desired_temperature;
+    snapshot.is_auto = is_auto;
+    xSemaphoreGive(mutex);
+    return snapshot;
+}
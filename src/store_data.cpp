@@ -1,23 +1,126 @@
-/* This module makes the handling of the NVS storage possible so that the 
+/* This module makes the handling of the NVS storage possible so that the
  * microcontroller can store data crucial to its operation.
+ * The whole configuration is stored as one versioned record with a CRC (a single NVS blob), which is
+ * loaded into a typed in-RAM copy (Stored_config) at boot. Reads are served from RAM, flash is only touched by writes.
+ * The values the sliders and the mode switch change are also kept in a separate 8 byte entry, so the frequent updates
+ * rewrite a single NVS entry instead of the whole record.
+ * Writes are write-behind: the setters only update RAM and mark the key dirty, a persistence
+ * task rewrites the record once the updates have been quiet for a while.
+ * Keys that belong together are committed through Config_transaction.
  */
 #include "esp_log.h"
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "esp_rom_crc.h"
 #include "nvs_flash.h"
 #include "nvs.h"
-#include <string>
+#include "credentials.h"
+#include "store_data.h"
 
+#define TAG "NVS"
+#define NVS_NAMESPACE "storage"
+#define NVS_RECORD_KEY "config"
+#define NVS_JOURNAL_KEY "txn"           //Only used by the legacy per-key layout
+#define CONFIG_SCHEMA_VERSION 1
+#define CONFIG_RECORD_MAX_SIZE 512
+#define NVS_CONTROL_KEY "control"
+#define CONTROL_VERSION 1
+
+//Every key of the configuration. The order matches config_key_names, the names of the legacy per-key layout.
+typedef enum
+{
+    CFG_SSID,
+    CFG_PASS,
+    CFG_APIKEY,
+    CFG_OP_MODE,
+    CFG_WINDOW_DEG,
+    CFG_DESIRED_TEMP,
+    CFG_LAT,
+    CFG_LON,
+    CFG_TZ,
+    CFG_KEY_COUNT
+} config_key_t;
+
+//The keys of the control entry, the rest are only written in the record
+#define CONTROL_KEYS ((1u << CFG_OP_MODE) | (1u << CFG_WINDOW_DEG) | (1u << CFG_DESIRED_TEMP))
+
+static const char *const config_key_names[CFG_KEY_COUNT] =
+{
+    "ssid", "pass", "apikey", "op_mode", "window_deg", "desired_temp", "lat", "lon", "tz"
+};
+
+/* The record that is stored on the flash. New fields must be appended to the end and the schema version increased:
+ * a record written by an older firmware is shorter, the missing fields keep their defaults.
+ * The coordinates and the window degree are fixed-point values multiplied by 100.
+ */
+struct __attribute__((packed)) Config_record
+{
+    uint16_t version;
+    uint16_t size;      //The size of the whole record
+    uint32_t crc;       //CRC32 of everything after this field
+    //Schema version 1
+    char ssid[NVS_SSID_SIZE];
+    char pass[NVS_PASS_SIZE];
+    char apikey[NVS_APIKEY_SIZE];
+    char tz[NVS_TZ_SIZE];
+    int32_t lat;
+    int32_t lon;
+    int32_t window_deg;
+    int16_t desired_temp;
+    uint8_t op_mode;
+};
+#define CONFIG_RECORD_HEADER_SIZE offsetof(Config_record, ssid)
+
+//The transaction journal of the legacy per-key layout
+struct Config_journal
+{
+    uint32_t keys;
+    Stored_config values;
+};
+
+static uint8_t record_buffer[CONFIG_RECORD_MAX_SIZE];
+static Metric_histogram commit_duration("nvs_commit_duration_seconds", "Duration of writing and committing the configuration record.",
+                                        NULL, METRICS_BUCKETS_FAST_US, METRICS_BUCKETS_FAST_COUNT);
+
+static Stored_config config;
+static nvs_handle_t config_handle;
+static bool config_loaded = false;
+static SemaphoreHandle_t config_mutex = NULL; //Guards the RAM copy and the dirty mask
+static SemaphoreHandle_t flash_mutex = NULL;  //Serializes the flash writes
+
+static uint32_t dirty_keys = 0;
+static uint32_t persist_quiet_ms = NVS_PERSIST_QUIET_MS;
+static uint32_t coalesced_updates = 0;
+static TaskHandle_t persist_task_handle = NULL;
+
+//Copying at most size - 1 characters, the copy is always terminated
+static void copy_str(char* dst, const char* src, size_t size)
+{
+    size_t length = strnlen(src, size - 1);
+    memcpy(dst, src, length);
+    dst[length] = '\0';
+}
 
-using namespace std;
+static void config_lock()
+{
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+}
 
-#define TAG "NVS"
+static void config_unlock()
+{
+    xSemaphoreGive(config_mutex);
+}
 
 //Initializing the storage
-esp_err_t init_nvs()
+static esp_err_t init_nvs()
 {
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
@@ -29,795 +132,821 @@ esp_err_t init_nvs()
     return ret;
 }
 
-//Writing the ssid to the storage
-void nvs_write_wifi_ssid(const char* ssid)
+//The values used when a key has never been written
+static void load_defaults()
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    memset(&config, 0, sizeof(config));
+    copy_str(config.ssid, WIFI_SSID_DEFAULT, sizeof(config.ssid));
+    copy_str(config.pass, WIFI_PWD_DEFAULT, sizeof(config.pass));
+    copy_str(config.tz, TIMEZONE_DEFAULT, sizeof(config.tz));
+    config.op_mode = false;
+    config.window_deg = 0;
+    config.desired_temp = 20;
+    config.lat = LAT;
+    config.lon = LON;
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+//Copying a single key between two configurations.
+static void copy_key(Stored_config &dst, const Stored_config &src, config_key_t key)
+{
+    switch (key)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {
-        //Write
-        ESP_LOGI(TAG, "Updating the Wi-Fi SSID in the NVS");
-        ret = nvs_set_str(nvs_handle, "ssid", ssid);
-        ESP_LOGI(TAG, "Updated ssid: %s", ssid);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Close
-        nvs_close(nvs_handle);
+        case CFG_SSID:
+            memcpy(dst.ssid, src.ssid, sizeof(dst.ssid));
+            break;
+        case CFG_PASS:
+            memcpy(dst.pass, src.pass, sizeof(dst.pass));
+            break;
+        case CFG_APIKEY:
+            memcpy(dst.apikey, src.apikey, sizeof(dst.apikey));
+            break;
+        case CFG_TZ:
+            memcpy(dst.tz, src.tz, sizeof(dst.tz));
+            break;
+        case CFG_OP_MODE:
+            dst.op_mode = src.op_mode;
+            break;
+        case CFG_WINDOW_DEG:
+            dst.window_deg = src.window_deg;
+            break;
+        case CFG_DESIRED_TEMP:
+            dst.desired_temp = src.desired_temp;
+            break;
+        case CFG_LAT:
+            dst.lat = src.lat;
+            break;
+        case CFG_LON:
+            dst.lon = src.lon;
+            break;
+        default:
+            break;
     }
 }
 
-//Writing the wifi password to the storage
-void nvs_write_wifi_pass(const char* pass)
+//Reading a single key of the legacy per-key layout into the RAM copy. The coordinates and the window degree were stored as fixed-point values multiplied by 100.
+static esp_err_t load_key(config_key_t key)
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    const char* name = config_key_names[key];
+    esp_err_t ret = ESP_OK;
+    size_t size;
+    int8_t i8_value;
+    int64_t i64_value;
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+    switch (key)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
+        case CFG_SSID:
+            size = sizeof(config.ssid);
+            ret = nvs_get_str(config_handle, name, config.ssid, &size);
+            break;
+        case CFG_PASS:
+            size = sizeof(config.pass);
+            ret = nvs_get_str(config_handle, name, config.pass, &size);
+            break;
+        case CFG_APIKEY:
+            size = sizeof(config.apikey);
+            ret = nvs_get_str(config_handle, name, config.apikey, &size);
+            break;
+        case CFG_TZ:
+            size = sizeof(config.tz);
+            ret = nvs_get_str(config_handle, name, config.tz, &size);
+            break;
+        case CFG_OP_MODE:
+            ret = nvs_get_i8(config_handle, name, &i8_value);
+            if (ret == ESP_OK)
+                config.op_mode = (i8_value != 0);
+            break;
+        case CFG_WINDOW_DEG:
+            ret = nvs_get_i64(config_handle, name, &i64_value);
+            if (ret == ESP_OK)
+                config.window_deg = i64_value / 100.0f;
+            break;
+        case CFG_DESIRED_TEMP:
+            ret = nvs_get_i64(config_handle, name, &i64_value);
+            if (ret == ESP_OK)
+                config.desired_temp = i64_value;
+            break;
+        case CFG_LAT:
+            ret = nvs_get_i64(config_handle, name, &i64_value);
+            if (ret == ESP_OK)
+                config.lat = i64_value / 100.0f;
+            break;
+        case CFG_LON:
+            ret = nvs_get_i64(config_handle, name, &i64_value);
+            if (ret == ESP_OK)
+                config.lon = i64_value / 100.0f;
+            break;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (ret)
     {
-        //Write
-        ESP_LOGI(TAG, "Updating the Wi-Fi password in the NVS: ***");
-        ret = nvs_set_str(nvs_handle, "pass", pass);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Close
-        nvs_close(nvs_handle);
+        case ESP_OK:
+            break;
+        case ESP_ERR_NVS_NOT_FOUND:
+            ESP_LOGI(TAG, "The value of '%s' is not initialized yet, using the default.", name);
+            break;
+        default :
+            ESP_LOGE(TAG, "Error (%s) reading '%s'!", esp_err_to_name(ret), name);
     }
+    return ret;
 }
 
-//Writing the Openweathermap API-key to the storage
-void nvs_write_apikey(const char* apikey)
+static void pack_record(const Stored_config &src, Config_record &record)
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    memset(&record, 0, sizeof(record));
+    record.version = CONFIG_SCHEMA_VERSION;
+    record.size = sizeof(record);
+    memcpy(record.ssid, src.ssid, sizeof(record.ssid));
+    memcpy(record.pass, src.pass, sizeof(record.pass));
+    memcpy(record.apikey, src.apikey, sizeof(record.apikey));
+    memcpy(record.tz, src.tz, sizeof(record.tz));
+    record.lat = (int32_t)(src.lat * 100);
+    record.lon = (int32_t)(src.lon * 100);
+    record.window_deg = (int32_t)(src.window_deg * 100);
+    record.desired_temp = src.desired_temp;
+    record.op_mode = src.op_mode ? 1 : 0;
+    record.crc = esp_rom_crc32_le(0, (const uint8_t*)&record + CONFIG_RECORD_HEADER_SIZE, record.size - CONFIG_RECORD_HEADER_SIZE);
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+static void unpack_record(const Config_record &record, Stored_config &dst)
+{
+    copy_str(dst.ssid, record.ssid, sizeof(dst.ssid));
+    copy_str(dst.pass, record.pass, sizeof(dst.pass));
+    copy_str(dst.apikey, record.apikey, sizeof(dst.apikey));
+    copy_str(dst.tz, record.tz, sizeof(dst.tz));
+    dst.lat = record.lat / 100.0f;
+    dst.lon = record.lon / 100.0f;
+    dst.window_deg = record.window_deg / 100.0f;
+    dst.desired_temp = record.desired_temp;
+    dst.op_mode = (record.op_mode != 0);
+}
+
+//Writing the whole configuration with one nvs_set_blob and one nvs_commit. The caller must hold flash_mutex.
+static esp_err_t write_record(const Stored_config &src)
+{
+    Config_record record;
+    pack_record(src, record);
+    Metric_timer timer(&commit_duration);
+    esp_err_t ret = nvs_set_blob(config_handle, NVS_RECORD_KEY, &record, sizeof(record));
+    if (ret == ESP_OK)
+        ret = nvs_commit(config_handle);
     if (ret != ESP_OK)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Error (%s) writing the configuration record!", esp_err_to_name(ret));
     }
-    else
-    {
-        //Write
-        ESP_LOGI(TAG, "Updating the Openweathermap API-key in the NVS");
-        ret = nvs_set_str(nvs_handle, "apikey", apikey);
-        ESP_LOGI(TAG, "Updated apikey: %s", apikey);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
+    return ret;
+}
 
-        //Close
-        nvs_close(nvs_handle);
-    }
+/* The control entry: window_deg * 100 in bits 0..31, desired_temp in bits 32..47, op_mode in bits 48..55
+ * and the version in bits 56..63. The entry is newer than the same values of the record whenever it exists.
+ */
+static int64_t pack_control(const Stored_config &src)
+{
+    uint64_t value = (uint32_t)(int32_t)(src.window_deg * 100)
+                     | (uint64_t)(uint16_t)(int16_t)src.desired_temp << 32
+                     | (uint64_t)(src.op_mode ? 1 : 0) << 48
+                     | (uint64_t)CONTROL_VERSION << 56;
+    return (int64_t)value;
 }
 
-//Writing the operation mode to the storage
-void nvs_write_operation_mode(bool op_mode)
+static bool unpack_control(int64_t packed, Stored_config &dst)
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    uint64_t value = (uint64_t)packed;
+    if ((value >> 56) != CONTROL_VERSION)
+        return false;
+    dst.window_deg = (int32_t)(uint32_t)value / 100.0f;
+    dst.desired_temp = (int16_t)(uint16_t)(value >> 32);
+    dst.op_mode = ((value >> 48) & 0xFF) != 0;
+    return true;
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+//Writing the control entry with one nvs_set_i64 and one nvs_commit. The caller must hold flash_mutex.
+static esp_err_t write_control(const Stored_config &src)
+{
+    Metric_timer timer(&commit_duration);
+    esp_err_t ret = nvs_set_i64(config_handle, NVS_CONTROL_KEY, pack_control(src));
+    if (ret == ESP_OK)
+        ret = nvs_commit(config_handle);
     if (ret != ESP_OK)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "Error (%s) writing the control entry!", esp_err_to_name(ret));
     }
-    else
-    {
-        //Write
-        ESP_LOGI(TAG, "Updating the operation mode in the NVS.");
-        if (op_mode)
-        {
-            ret = nvs_set_i8(nvs_handle, "op_mode", 1);
-            ESP_LOGI(TAG, "Updated operation mode set to: automatic");
-        }
-        else
-        {
-            ret = nvs_set_i8(nvs_handle, "op_mode", 0);
-            ESP_LOGI(TAG, "Updated operation mode set to: manual");
-        }
-
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
+    return ret;
+}
 
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
+/* Writing what the keys are stored in: the control entry for CONTROL_KEYS, the record for the others.
+ * *failed returns the keys that couldn't be written. The caller must hold flash_mutex.
+ */
+static esp_err_t write_keys(const Stored_config &src, uint32_t keys, uint32_t* failed)
+{
+    esp_err_t ret = ESP_OK;
+    *failed = 0;
+    if ((keys & ~CONTROL_KEYS) != 0 && (ret = write_record(src)) != ESP_OK)
+        *failed |= keys & ~CONTROL_KEYS;
+    if ((keys & CONTROL_KEYS) != 0)
+    {
+        esp_err_t control_ret = write_control(src);
+        if (control_ret != ESP_OK)
         {
-            ESP_LOGI(TAG, "Done");
+            *failed |= keys & CONTROL_KEYS;
+            ret = control_ret;
         }
-
-        //Close
-        nvs_close(nvs_handle);
     }
+    return ret;
 }
 
-//Writing the window degree to the storage
-void nvs_write_window_deg(float window_deg)
+/* Reading the record into the RAM copy, which holds the defaults at this point. The CRC covers the size
+ * the record was written with, so records of both older and newer schema versions can be validated.
+ */
+static esp_err_t read_record(uint16_t* version)
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    size_t size = 0;
+    esp_err_t ret = nvs_get_blob(config_handle, NVS_RECORD_KEY, NULL, &size);
     if (ret != ESP_OK)
+        return ret;
+    if (size < CONFIG_RECORD_HEADER_SIZE || size > sizeof(record_buffer))
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        ESP_LOGE(TAG, "The configuration record has an invalid size: %u", (unsigned)size);
+        return ESP_ERR_INVALID_SIZE;
     }
-    else
-    {
-        //Write
-        int64_t window_deg_t = window_deg * 100;
-        ESP_LOGI(TAG, "Updating the window degree in the NVS.");
-        ret = nvs_set_i64(nvs_handle, "window_deg", window_deg_t);
-        ESP_LOGI(TAG, "Updated the window degree: %.2f", window_deg);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
+    ret = nvs_get_blob(config_handle, NVS_RECORD_KEY, record_buffer, &size);
+    if (ret != ESP_OK)
+        return ret;
 
-        //Close
-        nvs_close(nvs_handle);
+    Config_record header;
+    memcpy(&header, record_buffer, CONFIG_RECORD_HEADER_SIZE);
+    if (header.size != size)
+    {
+        ESP_LOGE(TAG, "The configuration record is truncated.");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (esp_rom_crc32_le(0, record_buffer + CONFIG_RECORD_HEADER_SIZE, size - CONFIG_RECORD_HEADER_SIZE) != header.crc)
+    {
+        ESP_LOGE(TAG, "The CRC of the configuration record doesn't match.");
+        return ESP_ERR_INVALID_CRC;
     }
+
+    //Start from the defaults, so the fields that an older schema doesn't have keep them
+    Config_record record;
+    pack_record(config, record);
+    memcpy(&record, record_buffer, size < sizeof(record) ? size : sizeof(record));
+    unpack_record(record, config);
+    *version = header.version;
+    return ESP_OK;
 }
 
-//Writing the desired temperature to the storage
-void nvs_write_desired_temp(int desired_temp)
+/* Moving the per-key layout of the earlier firmware into the record, including a transaction journal that was
+ * left behind by a reset. The legacy keys are only erased once the record is safely on the flash.
+ */
+static esp_err_t migrate_legacy_keys()
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+    int found = 0;
+    for (int key = 0; key < CFG_KEY_COUNT; key++)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        if (load_key((config_key_t)key) == ESP_OK)
+            found++;
     }
-    else
+
+    Config_journal journal;
+    size_t size = sizeof(journal);
+    if (nvs_get_blob(config_handle, NVS_JOURNAL_KEY, &journal, &size) == ESP_OK && size == sizeof(journal))
     {
-        //Write
-        ESP_LOGI(TAG, "Updating the desired temperature in the NVS.");
-        ret = nvs_set_i64(nvs_handle, "desired_temp", desired_temp);
-        ESP_LOGI(TAG, "Updated the desired temperature: %d", desired_temp);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
+        ESP_LOGI(TAG, "Replaying an interrupted configuration transaction.");
+        for (int key = 0; key < CFG_KEY_COUNT; key++)
         {
-            ESP_LOGI(TAG, "Done");
+            if (journal.keys & (1u << key))
+                copy_key(config, journal.values, (config_key_t)key);
         }
+        found++;
+    }
 
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
+    esp_err_t ret = write_record(config);
+    if (ret != ESP_OK || found == 0)
+        return ret;
 
-        //Close
-        nvs_close(nvs_handle);
+    ESP_LOGI(TAG, "Migrated %d legacy key(s) into the configuration record.", found);
+    for (int key = 0; key < CFG_KEY_COUNT; key++)
+    {
+        nvs_erase_key(config_handle, config_key_names[key]);
     }
+    nvs_erase_key(config_handle, NVS_JOURNAL_KEY);
+    return nvs_commit(config_handle);
 }
 
-//Writing the latitude to the storage
-void nvs_write_latitude(float lat)
+/* Rewriting the record if anything is dirty. The RAM lock is only held while taking the snapshot,
+ * so the setters never wait for the flash.
+ */
+esp_err_t nvs_config_flush()
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+    if (!config_loaded)
+        return ESP_ERR_INVALID_STATE;
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(flash_mutex, portMAX_DELAY);
+    config_lock();
+    Stored_config snapshot = config;
+    uint32_t keys = dirty_keys;
+    uint32_t updates = coalesced_updates;
+    dirty_keys = 0;
+    coalesced_updates = 0;
+    config_unlock();
+
+    esp_err_t ret = ESP_OK;
+    if (keys != 0)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {
-        int64_t lat_t = lat * 100;
-        //Write
-        ESP_LOGI(TAG, "Updating the latitude in the NVS.");
-        ret = nvs_set_i64(nvs_handle, "lat", lat_t);
-        ESP_LOGI(TAG, "Updated the latitude: %.2f", lat);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
+        uint32_t failed;
+        ret = write_keys(snapshot, keys, &failed);
+        if (ret == ESP_OK)
         {
-            ESP_LOGI(TAG, "Done");
+            ESP_LOGI(TAG, "Committed %d key(s) to the NVS in %lld us, %" PRIu32 " update(s) coalesced.",
+                     __builtin_popcount(keys), (long long)(esp_timer_get_time() - start), updates);
         }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
         else
         {
-            ESP_LOGI(TAG, "Done");
+            //Keep the keys dirty so the next flush retries them
+            config_lock();
+            dirty_keys |= failed;
+            config_unlock();
         }
-
-        //Close
-        nvs_close(nvs_handle);
     }
+    xSemaphoreGive(flash_mutex);
+    return ret;
 }
 
-//Writing the longitude to the storage
-void nvs_write_longitude(float lon)
+/* The persistence task sleeps until a key becomes dirty, then waits until no update has arrived for the quiet period.
+ * A steady stream of updates can postpone the commit by at most NVS_PERSIST_MAX_DEFER quiet periods.
+ * A failed commit leaves the keys dirty, the task wakes up by itself to retry them, backing off while the flash keeps failing.
+ */
+static void persist_task(void *params)
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
-    {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
+    uint32_t retry_ms = 0;
+    while (1)
     {
-        //Write
-        int64_t lon_t = lon * 100;
-        ESP_LOGI(TAG, "Updating the longitude in the NVS.");
-        ret = nvs_set_i64(nvs_handle, "lon", lon_t);
-        ESP_LOGI(TAG, "Updated the longitude: %.2f", lon);
-        if (ret != ESP_OK)
+        ulTaskNotifyTake(pdTRUE, retry_ms > 0 ? pdMS_TO_TICKS(retry_ms) : portMAX_DELAY);
+        TickType_t first_update = xTaskGetTickCount();
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(persist_quiet_ms)) > 0)
         {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
+            if (xTaskGetTickCount() - first_update >= pdMS_TO_TICKS(persist_quiet_ms * NVS_PERSIST_MAX_DEFER))
+                break;
         }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
+        if (nvs_config_flush() == ESP_OK)
         {
-            ESP_LOGI(TAG, "Failed");
-        } 
+            retry_ms = 0;
+        }
         else
         {
-            ESP_LOGI(TAG, "Done");
+            retry_ms = retry_ms == 0 ? NVS_PERSIST_RETRY_MS : retry_ms * 2;
+            if (retry_ms > NVS_PERSIST_RETRY_MAX_MS)
+                retry_ms = NVS_PERSIST_RETRY_MAX_MS;
+            ESP_LOGW(TAG, "Committing the dirty keys failed, retrying in %" PRIu32 " ms.", retry_ms);
         }
-
-        //Close
-        nvs_close(nvs_handle);
     }
 }
 
-//Writing the ssid to the storage
-void nvs_write_timezone(const char* tz)
+static void persist_on_shutdown()
 {
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    nvs_config_flush();
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+//Marking a key dirty and waking up the persistence task. The caller must hold the lock.
+static void mark_dirty(config_key_t key)
+{
+    dirty_keys |= (1u << key);
+    coalesced_updates++;
+    if (persist_task_handle == NULL)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        xTaskCreate(persist_task, "nvs_persist", 3072, NULL, 2, &persist_task_handle);
+        esp_register_shutdown_handler(persist_on_shutdown);
     }
-    else
-    {
-        //Write
-        ESP_LOGI(TAG, "Updating the timezone in the NVS");
-        ret = nvs_set_str(nvs_handle, "tz", tz);
-        ESP_LOGI(TAG, "Updated timezone: %s", tz);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
-
-        //Commit the written value..
-        ESP_LOGI(TAG, "Committing updates in NVS ... ");
-        ret = nvs_commit(nvs_handle);
-        if (ret != ESP_OK)
-        {
-            ESP_LOGI(TAG, "Failed");
-        } 
-        else
-        {
-            ESP_LOGI(TAG, "Done");
-        }
+    xTaskNotifyGive(persist_task_handle);
+}
 
-        //Close
-        nvs_close(nvs_handle);
-    }
+void nvs_config_set_quiet_period(uint32_t quiet_ms)
+{
+    persist_quiet_ms = quiet_ms;
 }
 
-//Reading the ssid from the storage
-const char* nvs_read_wifi_ssid()
+/* Initializing the non-volatile storage(NVS), opening the namespace for the lifetime of the firmware
+ * and loading the configuration record into RAM. The readers call it lazily as well, so the order of the initialization doesn't matter.
+ */
+esp_err_t nvs_config_init()
 {
-    char* ssid = NULL;
-    size_t size = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    if (config_loaded)
+        return ESP_OK;
+
+    if (config_mutex == NULL)
+        config_mutex = xSemaphoreCreateMutex();
+    if (flash_mutex == NULL)
+        flash_mutex = xSemaphoreCreateMutex();
+    load_defaults();
 
-    //Open the NVS
+    init_nvs();
     ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &config_handle);
     if (ret != ESP_OK)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Reading the ssid length
-        ret = nvs_get_str(nvs_handle, "ssid", NULL, &size);
-        ssid = (char*)malloc(size*sizeof(char*));
-        //Read
-        ret = nvs_get_str(nvs_handle, "ssid", ssid, &size);
-        ESP_LOGI(TAG, "Reading ssid from NVS: %s ", ssid);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
+        ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        return ret;
+    }
 
-        //Close
-        nvs_close(nvs_handle);
+    //One flash read at boot. Without a record the legacy per-key layout is migrated.
+    uint16_t version = 0;
+    ret = read_record(&version);
+    if (ret == ESP_OK && version < CONFIG_SCHEMA_VERSION)
+    {
+        ESP_LOGI(TAG, "Upgrading the configuration record from schema version %u to %u.", version, CONFIG_SCHEMA_VERSION);
+        write_record(config);
     }
-    return ssid;
+    else if (ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        migrate_legacy_keys();
+    }
+    else if (ret == ESP_OK && version > CONFIG_SCHEMA_VERSION)
+    {
+        ESP_LOGW(TAG, "The configuration record is of a newer firmware (schema version %u), the fields this firmware doesn't know "
+                 "are lost at the next change of a setting.", version);
+    }
+    else if (ret != ESP_OK)
+    {
+        //The record is left on the flash: a read error may be transient, and the stored credentials aren't lost to it.
+        //The defaults are only written once a setting is changed.
+        ESP_LOGE(TAG, "Error (%s) reading the configuration record, running on the defaults!", esp_err_to_name(ret));
+    }
+    int64_t control;
+    if (nvs_get_i64(config_handle, NVS_CONTROL_KEY, &control) == ESP_OK && !unpack_control(control, config))
+    {
+        ESP_LOGW(TAG, "The control entry is of an unknown version, using the values of the record.");
+    }
+    config_loaded = true;
+
+    ESP_LOGI(TAG, "Configuration loaded: ssid: %s, mode: %s, window: %.2f, desired temperature: %d, lat: %.2f, lon: %.2f, tz: %s",
+             config.ssid, config.op_mode ? "automatic" : "manual", config.window_deg, config.desired_temp,
+             config.lat, config.lon, config.tz);
+    return ESP_OK;
 }
 
-//Reading the wifi password from the storage
-const char* nvs_read_wifi_pass()
+static void ensure_loaded()
 {
-    char* pass = NULL;
-    size_t size = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    if (!config_loaded)
+        nvs_config_init();
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+//Updating a string key. It is only marked dirty if the value has changed.
+static void write_str(config_key_t key, char* field, size_t size, const char* value)
+{
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if (strncmp(field, value, size - 1) != 0)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Reading the ssid length
-        ret = nvs_get_str(nvs_handle, "pass", NULL, &size);
-        pass = (char*)malloc(size*sizeof(char*));
-        //Read
-        ret = nvs_get_str(nvs_handle, "pass", pass, &size);
-        ESP_LOGI(TAG, "Reading password from NVS: ***");
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
-
-        //Close
-        nvs_close(nvs_handle);
+        copy_str(field, value, size);
+        mark_dirty(key);
     }
-    return pass;
+    config_unlock();
 }
 
-//Reading the Openweathermap API-key from the storage
-const char* nvs_read_apikey()
+//Writing the ssid to the storage
+void nvs_write_wifi_ssid(const char* ssid)
 {
-    char* apikey = NULL;
-    size_t size = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    ESP_LOGI(TAG, "Updating the Wi-Fi SSID in the NVS: %s", ssid);
+    write_str(CFG_SSID, config.ssid, sizeof(config.ssid), ssid);
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
-    {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Reading the ssid length
-        ret = nvs_get_str(nvs_handle, "apikey", NULL, &size);
-        apikey = (char*)malloc(size*sizeof(char*));
-        //Read
-        ret = nvs_get_str(nvs_handle, "apikey", apikey, &size);
-        ESP_LOGI(TAG, "Reading Openweathermap API-key from NVS: %s ", apikey);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
+//Writing the wifi password to the storage
+void nvs_write_wifi_pass(const char* pass)
+{
+    ESP_LOGI(TAG, "Updating the Wi-Fi password in the NVS: ***");
+    write_str(CFG_PASS, config.pass, sizeof(config.pass), pass);
+}
 
-        //Close
-        nvs_close(nvs_handle);
-    }
-    return apikey;
+//Writing the Openweathermap API-key to the storage
+void nvs_write_apikey(const char* apikey)
+{
+    ESP_LOGI(TAG, "Updating the Openweathermap API-key in the NVS: %s", apikey);
+    write_str(CFG_APIKEY, config.apikey, sizeof(config.apikey), apikey);
 }
 
-//Reading the operation mode from the storage
-bool nvs_read_operation_mode()
+//Writing the timezone to the storage
+void nvs_write_timezone(const char* tz)
 {
-    int8_t op_mode = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    ESP_LOGI(TAG, "Updating the timezone in the NVS: %s", tz);
+    write_str(CFG_TZ, config.tz, sizeof(config.tz), tz);
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+//Writing the operation mode to the storage
+void nvs_write_operation_mode(bool op_mode)
+{
+    ESP_LOGI(TAG, "Updating the operation mode in the NVS: %s", op_mode ? "automatic" : "manual");
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if (config.op_mode != op_mode)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        config.op_mode = op_mode;
+        mark_dirty(CFG_OP_MODE);
     }
-    else
-    {   
-        //Read
-        ret = nvs_get_i8(nvs_handle, "op_mode", &op_mode);
-        if(op_mode)
-        {
-            ESP_LOGI(TAG, "Reading operation mode from NVS: automatic");
-        }
-        else
-        {
-            ESP_LOGI(TAG, "Reading operation mode from NVS: manual");
-        }
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
-        //Close
-        nvs_close(nvs_handle);
-    }
-    if(op_mode)
+    config_unlock();
+}
+
+//Writing the window degree to the storage
+void nvs_write_window_deg(float window_deg)
+{
+    ESP_LOGI(TAG, "Updating the window degree in the NVS: %.2f", window_deg);
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if ((int64_t)(config.window_deg * 100) != (int64_t)(window_deg * 100))
     {
-        return true;
+        config.window_deg = window_deg;
+        mark_dirty(CFG_WINDOW_DEG);
     }
-    else
+    config_unlock();
+}
+
+//Writing the desired temperature to the storage
+void nvs_write_desired_temp(int desired_temp)
+{
+    ESP_LOGI(TAG, "Updating the desired temperature in the NVS: %d", desired_temp);
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if (config.desired_temp != desired_temp)
     {
-        return false;
+        config.desired_temp = desired_temp;
+        mark_dirty(CFG_DESIRED_TEMP);
     }
-    
+    config_unlock();
 }
 
-//Reading the window degree from the storage
-float nvs_read_window_deg()
+//Writing the latitude to the storage
+void nvs_write_latitude(float lat)
 {
-    int64_t window_deg_t = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+    ESP_LOGI(TAG, "Updating the latitude in the NVS: %.2f", lat);
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if ((int64_t)(config.lat * 100) != (int64_t)(lat * 100))
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Read
-        ret = nvs_get_i64(nvs_handle, "window_deg", &window_deg_t);
-        printf("Window degree = %" PRIu64 "\n", window_deg_t);
-        //ESP_LOGI(TAG, "Reading window degree from NVS: %.2f ", window_deg_t);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
-        //Close
-        nvs_close(nvs_handle);
+        config.lat = lat;
+        mark_dirty(CFG_LAT);
     }
-    return window_deg_t;
+    config_unlock();
 }
 
-//Reading the desired temperature from the storage
-int nvs_read_desired_temp()
+//Writing the longitude to the storage
+void nvs_write_longitude(float lon)
 {
-    int64_t desired_temp_t = 20;
-    int desired_temp = 20;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+    ESP_LOGI(TAG, "Updating the longitude in the NVS: %.2f", lon);
+    ensure_loaded();
+    if (!config_loaded)
+        return;
+    config_lock();
+    if ((int64_t)(config.lon * 100) != (int64_t)(lon * 100))
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Read
-        ret = nvs_get_i64(nvs_handle, "desired_temp", &desired_temp_t);
-        desired_temp = desired_temp_t;
-        ESP_LOGI(TAG, "Reading the desired temperature from NVS: %d", desired_temp);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
-        //Close
-        nvs_close(nvs_handle);
+        config.lon = lon;
+        mark_dirty(CFG_LON);
     }
+    config_unlock();
+}
 
-    return desired_temp;
+//Copying a string key into the caller's buffer under the lock. Returns ESP_ERR_INVALID_SIZE if it had to be truncated.
+static esp_err_t read_str(const char* field, char* dst, size_t size)
+{
+    if (dst == NULL || size == 0)
+        return ESP_ERR_INVALID_ARG;
+    ensure_loaded();
+    if (!config_loaded)
+    {
+        dst[0] = '\0';
+        return ESP_ERR_INVALID_STATE;
+    }
+    config_lock();
+    size_t len = strlen(field);
+    copy_str(dst, field, size);
+    config_unlock();
+    return (len < size) ? ESP_OK : ESP_ERR_INVALID_SIZE;
 }
 
-//Reading the latitude from the storage
-float nvs_read_latitude()
+//Reading the ssid from the RAM copy
+esp_err_t nvs_read_wifi_ssid(char* ssid, size_t size)
 {
-    int64_t lat_t = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    return read_str(config.ssid, ssid, size);
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+//Reading the wifi password from the RAM copy
+esp_err_t nvs_read_wifi_pass(char* pass, size_t size)
+{
+    return read_str(config.pass, pass, size);
+}
+
+//Reading the Openweathermap API-key from the RAM copy
+esp_err_t nvs_read_apikey(char* apikey, size_t size)
+{
+    return read_str(config.apikey, apikey, size);
+}
+
+//Reading the timezone from the RAM copy
+esp_err_t nvs_read_timezone(char* tz, size_t size)
+{
+    return read_str(config.tz, tz, size);
+}
+
+//Copying the whole configuration at once, so the keys are consistent with each other
+void nvs_read_config(Stored_config* out)
+{
+    ensure_loaded();
+    if (config_mutex == NULL)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Read
-        ret = nvs_get_i64(nvs_handle, "lat", &lat_t);
-        printf("Latitude = %" PRIu64 "\n", lat_t);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
-        //Close
-        nvs_close(nvs_handle);
+        *out = config;
+        return;
     }
-    return lat_t;
+    config_lock();
+    *out = config;
+    config_unlock();
+}
+
+//Reading the operation mode from the RAM copy
+bool nvs_read_operation_mode()
+{
+    ensure_loaded();
+    return config.op_mode;
+}
+
+//Reading the window degree from the RAM copy
+float nvs_read_window_deg()
+{
+    ensure_loaded();
+    return config.window_deg;
+}
+
+//Reading the desired temperature from the RAM copy
+int nvs_read_desired_temp()
+{
+    ensure_loaded();
+    return config.desired_temp;
+}
+
+//Reading the latitude from the RAM copy
+float nvs_read_latitude()
+{
+    ensure_loaded();
+    return config.lat;
 }
 
-//Reading the longitude from the storage
+//Reading the longitude from the RAM copy
 float nvs_read_longitude()
 {
-    int64_t lon_t = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
+    ensure_loaded();
+    return config.lon;
+}
 
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (ret != ESP_OK)
+Config_transaction::Config_transaction()
+{
+    memset(&staged, 0, sizeof(staged));
+    keys = 0;
+}
+
+void Config_transaction::set_wifi_ssid(const char* ssid)
+{
+    copy_str(staged.ssid, ssid, sizeof(staged.ssid));
+    keys |= (1u << CFG_SSID);
+}
+
+void Config_transaction::set_wifi_pass(const char* pass)
+{
+    copy_str(staged.pass, pass, sizeof(staged.pass));
+    keys |= (1u << CFG_PASS);
+}
+
+void Config_transaction::set_apikey(const char* apikey)
+{
+    copy_str(staged.apikey, apikey, sizeof(staged.apikey));
+    keys |= (1u << CFG_APIKEY);
+}
+
+void Config_transaction::set_timezone(const char* tz)
+{
+    copy_str(staged.tz, tz, sizeof(staged.tz));
+    keys |= (1u << CFG_TZ);
+}
+
+void Config_transaction::set_operation_mode(bool op_mode)
+{
+    staged.op_mode = op_mode;
+    keys |= (1u << CFG_OP_MODE);
+}
+
+void Config_transaction::set_window_deg(float window_deg)
+{
+    staged.window_deg = window_deg;
+    keys |= (1u << CFG_WINDOW_DEG);
+}
+
+void Config_transaction::set_desired_temp(int desired_temp)
+{
+    staged.desired_temp = desired_temp;
+    keys |= (1u << CFG_DESIRED_TEMP);
+}
+
+void Config_transaction::set_latitude(float lat)
+{
+    staged.lat = lat;
+    keys |= (1u << CFG_LAT);
+}
+
+void Config_transaction::set_longitude(float lon)
+{
+    staged.lon = lon;
+    keys |= (1u << CFG_LON);
+}
+
+/* Applying the staged keys to the RAM copy at once, then rewriting the record synchronously.
+ * The record is a single blob, so a power cut leaves either the old or the new values on the flash.
+ */
+esp_err_t Config_transaction::commit(int64_t* latency_us)
+{
+    if (keys == 0)
+        return ESP_OK;
+    ensure_loaded();
+    if (!config_loaded)
+        return ESP_ERR_INVALID_STATE;
+
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(flash_mutex, portMAX_DELAY);
+    config_lock();
+    for (int key = 0; key < CFG_KEY_COUNT; key++)
     {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+        if (keys & (1u << key))
+            copy_key(config, staged, (config_key_t)key);
     }
-    else
-    {   
-        //Read
-        ret = nvs_get_i64(nvs_handle, "lon", &lon_t);
-        printf("Window degree = %" PRIu64 "\n", lon_t);
-        switch (ret)
+    //The pending keys are written as well, they may share the record or the control entry with the staged ones
+    Stored_config snapshot = config;
+    uint32_t pending = dirty_keys;
+    dirty_keys = 0;
+    coalesced_updates = 0;
+    config_unlock();
+
+    uint32_t failed;
+    esp_err_t ret = write_keys(snapshot, keys | pending, &failed);
+    xSemaphoreGive(flash_mutex);
+
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (latency_us != NULL)
+        *latency_us = elapsed;
+
+    if (failed != 0)
+    {
+        //The RAM copy is already updated, let the persistence task retry the flash
+        config_lock();
+        for (int key = 0; key < CFG_KEY_COUNT; key++)
         {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
+            if (failed & (1u << key))
+                mark_dirty((config_key_t)key);
         }
-        //Close
-        nvs_close(nvs_handle);
+        config_unlock();
     }
-    return lon_t;
+    if ((failed & keys) != 0)
+    {
+        ESP_LOGE(TAG, "Error (%s) committing the transaction, retrying in the background.", esp_err_to_name(ret));
+        return ret;
+    }
+    ESP_LOGI(TAG, "Transaction of %d key(s) committed in %lld us.", __builtin_popcount(keys), (long long)elapsed);
+    return ESP_OK;
 }
 
-//Reading the timezone from the storage
-const char* nvs_read_timezone()
+/* The blobs of the other modules share the namespace and the flash lock of the configuration,
+ * but not its record: they are written when their owner decides to, not by the persistence task.
+ */
+esp_err_t nvs_write_blob(const char* key, const void* data, size_t size)
 {
-    char* tz = NULL;
-    size_t size = 0;
-    //Initializing the non-volatile storage(NVS), and checks if the NVS partitions have been corrupted.
-    esp_err_t ret = init_nvs();
-
-    //Open the NVS
-    ESP_LOGI(TAG, "Opening Non-Volatile Storage (NVS) handle... ");
-    nvs_handle_t nvs_handle;
-    ret = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    ensure_loaded();
+    if (!config_loaded)
+        return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(flash_mutex, portMAX_DELAY);
+    esp_err_t ret = nvs_set_blob(config_handle, key, data, size);
+    if (ret == ESP_OK)
+        ret = nvs_commit(config_handle);
+    xSemaphoreGive(flash_mutex);
     if (ret != ESP_OK)
-    {
-        ESP_LOGI(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
-    }
-    else
-    {   
-        //Reading the ssid length
-        ret = nvs_get_str(nvs_handle, "tz", NULL, &size);
-        tz = (char*)malloc(size*sizeof(char*));
-        //Read
-        ret = nvs_get_str(nvs_handle, "tz", tz, &size);
-        ESP_LOGI(TAG, "Reading timezone from NVS: %s ", tz);
-        switch (ret)
-        {
-            case ESP_OK:
-                ESP_LOGI(TAG, "Done!");
-                break;
-            case ESP_ERR_NVS_NOT_FOUND:
-                ESP_LOGI(TAG, "The value is not initialized yet!");
-                break;
-            default :
-                ESP_LOGI(TAG, "Error (%s) reading!", esp_err_to_name(ret));
-        }
+        ESP_LOGE(TAG, "Error (%s) writing '%s'!", esp_err_to_name(ret), key);
+    return ret;
+}
 
-        //Close
-        nvs_close(nvs_handle);
-    }
-    return tz;
-}
\ No newline at end of file
+esp_err_t nvs_read_blob(const char* key, void* data, size_t* size)
+{
+    ensure_loaded();
+    if (!config_loaded)
+        return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(flash_mutex, portMAX_DELAY);
+    esp_err_t ret = nvs_get_blob(config_handle, key, data, size);
+    xSemaphoreGive(flash_mutex);
+    if (ret != ESP_OK && ret != ESP_ERR_NVS_NOT_FOUND)
+        ESP_LOGE(TAG, "Error (%s) reading '%s'!", esp_err_to_name(ret), key);
+    return ret;
+}
@@ -0,0 +1,108 @@
+/* This module connects to a weather server with a plain TCP socket, for the servers on the local network
+ * that answer without TLS, like the replay server of the host build or a caching proxy.
+ */
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "tcp_transport.h"
+
+static const char *TAG = "TCP_TRANSPORT";
+
+Tcp_transport::Tcp_transport(uint32_t read_timeout_ms)
+{
+    this -> read_timeout_ms = read_timeout_ms;
+}
+
+int Tcp_transport::connect(const char* host, const char* port)
+{
+    struct addrinfo hints = {};
+    struct addrinfo *address = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    int ret = getaddrinfo(host, port, &hints, &address);
+    if (ret != 0 || address == NULL)
+    {
+        ESP_LOGE(TAG, "DNS lookup failed for %s, error %d", host, ret);
+        return -1;
+    }
+
+    sock = socket(address->ai_family, address->ai_socktype, 0);
+    if (sock < 0)
+    {
+        ESP_LOGE(TAG, "Failed to allocate a socket, errno %d", errno);
+        freeaddrinfo(address);
+        return -1;
+    }
+    if (::connect(sock, address->ai_addr, address->ai_addrlen) != 0)
+    {
+        ESP_LOGE(TAG, "Connecting to %s:%s failed, errno %d", host, port, errno);
+        freeaddrinfo(address);
+        ::close(sock);
+        sock = -1;
+        return -1;
+    }
+    freeaddrinfo(address);
+
+    //The request is sent in one write, without waiting for the acknowledgement of the previous segment
+    int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    struct timeval timeout;
+    timeout.tv_sec = read_timeout_ms / 1000;
+    timeout.tv_usec = (read_timeout_ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    connected = true;
+    return 0;
+}
+
+int Tcp_transport::write(const char* data, size_t length)
+{
+    size_t written_bytes = 0;
+    while (written_bytes < length)
+    {
+        int ret = send(sock, data + written_bytes, length - written_bytes, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ESP_LOGE(TAG, "send failed, errno %d", errno);
+            return -1;
+        }
+        written_bytes += ret;
+    }
+    return 0;
+}
+
+int Tcp_transport::read(char* buf, size_t size)
+{
+    int ret;
+    do {
+        ret = recv(sock, buf, size, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+    {
+        ESP_LOGE(TAG, "recv failed, errno %d", errno);
+        return -1;
+    }
+    return ret;
+}
+
+//Nothing may be waiting on an idle connection, not even its end
+bool Tcp_transport::is_usable()
+{
+    char c;
+    if (!connected)
+        return false;
+    int ret = recv(sock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void Tcp_transport::disconnect()
+{
+    if (sock >= 0)
+        ::close(sock);
+    sock = -1;
+    connected = false;
+}
@@ -0,0 +1,226 @@
+/* This module uses Mbed-TLS to connect to the weather API. Used source:
+ *
+ * https://github.com/espressif/esp-idf/blob/master/examples/protocols/https_mbedtls/main/https_mbedtls_example_main.c
+ *
+ * License: Apache-2.0
+ * 2015-2021 Espressif Systems (Shanghai) CO LTD
+ */
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/esp_debug.h"
+#include "mbedtls/error.h"
+#include "esp_crt_bundle.h"
+#include "metrics.h"
+#include "tls_transport.h"
+
+static const char *TAG = "TLS_TRANSPORT";
+#define HANDSHAKE_NAME "weather_tls_handshake_duration_seconds"
+#define HANDSHAKE_HELP "Duration of the TLS handshakes with the weather API, resumed ones skip the certificate and the key exchange."
+static Metric_histogram handshake_full(HANDSHAKE_NAME, HANDSHAKE_HELP, "session=\"full\"", METRICS_BUCKETS_SLOW_US, METRICS_BUCKETS_SLOW_COUNT);
+static Metric_histogram handshake_resumed(HANDSHAKE_NAME, HANDSHAKE_HELP, "session=\"resumed\"", METRICS_BUCKETS_SLOW_US, METRICS_BUCKETS_SLOW_COUNT);
+
+static void log_error(const char* function, int ret)
+{
+    char buf[100];
+    mbedtls_strerror(ret, buf, sizeof(buf));
+    ESP_LOGE(TAG, "%s returned -0x%x - %s", function, -ret, buf);
+}
+
+void Tls_transport::setup(uint32_t read_timeout_ms)
+{
+    int ret;
+    if (set_up)
+        return;
+    mbedtls_ssl_init(&ssl);
+    mbedtls_x509_crt_init(&cacert);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_net_init(&server_fd);
+    mbedtls_ssl_session_init(&saved_session);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_entropy_init(&entropy);
+
+    ESP_LOGI(TAG, "Seeding the random number generator");
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, NULL, 0)) != 0)
+    {
+        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed returned %d", ret);
+        abort();
+    }
+
+    ESP_LOGI(TAG, "Attaching the certificate bundle...");
+    if ((ret = esp_crt_bundle_attach(&conf)) < 0)
+    {
+        ESP_LOGE(TAG, "esp_crt_bundle_attach returned -0x%x\n\n", -ret);
+        abort();
+    }
+
+    ESP_LOGI(TAG, "Setting up the SSL/TLS structure...");
+    if ((ret = mbedtls_ssl_config_defaults(&conf,
+                                          MBEDTLS_SSL_IS_CLIENT,
+                                          MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+    {
+        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults returned %d", ret);
+        abort();
+    }
+
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &cacert, NULL);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    //A kept-alive connection isn't closed by the server to end a response
+    mbedtls_ssl_conf_read_timeout(&conf, read_timeout_ms);
+
+    if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0)
+    {
+        ESP_LOGE(TAG, "mbedtls_ssl_setup returned -0x%x\n\n", -ret);
+        abort();
+    }
+    set_up = true;
+}
+
+void Tls_transport::forget_saved_session()
+{
+    mbedtls_ssl_session_free(&saved_session);
+    has_saved_session = false;
+}
+
+/* A resumed session keeps the start time of the one it resumes, a full handshake starts a new session.
+ * mbedtls has no public accessor for it, the field of the session structure is read directly.
+ */
+bool Tls_transport::is_resumed_session(const mbedtls_ssl_session* session) const
+{
+    return has_saved_session && session->MBEDTLS_PRIVATE(start) == saved_session.MBEDTLS_PRIVATE(start);
+}
+
+//Keeping the session for the next connection. mbedtls_ssl_get_session() can only be called once per connection.
+void Tls_transport::save_session(uint32_t handshake_us)
+{
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_get_session(&ssl, &session) == 0)
+    {
+        bool resumed = is_resumed_session(&session);
+        (resumed ? handshake_resumed : handshake_full).observe_us(handshake_us);
+        ESP_LOGI(TAG, "%s handshake in %" PRIu32 " ms", resumed ? "Resumed" : "Full", handshake_us / 1000);
+        forget_saved_session();
+        saved_session = session;
+        has_saved_session = true;
+    }
+    else
+    {
+        handshake_full.observe_us(handshake_us);
+        ESP_LOGI(TAG, "Full handshake in %" PRIu32 " ms, the session can't be resumed", handshake_us / 1000);
+        mbedtls_ssl_session_free(&session);
+        forget_saved_session();
+    }
+}
+
+int Tls_transport::connect(const char* host, const char* port)
+{
+    int ret, flags;
+    char buf[256];
+
+    if ((ret = mbedtls_ssl_set_hostname(&ssl, host)) != 0)
+    {
+        ESP_LOGE(TAG, "mbedtls_ssl_set_hostname returned -0x%x", -ret);
+        return ret;
+    }
+    mbedtls_net_init(&server_fd);
+    if ((ret = mbedtls_net_connect(&server_fd, host, port, MBEDTLS_NET_PROTO_TCP)) != 0)
+    {
+        log_error("mbedtls_net_connect", ret);
+        mbedtls_net_free(&server_fd);
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Connected.");
+    mbedtls_ssl_set_bio(&ssl, &server_fd, mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+    if (has_saved_session && (ret = mbedtls_ssl_set_session(&ssl, &saved_session)) != 0)
+    {
+        ESP_LOGW(TAG, "mbedtls_ssl_set_session returned -0x%x, doing a full handshake", -ret);
+    }
+
+    ESP_LOGI(TAG, "Performing the SSL/TLS handshake...");
+    int64_t handshake_start = esp_timer_get_time();
+    while ((ret = mbedtls_ssl_handshake(&ssl)) != 0)
+    {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+        {
+            log_error("mbedtls_ssl_handshake", ret);
+            //The saved session may be the reason, the next connection starts over
+            forget_saved_session();
+            mbedtls_ssl_session_reset(&ssl);
+            mbedtls_net_free(&server_fd);
+            return ret;
+        }
+    }
+    uint32_t handshake_us = (uint32_t)(esp_timer_get_time() - handshake_start);
+    connected = true;
+
+    ESP_LOGI(TAG, "Verifying peer X.509 certificate...");
+    if ((flags = mbedtls_ssl_get_verify_result(&ssl)) != 0)
+    {
+        ESP_LOGW(TAG, "Failed to verify peer certificate!");
+        mbedtls_x509_crt_verify_info(buf, sizeof(buf), "  ! ", flags);
+        ESP_LOGW(TAG, "verification info: %s", buf);
+        forget_saved_session();
+        disconnect();
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    }
+    ESP_LOGI(TAG, "Certificate verified.");
+    ESP_LOGI(TAG, "Cipher suite is %s", mbedtls_ssl_get_ciphersuite(&ssl));
+    save_session(handshake_us);
+    return 0;
+}
+
+int Tls_transport::write(const char* data, size_t length)
+{
+    int ret;
+    size_t written_bytes = 0;
+    do {
+        ret = mbedtls_ssl_write(&ssl, (const unsigned char *)data + written_bytes, length - written_bytes);
+        if (ret >= 0)
+        {
+            ESP_LOGI(TAG, "%d bytes written", ret);
+            written_bytes += ret;
+        }
+        else if (ret != MBEDTLS_ERR_SSL_WANT_WRITE && ret != MBEDTLS_ERR_SSL_WANT_READ)
+        {
+            log_error("mbedtls_ssl_write", ret);
+            return ret;
+        }
+    } while(written_bytes < length);
+    return 0;
+}
+
+int Tls_transport::read(char* buf, size_t size)
+{
+    int ret;
+    do {
+        ret = mbedtls_ssl_read(&ssl, (unsigned char *)buf, size);
+    } while(ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        return 0;
+    if (ret < 0)
+        log_error("mbedtls_ssl_read", ret);
+    return ret;
+}
+
+//The server may have closed an idle connection, or sent something unexpected on it
+bool Tls_transport::is_usable()
+{
+    return connected && mbedtls_ssl_get_bytes_avail(&ssl) == 0 && mbedtls_net_poll(&server_fd, MBEDTLS_NET_POLL_READ, 0) == 0;
+}
+
+void Tls_transport::disconnect()
+{
+    if (connected)
+        mbedtls_ssl_close_notify(&ssl);
+    mbedtls_ssl_session_reset(&ssl);
+    mbedtls_net_free(&server_fd);
+    connected = false;
+}
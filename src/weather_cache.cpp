@@ -0,0 +1,172 @@
+/* This module keeps a copy of the latest fetched weather in the NVS, see weather_cache.h.
+ * The record is versioned and has a CRC like the configuration record, a record that doesn't match is ignored.
+ * The alert descriptions are not kept, they are too long for the value of a cold start.
+ */
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "store_data.h"
+#include "weather_data.h"
+#include "weather_cache.h"
+
+#define NVS_WEATHER_KEY "weather"
+#define WEATHER_CACHE_VERSION 1
+
+static const char *TAG = "WEATHER_CACHE";
+
+extern Weather_data Weather;
+
+/* The cached copy on the flash. The coordinates are stored to notice a location that was changed since,
+ * they are fixed-point values multiplied by 100 like in the configuration record.
+ */
+struct __attribute__((packed)) Weather_cache_record
+{
+    uint16_t version;
+    uint16_t size;
+    uint32_t crc;       //CRC32 of everything after this field
+    int64_t updated_at;
+    int32_t lat;
+    int32_t lon;
+    float temp;
+    float wind_speed;
+    int16_t pressure;
+    int16_t humidity;
+    int16_t wind_deg;
+    int32_t timezone_offset;
+    uint8_t weather_id_count;
+    int16_t weather_ids[WEATHER_SNAPSHOT_MAX_IDS];
+    uint8_t alert_count;
+    char alert_events[WEATHER_SNAPSHOT_MAX_ALERTS][WEATHER_SNAPSHOT_EVENT_SIZE];
+};
+#define WEATHER_CACHE_HEADER_SIZE offsetof(Weather_cache_record, updated_at)
+
+static Weather_cache_record saved;      //What is on the flash, to compare the next fetch with
+static bool has_saved = false;
+static int64_t saved_us = 0;            //esp_timer time of the last write
+
+static uint32_t get_crc(const Weather_cache_record* record)
+{
+    return esp_rom_crc32_le(0, (const uint8_t*)record + WEATHER_CACHE_HEADER_SIZE, sizeof(*record) - WEATHER_CACHE_HEADER_SIZE);
+}
+
+static void pack_record(const Weather_snapshot* snapshot, Weather_cache_record* record)
+{
+    memset(record, 0, sizeof(*record));
+    record->version = WEATHER_CACHE_VERSION;
+    record->size = sizeof(*record);
+    record->updated_at = snapshot->updated_at;
+    record->lat = (int32_t)(snapshot->lat * 100);
+    record->lon = (int32_t)(snapshot->lon * 100);
+    record->temp = snapshot->temp;
+    record->wind_speed = snapshot->wind_speed;
+    record->pressure = snapshot->pressure;
+    record->humidity = snapshot->humidity;
+    record->wind_deg = snapshot->wind_deg;
+    record->timezone_offset = snapshot->timezone_offset;
+    record->weather_id_count = snapshot->weather_id_count;
+    for (int i = 0; i < snapshot->weather_id_count; i++)
+        record->weather_ids[i] = snapshot->weather_ids[i];
+    record->alert_count = snapshot->alert_count < WEATHER_SNAPSHOT_MAX_ALERTS ? snapshot->alert_count : WEATHER_SNAPSHOT_MAX_ALERTS;
+    memcpy(record->alert_events, snapshot->alert_events, record->alert_count * WEATHER_SNAPSHOT_EVENT_SIZE);
+    record->crc = get_crc(record);
+}
+
+esp_err_t weather_cache_load()
+{
+    Weather_cache_record record;
+    size_t size = sizeof(record);
+    esp_err_t ret = nvs_read_blob(NVS_WEATHER_KEY, &record, &size);
+    if (ret == ESP_ERR_NVS_NOT_FOUND)
+    {
+        ESP_LOGI(TAG, "There is no cached weather yet.");
+        return ret;
+    }
+    if (ret != ESP_OK)
+        return ret;
+    if (size != sizeof(record) || record.version != WEATHER_CACHE_VERSION || record.size != sizeof(record)
+        || record.crc != get_crc(&record) || record.weather_id_count > WEATHER_SNAPSHOT_MAX_IDS
+        || record.alert_count > WEATHER_SNAPSHOT_MAX_ALERTS)
+    {
+        ESP_LOGW(TAG, "The cached weather is invalid, ignoring it.");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    Weather.lock();
+    //The weather of another location would be wrong, not just old
+    if (record.lat != (int32_t)(Weather.get_lat() * 100) || record.lon != (int32_t)(Weather.get_lon() * 100))
+    {
+        Weather.unlock();
+        ESP_LOGI(TAG, "The cached weather is of other coordinates, ignoring it.");
+        return ESP_ERR_NOT_FOUND;
+    }
+    Weather.set_temp(record.temp);
+    Weather.set_wind_speed(record.wind_speed);
+    Weather.set_pressure(record.pressure);
+    Weather.set_humidity(record.humidity);
+    Weather.set_wind_deg(record.wind_deg);
+    Weather.set_timezone_offset(record.timezone_offset);
+    vector<int> weather_ids;
+    for (int i = 0; i < record.weather_id_count; i++)
+        weather_ids.push_back(record.weather_ids[i]);
+    Weather.set_weather_id(weather_ids);
+    vector<string> events, descriptions;
+    for (int i = 0; i < record.alert_count; i++)
+    {
+        record.alert_events[i][WEATHER_SNAPSHOT_EVENT_SIZE - 1] = '\0';
+        events.push_back(record.alert_events[i]);
+        descriptions.push_back("");
+    }
+    Weather.set_alert_event(events);
+    Weather.set_alert_description(descriptions);
+    Weather.set_cached(record.updated_at);
+    Weather.unlock();
+
+    saved = record;
+    has_saved = true;
+    saved_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Loaded the cached weather of %" PRId64 ": %.2f °C, %d alert(s)", record.updated_at, record.temp, record.alert_count);
+    return ESP_OK;
+}
+
+//Whether the new record differs from the one on the flash enough to be written
+static bool is_worth_saving(const Weather_cache_record* record)
+{
+    if (!has_saved)
+        return true;
+    if (esp_timer_get_time() - saved_us >= (int64_t)WEATHER_CACHE_REFRESH_S * 1000000)
+        return true;
+    //The fetch time of the copy on the flash is unknown, the clock has been set since
+    if (saved.updated_at == 0 && record->updated_at != 0)
+        return true;
+    return fabsf(record->temp - saved.temp) >= WEATHER_CACHE_TEMP_DELTA
+           || record->lat != saved.lat || record->lon != saved.lon
+           || record->weather_id_count != saved.weather_id_count
+           || memcmp(record->weather_ids, saved.weather_ids, sizeof(record->weather_ids)) != 0
+           || record->alert_count != saved.alert_count
+           || memcmp(record->alert_events, saved.alert_events, sizeof(record->alert_events)) != 0;
+}
+
+esp_err_t weather_cache_save()
+{
+    Weather_snapshot snapshot = Weather.get_snapshot();
+    Weather_cache_record record;
+    pack_record(&snapshot, &record);
+    if (!is_worth_saving(&record))
+        return ESP_OK;
+
+    esp_err_t ret = nvs_write_blob(NVS_WEATHER_KEY, &record, sizeof(record));
+    if (ret == ESP_OK)
+    {
+        saved = record;
+        has_saved = true;
+        saved_us = esp_timer_get_time();
+        ESP_LOGI(TAG, "Cached the weather of %" PRId64, record.updated_at);
+    }
+    return ret;
+}
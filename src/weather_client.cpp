@@ -0,0 +1,92 @@
+/* This module sends a request to a weather provider and reads its response, whatever the provider and the transport are.
+ * A kept-alive connection is used again. If the server closed it in the meantime, the request is sent again
+ * on a new connection.
+ */
+#include "esp_log.h"
+#include "metrics.h"
+#include "weather_client.h"
+
+static const char *TAG = "WEATHER_CLIENT";
+static Metric_counter connections_reused("weather_connections_reused_total", "Weather requests sent on the kept-alive connection of the previous one.");
+
+/* Reading the response until it is complete. Every chunk is parsed as it arrives, the response is never held
+ * as a whole. Returns 0 if the response has been read, even if it was invalid, and the error of the transport otherwise.
+ * *received tells whether any byte arrived: a kept-alive connection that the server closed in the meantime sends none.
+ * *closed tells whether the server closed the connection.
+ */
+static int read_response(Weather_transport* transport, Weather_provider* provider, bool* received, bool* closed)
+{
+    char buf[512];
+    int ret;
+    ESP_LOGI(TAG, "Reading HTTP response...");
+    provider->begin_response();
+    *received = false;
+    *closed = false;
+    do {
+        ret = transport->read(buf, sizeof(buf));
+        if (ret == 0)
+        {
+            ESP_LOGI(TAG, "connection closed");
+            *closed = true;
+            return *received ? 0 : WEATHER_TRANSPORT_ERR_CLOSED;
+        }
+        if (ret < 0)
+            return ret;
+
+        *received = true;
+        ESP_LOGD(TAG, "%d bytes read", ret);
+        if (!provider->feed_response(buf, ret))
+            return 0;
+    } while(!provider->is_response_complete());
+    return 0;
+}
+
+int weather_client_fetch(Weather_transport* transport, Weather_provider* provider, const char* request, size_t request_length,
+                         bool* parsed)
+{
+    int ret = 0;
+    bool received = false, closed = false;
+    *parsed = false;
+    //A failed connection leaves no stale status behind
+    provider->begin_response();
+    if (transport->is_connected() && !transport->is_usable())
+    {
+        ESP_LOGI(TAG, "The server has closed the connection");
+        transport->disconnect();
+    }
+
+    for (int attempt = 0; attempt < 2 && !received; attempt++)
+    {
+        bool reused = transport->is_connected();
+        if (!reused)
+        {
+            ESP_LOGI(TAG, "Connecting to %s:%s (%s)...", provider->get_host(), provider->get_port(), provider->get_name());
+            if ((ret = transport->connect(provider->get_host(), provider->get_port())) != 0)
+                return ret;
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Reusing the connection");
+            connections_reused.add();
+        }
+
+        ESP_LOGI(TAG, "Writing HTTP request...");
+        ret = transport->write(request, request_length);
+        if (ret == 0)
+            ret = read_response(transport, provider, &received, &closed);
+        if (ret != 0)
+        {
+            transport->disconnect();
+            if (!reused || received)
+                return ret;
+        }
+    }
+    if (ret != 0)
+        return ret;
+
+    //A rejected request (e.g. a 429) that was read to its end leaves the connection usable for the next one
+    *parsed = provider->finish_response();
+    if (closed || !provider->get_response().keep_alive)
+        transport->disconnect();
+    return 0;
+}
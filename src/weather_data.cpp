@@ -1,7 +1,10 @@
 //The data that is acquired from the Openweathermap API is stored in a class instance.
 #include <vector>
 #include <string>
+#include <string.h>
+#include <time.h>
 #include "weather_data.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 #include "credentials.h"
 using namespace std;
@@ -98,18 +101,152 @@ float Weather_data::get_lon()
     return lon;
 }
 
+void Weather_data::set_forecast(const Weather_forecast* forecast)
+{
+    this -> forecast = *forecast;
+}
+void Weather_data::get_forecast(Weather_forecast* forecast)
+{
+    time_t now = time(NULL);
+    lock();
+    if (now >= WEATHER_CLOCK_VALID_S)
+    {
+        forecast_ring_drop_before(&this -> forecast.hourly.ring, now);
+        forecast_ring_drop_before(&this -> forecast.daily.ring, now);
+    }
+    *forecast = this -> forecast;
+    unlock();
+}
+
+void Weather_data::set_fetched(int64_t server_date)
+{
+    time_t now = time(NULL);
+    has_data = true;
+    //Before SNTP the data is dated by the server, so that the cached copy has a known age after a restart
+    if (now >= WEATHER_CLOCK_VALID_S)
+        updated_at = now;
+    else
+        updated_at = server_date >= WEATHER_CLOCK_VALID_S ? server_date : 0;
+    fetched_us = esp_timer_get_time();
+}
+void Weather_data::set_cached(int64_t updated_at)
+{
+    has_data = true;
+    this -> updated_at = updated_at;
+    fetched_us = -1;
+}
+int64_t Weather_data::get_updated_at()
+{
+    return updated_at;
+}
+
+/* The data fetched since the boot is timed by esp_timer, which runs before SNTP has set the clock.
+ * The cached data can only be timed by the clock, and by its fetch time that was stored with it.
+ */
+int32_t Weather_data::calculate_age_s()
+{
+    if (fetched_us >= 0)
+        return (int32_t)((esp_timer_get_time() - fetched_us) / 1000000);
+    time_t now = time(NULL);
+    if (updated_at == 0 || now < WEATHER_CLOCK_VALID_S)
+        return -1;
+    //A clock that was set back makes it look new, it is not trusted
+    return now >= updated_at ? (int32_t)(now - updated_at) : WEATHER_EXPIRED_AGE_S;
+}
+
+Weather_freshness Weather_data::calculate_freshness()
+{
+    if (!has_data)
+        return WEATHER_MISSING;
+    int32_t age_s = calculate_age_s();
+    if (age_s < 0)
+        return WEATHER_UNVERIFIED;
+    if (age_s < WEATHER_STALE_AGE_S)
+        return WEATHER_FRESH;
+    if (age_s < WEATHER_EXPIRED_AGE_S)
+        return WEATHER_STALE;
+    return WEATHER_MISSING;
+}
+
+Weather_freshness Weather_data::get_freshness()
+{
+    lock();
+    Weather_freshness freshness = calculate_freshness();
+    unlock();
+    return freshness;
+}
+
 Weather_data::Weather_data()
 {
+    mutex = xSemaphoreCreateMutex();
     pressure = humidity = wind_deg = timezone_offset = 0;
     temp = wind_speed = 0;
+    has_data = false;
+    updated_at = 0;
+    fetched_us = -1;
+    weather_forecast_init(&forecast);
     lat = LAT;
     lon = LON;
 }
 
+void Weather_data::lock()
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void Weather_data::unlock()
+{
+    xSemaphoreGive(mutex);
+}
+
+Weather_snapshot Weather_data::get_snapshot()
+{
+    Weather_snapshot snapshot;
+    lock();
+    snapshot.pressure = pressure;
+    snapshot.humidity = humidity;
+    snapshot.wind_deg = wind_deg;
+    snapshot.timezone_offset = timezone_offset;
+    snapshot.temp = temp;
+    snapshot.wind_speed = wind_speed;
+    snapshot.lat = lat;
+    snapshot.lon = lon;
+    snapshot.weather_id_count = weather_ids.size() < WEATHER_SNAPSHOT_MAX_IDS ? weather_ids.size() : WEATHER_SNAPSHOT_MAX_IDS;
+    for (int i = 0; i < snapshot.weather_id_count; i++)
+        snapshot.weather_ids[i] = weather_ids[i];
+    snapshot.alert_count = alert_events.size();
+    for (int i = 0; i < snapshot.alert_count && i < WEATHER_SNAPSHOT_MAX_ALERTS; i++)
+    {
+        strncpy(snapshot.alert_events[i], alert_events[i].c_str(), WEATHER_SNAPSHOT_EVENT_SIZE - 1);
+        snapshot.alert_events[i][WEATHER_SNAPSHOT_EVENT_SIZE - 1] = '\0';
+    }
+    snapshot.freshness = calculate_freshness();
+    snapshot.age_s = calculate_age_s();
+    snapshot.updated_at = updated_at;
+    unlock();
+    return snapshot;
+}
+
 void list_vector(vector<int> vec)
 {
-    for(int i = 0; i < vec.size(); i++)
+    for(size_t i = 0; i < vec.size(); i++)
     {
         ESP_LOGI(TAG, "%d", vec[i] );
     }
-}
\ No newline at end of file
+}
+
+const char* weather_freshness_name(Weather_freshness freshness)
+{
+    switch (freshness)
+    {
+        case WEATHER_MISSING:
+            return "missing";
+        case WEATHER_FRESH:
+            return "fresh";
+        case WEATHER_UNVERIFIED:
+            return "unverified";
+        case WEATHER_STALE:
+            return "stale";
+    }
+    return "unknown";
+}
@@ -0,0 +1,106 @@
+/* This module stores the hourly and the daily forecast, see weather_forecast.h.
+ * The parser of JSON_parser.cpp writes the entries into the ring as they are read from the response.
+ */
+#include <string.h>
+#include <math.h>
+#include "weather_forecast.h"
+
+//Every weather condition code of Openweathermap, the packed code is the index + 1
+static const uint16_t weather_ids[] =
+{
+    200, 201, 202, 210, 211, 212, 221, 230, 231, 232,
+    300, 301, 302, 310, 311, 312, 313, 314, 321,
+    500, 501, 502, 503, 504, 511, 520, 521, 522, 531,
+    600, 601, 602, 611, 612, 613, 615, 616, 620, 621, 622,
+    701, 711, 721, 731, 741, 751, 761, 762, 771, 781,
+    800, 801, 802, 803, 804
+};
+
+#define WEATHER_ID_COUNT (sizeof(weather_ids) / sizeof(weather_ids[0]))
+
+static void init_ring(Forecast_ring* ring, uint16_t capacity, uint32_t step_s, uint32_t tolerance_s)
+{
+    ring->start = 0;
+    ring->last = 0;
+    ring->step_s = step_s;
+    ring->tolerance_s = tolerance_s;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->count = 0;
+}
+
+void weather_forecast_init(Weather_forecast* forecast)
+{
+    memset(forecast, 0, sizeof(*forecast));
+    init_ring(&forecast->hourly.ring, FORECAST_HOURS, FORECAST_HOUR_S, 0);
+    init_ring(&forecast->daily.ring, FORECAST_DAYS, FORECAST_DAY_S, FORECAST_DAY_TOLERANCE_S);
+}
+
+int forecast_ring_push(Forecast_ring* ring, int64_t time)
+{
+    if (ring->count >= ring->capacity)
+        return -1;
+    if (ring->count == 0)
+    {
+        ring->start = time;
+    }
+    else
+    {
+        //Compared with the last entry, so the shifts don't add up
+        int64_t shift = time - (ring->last + ring->step_s);
+        if (shift < -(int64_t)ring->tolerance_s || shift > (int64_t)ring->tolerance_s)
+            return -1;
+    }
+    ring->last = time;
+    return forecast_ring_slot(ring, ring->count++);
+}
+
+int forecast_ring_slot(const Forecast_ring* ring, int index)
+{
+    return (ring->head + index) % ring->capacity;
+}
+
+int64_t forecast_ring_time(const Forecast_ring* ring, int index)
+{
+    return ring->start + (int64_t)index * ring->step_s;
+}
+
+void forecast_ring_drop_before(Forecast_ring* ring, int64_t time)
+{
+    while (ring->count > 0 && ring->start + ring->step_s <= time)
+    {
+        ring->head = (ring->head + 1) % ring->capacity;
+        ring->start += ring->step_s;
+        ring->count--;
+    }
+}
+
+int16_t forecast_to_fixed(float value, int scale)
+{
+    float scaled = roundf(value * scale);
+    if (!(scaled > INT16_MIN))
+        return INT16_MIN;
+    if (scaled > INT16_MAX)
+        return INT16_MAX;
+    return (int16_t)scaled;
+}
+
+float forecast_from_fixed(int16_t value, int scale)
+{
+    return (float)value / scale;
+}
+
+uint8_t weather_id_pack(int id)
+{
+    for (size_t i = 0; i < WEATHER_ID_COUNT; i++)
+    {
+        if (weather_ids[i] == id)
+            return (uint8_t)(i + 1);
+    }
+    return 0;
+}
+
+int weather_id_unpack(uint8_t packed)
+{
+    return packed > 0 && packed <= WEATHER_ID_COUNT ? weather_ids[packed - 1] : 0;
+}
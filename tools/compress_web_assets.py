@@ -0,0 +1,34 @@
+# Precompressing the web assets of the data directory before the SPIFFS image is built.
+# The webserver sends "<file>.gz" to the browsers that accept a gzip compressed response.
+# The gzip header has no timestamp, so the output (and the ETag of the file) only changes with the content.
+#
+# Used by PlatformIO as an extra script, or standalone: python tools/compress_web_assets.py [data directory]
+import gzip
+import os
+import sys
+
+COMPRESSED_EXTENSIONS = (".html", ".css", ".js", ".json", ".svg")
+
+
+def compress_web_assets(data_dir):
+    for name in sorted(os.listdir(data_dir)):
+        source = os.path.join(data_dir, name)
+        if not name.endswith(COMPRESSED_EXTENSIONS) or not os.path.isfile(source):
+            continue
+        target = source + ".gz"
+        if os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+            continue
+        with open(source, "rb") as f:
+            content = f.read()
+        with open(target, "wb") as f:
+            with gzip.GzipFile(filename="", mode="wb", compresslevel=9, fileobj=f, mtime=0) as gz:
+                gz.write(content)
+        print("Compressed %s: %d -> %d bytes" % (name, len(content), os.path.getsize(target)))
+
+
+try:
+    Import("env")  # noqa: F821, defined by PlatformIO
+    compress_web_assets(env.subst("$PROJECT_DATA_DIR"))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        compress_web_assets(sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), "..", "data"))